@@ -1,13 +1,12 @@
 #!/bin/bash
 
-BINARY=bin/fred
+BINARY=bin/edison
 EDSCRIPT=scripts/unfunny.edl
-SAMPLE=samples/lowerbible.txt
+SAMPLE=samples/lowerulysses.txt
 RESULT=raptorbible.txt
 
 if [ ! -e $BINARY ]; then
-	make
-	mv bin/led bin/fred
+	make release
 fi
 
 if [ ! -e $BINARY ]; then
@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# Runs scripts with and without -O and checks that they write the same
+# file. The file is still being read in the background when the first
+# commands run, so merged commands must not look at it before it's all
+# there.
+
+BINARY=${1:-bin/edison}
+WORK=/tmp/optimize-check
+
+if [ ! -e $BINARY ]; then
+	echo Build "$BINARY" first.
+	exit 1
+fi
+
+rm -rf $WORK
+mkdir -p $WORK
+
+FAILED=0
+
+# check NAME SCRIPT: SCRIPT has to end with a W to $WORK/out.txt. What's
+# listed and the summary of a quiet run have to be the same, too.
+check() {
+	for QUIET in "" -q; do
+		for MODE in plain opt; do
+			printf 'l1\nl2\nl3\nl4\nl5\nl6\nl7\n' > $WORK/doc.txt
+			printf "$2" > $WORK/script.edl
+			rm -f $WORK/out.txt
+			if [ $MODE = opt ]; then
+				$BINARY $QUIET -O -s $WORK/script.edl $WORK/doc.txt > $WORK/$MODE.log 2> $WORK/$MODE.err
+			else
+				$BINARY $QUIET -s $WORK/script.edl $WORK/doc.txt > $WORK/$MODE.log 2> $WORK/$MODE.err
+			fi
+			mv $WORK/out.txt $WORK/$MODE.txt
+			[ -n "$QUIET" ] && tail -n 1 $WORK/$MODE.err >> $WORK/$MODE.log
+		done
+
+		if cmp -s $WORK/plain.txt $WORK/opt.txt && cmp -s $WORK/plain.log $WORK/opt.log; then
+			echo "$1 $QUIET: ok"
+		else
+			echo "$1 $QUIET: FAILED"
+			FAILED=1
+		fi
+	done
+}
+
+check "delete group" '5,5D\n6D\nW"'$WORK'/out.txt"\nQ\n'
+check "delete group, whole file" '1,2D\n1D\nW"'$WORK'/out.txt"\nQ\n'
+check "replace group" '1,7R"l","x"\n1,7R"x","y"\nW"'$WORK'/out.txt"\nQ\n'
+check "replace group, listed" '1,7R"l","x"\n1,7R"2","y"\n1,3L\nW"'$WORK'/out.txt"\nQ\n'
+check "dropped W" 'W"'$WORK'/out.txt"\n3D\nW"'$WORK'/out.txt"\nQ\n'
+
+# Over several files, a bare W writes each of them in turn, so it can't
+# be dropped for a later W to one of them.
+for MODE in plain opt; do
+	printf 'a1\na2\n' > $WORK/a.txt
+	printf 'b1\nb2\n' > $WORK/b.txt
+	printf '1D\nW\n1D\nW"'$WORK'/a.txt"\nQ\n' > $WORK/script.edl
+	if [ $MODE = opt ]; then
+		$BINARY -q -O -s $WORK/script.edl $WORK/a.txt $WORK/b.txt > /dev/null 2>&1
+	else
+		$BINARY -q -s $WORK/script.edl $WORK/a.txt $WORK/b.txt > /dev/null 2>&1
+	fi
+	mv $WORK/b.txt $WORK/$MODE.txt
+done
+
+if cmp -s $WORK/plain.txt $WORK/opt.txt; then
+	echo "bare W, several files: ok"
+else
+	echo "bare W, several files: FAILED"
+	FAILED=1
+fi
+
+rm -rf $WORK
+exit $FAILED
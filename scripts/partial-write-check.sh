@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Writes part of a file onto itself while it's still being read in the
+# background, then all of it. Nothing of the file may be lost on the way,
+# with or without an index next to it.
+
+BINARY=${1:-bin/edison}
+WORK=/tmp/partial-write-check
+N_LINES=2000000
+
+if [ ! -e $BINARY ]; then
+	echo Build "$BINARY" first.
+	exit 1
+fi
+
+rm -rf $WORK
+mkdir -p $WORK
+
+FAILED=0
+
+# check NAME OPTIONS: the first 5 lines are written over the file, then
+# the whole document.
+check() {
+	seq 1 $N_LINES > $WORK/expect.txt
+	cp $WORK/expect.txt $WORK/doc.txt
+	rm -f $WORK/doc.txt.edx
+
+	# Leaves an index behind, if it's asked for.
+	if [ -n "$2" ]; then
+		printf 'W"/dev/null"\nQ\nY\n' | $BINARY $2 $WORK/doc.txt > /dev/null 2>&1
+	fi
+
+	printf '5W\nE\n' | $BINARY $2 $WORK/doc.txt > /dev/null 2>&1
+	if [ $? -eq 0 ] && cmp -s $WORK/expect.txt $WORK/doc.txt; then
+		echo "$1: ok"
+	else
+		echo "$1: FAILED"
+		FAILED=1
+	fi
+}
+
+check "partial W, then E"
+check "partial W, then E, indexed" -x
+
+rm -rf $WORK
+exit $FAILED
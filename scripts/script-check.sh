@@ -0,0 +1,52 @@
+#!/bin/bash
+
+# Runs scripts with -s (and -s -O) and piped into the editor, and checks
+# that they write the same file. The lines after a command that fails
+# aren't its text, so they have to run as commands either way.
+
+BINARY=${1:-bin/edison}
+WORK=/tmp/script-check
+
+if [ ! -e $BINARY ]; then
+	echo Build "$BINARY" first.
+	exit 1
+fi
+
+rm -rf $WORK
+mkdir -p $WORK
+
+FAILED=0
+
+# check NAME SCRIPT: SCRIPT has to end with a W to $WORK/out.txt.
+check() {
+	for MODE in piped script opt; do
+		printf 'l1\nl2\nl3\nl4\nl5\n' > $WORK/doc.txt
+		printf "$2" > $WORK/script.edl
+		rm -f $WORK/out.txt
+		case $MODE in
+			piped)	$BINARY $WORK/doc.txt < $WORK/script.edl > /dev/null 2>&1 ;;
+			script)	$BINARY -s $WORK/script.edl $WORK/doc.txt > /dev/null 2>&1 ;;
+			opt)	$BINARY -O -s $WORK/script.edl $WORK/doc.txt > /dev/null 2>&1 ;;
+		esac
+		mv $WORK/out.txt $WORK/$MODE.txt
+	done
+
+	if cmp -s $WORK/piped.txt $WORK/script.txt && cmp -s $WORK/piped.txt $WORK/opt.txt; then
+		echo "$1: ok"
+	else
+		echo "$1: FAILED"
+		FAILED=1
+	fi
+}
+
+check "edit past the end" '50\n2D\nW"'$WORK'/out.txt"\nQ\n'
+check "edit" '2\nnew\nW"'$WORK'/out.txt"\nQ\n'
+check "edit past the end, then I" '50\n1I\nnew\n.\nW"'$WORK'/out.txt"\nQ\n'
+check "edit, then I" '2\n1I\nnew\n.\nW"'$WORK'/out.txt"\nQ\n'
+check "I with a range" '1,2I\n3D\n.\nW"'$WORK'/out.txt"\nQ\n'
+check "A with a count" '2A\nx\ny\n1D\n.\nW"'$WORK'/out.txt"\nQ\n'
+check "edit past the end, then D group" '50\n1D\n1D\n2,3R"l","x"\n2,3R"x","y"\nW"'$WORK'/out.txt"\nQ\n'
+check "edit past the end, then W" '50\nW"'$WORK'/out.txt"\n1D\nW"'$WORK'/out.txt"\nQ\n'
+
+rm -rf $WORK
+exit $FAILED
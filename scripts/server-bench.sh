@@ -0,0 +1,68 @@
+#!/bin/bash
+
+# Starts a server on a copy of the sample and lets CLIENTS clients send
+# COMMANDS commands each, all at once. For comparison, the same commands
+# are then run by starting the editor once per client.
+
+BINARY=bin/edison
+CLIENT=bin/edison-client
+SAMPLE=samples/lowerulysses.txt
+DOC=/tmp/server-bench.txt
+SOCKET=/tmp/server-bench.sock
+
+CLIENTS=${1:-16}
+COMMANDS=${2:-1000}
+
+if [ ! -e $BINARY ] || [ ! -e $CLIENT ]; then
+	echo Build "$BINARY" and "$CLIENT" first.
+	exit 1
+fi
+
+cp $SAMPLE $DOC
+rm -f $SOCKET
+$BINARY -q -S $SOCKET $DOC 2> /dev/null &
+SERVER=$!
+
+while [ ! -S $SOCKET ]; do
+	sleep 0.1
+done
+
+# Searches, edits and listings, with a line that fails now and then.
+for ((I = 0; I < COMMANDS; I++)); do
+	case $((I % 5)) in
+		0) echo "$((I % 100 + 1))" ;;
+		1) echo "~S\"the\"" ;;
+		2) echo "$((I % 100 + 1)),$((I % 100 + 5))~R\"the\",\"teh\"" ;;
+		3) echo "$((I % 100 + 1)),$((I % 100 + 3))L" ;;
+		4) echo "~R\"teh\",\"the\"" ;;
+	esac
+done > /tmp/server-bench.edl
+echo Q >> /tmp/server-bench.edl
+
+START=$(date +%s.%N)
+for ((I = 0; I < CLIENTS; I++)); do
+	$CLIENT $SOCKET < /tmp/server-bench.edl > /dev/null &
+done
+wait $(jobs -p | grep -v "^$SERVER\$")
+END=$(date +%s.%N)
+
+kill $SERVER
+wait $SERVER 2> /dev/null
+
+echo "Server, $CLIENTS clients, $COMMANDS commands each:" \
+	$(awk "BEGIN { print $END - $START }") s, \
+	$(awk "BEGIN { printf \"%d\", $CLIENTS * $COMMANDS / ($END - $START) }") commands/s
+
+START=$(date +%s.%N)
+for ((I = 0; I < CLIENTS; I++)); do
+	$BINARY -q $DOC < /tmp/server-bench.edl > /dev/null 2>&1
+done
+END=$(date +%s.%N)
+
+echo "One editor per client:" \
+	$(awk "BEGIN { print $END - $START }") s, \
+	$(awk "BEGIN { printf \"%d\", $CLIENTS * $COMMANDS / ($END - $START) }") commands/s
+
+rm -f $DOC /tmp/server-bench.edl
+
+exit 0
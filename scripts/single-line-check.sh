@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Runs R from a single line number on a file bigger than one read block,
+# while it's still being read in the background. Like S, it goes from the
+# line after the cursor to the end of the file, so it has to wait for all
+# of it; each run is repeated, as a short wait only loses lines now and
+# then.
+
+BINARY=${1:-bin/edison}
+WORK=/tmp/single-line-check
+N_LINES=300000
+RUNS=5
+
+if [ ! -e $BINARY ]; then
+	echo Build "$BINARY" first.
+	exit 1
+fi
+
+rm -rf $WORK
+mkdir -p $WORK
+
+FAILED=0
+
+yes a | head -n $N_LINES > $WORK/doc.txt
+
+# check NAME COMMAND EXPECT: COMMAND is run on the document, which is then
+# written out and compared with EXPECT.
+check() {
+	local RESULT=ok
+	for ((I = 0; I < RUNS; I++)); do
+		rm -f $WORK/out.txt
+		printf '%s\nW"%s"\nQ\nY\n' "$2" $WORK/out.txt | $BINARY -q $WORK/doc.txt > /dev/null 2>&1
+		if [ $? -ne 0 ] || ! cmp -s $3 $WORK/out.txt; then
+			RESULT=FAILED
+			FAILED=1
+		fi
+	done
+	echo "$1: $RESULT"
+}
+
+sed '2,$s/a/e/' $WORK/doc.txt > $WORK/replaced.txt
+check "single line R" '6R"a","e"' $WORK/replaced.txt
+check "single line ~R" '6~R"a","e"' $WORK/replaced.txt
+
+rm -rf $WORK
+exit $FAILED
@@ -0,0 +1,161 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+/* Talks to an editor started with -S: whatever comes in on stdin goes to
+   the server, whatever the server says goes to stdout. Piping a list of
+   commands into it works like piping them into the editor itself. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define CLIENT_NAME		"edison-client"
+
+#ifndef _WIN32
+
+#define BUF_SIZE		4096
+
+static int write_all(const int fd, const char *buf, size_t size) {
+	ssize_t n;
+
+	while(size > 0) {
+		if((n = write(fd, buf, size)) < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		buf += n;
+		size -= n;
+	}
+
+	return 0;
+}
+
+static int connect_to(const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: Socket path too long.\n", CLIENT_NAME);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror(CLIENT_NAME);
+		return -1;
+	}
+
+	if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		perror(CLIENT_NAME);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Sends what it can of what's pending without waiting. */
+static int send_some(const int fd, char *buf, size_t *used) {
+	ssize_t n;
+
+	if((n = write(fd, buf, *used)) < 0) {
+		if((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+		return -1;
+	}
+
+	memmove(buf, buf + n, *used - n);
+	*used -= n;
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	struct pollfd fds[2];
+	char buf[BUF_SIZE], pending[BUF_SIZE];
+	size_t n_pending = 0;
+	ssize_t n;
+	int fd, input_open = 1, shut = 0;
+
+	if(argc != 2) {
+		printf("USAGE: %s socket\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if((fd = connect_to(argv[1])) < 0)
+		return EXIT_FAILURE;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	/* The server may have a lot to say before it reads on. Waiting for
+	   it to take our input while it waits for us to take its output
+	   would never end, so neither side of the socket blocks. */
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	/* Runs until the server hangs up, which it does after E, Q or the
+	   end of our input. */
+	for(;;) {
+		fds[0].fd = fd;
+		fds[0].events = n_pending > 0 ? POLLIN | POLLOUT : POLLIN;
+		fds[1].fd = input_open && (n_pending == 0) ? STDIN_FILENO : -1;
+		fds[1].events = POLLIN;
+
+		if(poll(fds, 2, -1) < 0) {
+			if(errno == EINTR) continue;
+			perror(CLIENT_NAME);
+			break;
+		}
+
+		if(fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+			if((n = read(fd, buf, BUF_SIZE)) == 0) break;
+			if(n < 0) {
+				if((errno != EINTR) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) break;
+			} else if(write_all(STDOUT_FILENO, buf, n) < 0) {
+				break;
+			}
+		}
+
+		if((n_pending > 0) && (fds[0].revents & POLLOUT)) {
+			if(send_some(fd, pending, &n_pending) < 0) {
+				n_pending = 0;
+				input_open = 0;
+			}
+		}
+
+		if((fds[1].fd >= 0) && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+			if((n = read(STDIN_FILENO, pending, BUF_SIZE)) <= 0) input_open = 0;
+			else n_pending = n;
+		}
+
+		/* The end of our input goes out after the rest of it. */
+		if(!input_open && (n_pending == 0) && !shut) {
+			shutdown(fd, SHUT_WR);
+			shut = 1;
+		}
+	}
+
+	close(fd);
+	return EXIT_SUCCESS;
+}
+
+#else
+
+int main(int argc, char **argv) {
+	fprintf(stderr, "%s: Unix domain sockets aren't supported here.\n", CLIENT_NAME);
+	return EXIT_FAILURE;
+}
+
+#endif
@@ -20,6 +20,8 @@ typedef struct dynarr_t {
 	size_t n_used, n_alloced;
 	void *data;
 	dynarr_freefunc_t freefunc;
+	dynarr_releasefunc_t release;
+	void *release_ctx;
 } dynarr_t;
 
 static void *get_index(dynarr_t *arr, const size_t index) {
@@ -32,6 +34,14 @@ static void *get_index(dynarr_t *arr, const size_t index) {
 	return raw_array + arr->element_size * index;
 }
 
+/* Grows by at least as much as there already is, so filling an array
+   one element at a time doesn't copy it over and over. */
+static size_t growth(const dynarr_t *arr, const size_t n_needed) {
+	size_t out = arr->n_alloced > arr->prealloc_size ? arr->n_alloced : arr->prealloc_size;
+
+	return n_needed > out ? n_needed : out;
+}
+
 static int dynarr_extend(dynarr_t *arr, const size_t n_blocks) {
 	size_t old_size, new_size;
 	char *new_data;
@@ -50,6 +60,15 @@ static int dynarr_extend(dynarr_t *arr, const size_t n_blocks) {
 	return RET_OK;
 }
 
+/* Elements taken out by a delete go to the release function instead of
+   the free function, if there is one. */
+static void drop_element(dynarr_t *arr, void *element) {
+	if(arr->release != NULL)
+		arr->release(arr->release_ctx, element);
+	else if(arr->freefunc != NULL)
+		arr->freefunc(element);
+}
+
 /**/
 
 int dynarr_append(dynarr_t *arr, const void *data) {
@@ -59,7 +78,7 @@ int dynarr_append(dynarr_t *arr, const void *data) {
 	if(arr == NULL) return RET_ERR_NULLPO;
 
 	if(arr->n_used == arr->n_alloced)
-		if((status = dynarr_extend(arr, arr->prealloc_size)) != RET_OK)
+		if((status = dynarr_extend(arr, growth(arr, 1))) != RET_OK)
 			return status;
 
 	if((out_pos = dynarr_get_element(arr, arr->n_used)) != NULL)
@@ -90,7 +109,7 @@ int dynarr_append(dynarr_t *arr, const void *data) {
 
 	for(i = actual_start; i < actual_end + 1; i++) {
 		if((element = dynarr_get_element(arr, i)) != NULL)
-			arr->freefunc(element);
+			drop_element(arr, element);
 	}
 
 	move_from = dynarr_get_element(arr, actual_end + 1);
@@ -112,7 +131,7 @@ int dynarr_insert(dynarr_t *arr, const void *data, const size_t pos) {
 	if(arr == NULL) return RET_ERR_NULLPO;
 
 	if(arr->n_used == arr->n_alloced)
-		if((status = dynarr_extend(arr, arr->prealloc_size)) != RET_OK)
+		if((status = dynarr_extend(arr, growth(arr, 1))) != RET_OK)
 			return status;
 
 	bytes = arr->data;
@@ -174,6 +193,71 @@ int dynarr_move(dynarr_t *arr, const size_t start_index, const size_t end_index,
 	return RET_OK;
 }
 
+int dynarr_insert_range(dynarr_t *arr, const void *data, const size_t n_elements, const size_t pos) {
+	size_t actual_pos = pos, n_free;
+	uint8_t *bytes;
+	int status;
+
+	if((arr == NULL) || (data == NULL)) return RET_ERR_NULLPO;
+	if(n_elements == 0) return RET_OK;
+
+	n_free = arr->n_alloced - arr->n_used;
+	if(n_free < n_elements)
+		if((status = dynarr_extend(arr, growth(arr, n_elements - n_free))) != RET_OK)
+			return status;
+
+	bytes = arr->data;
+	if(pos > arr->n_used) actual_pos = arr->n_used;
+
+	/* One move for the tail, no matter how many elements go in. */
+	memmove(bytes + (actual_pos + n_elements) * arr->element_size,
+		bytes + actual_pos * arr->element_size,
+		(arr->n_used - actual_pos) * arr->element_size);
+	memcpy(bytes + actual_pos * arr->element_size, data, n_elements * arr->element_size);
+	arr->n_used += n_elements;
+
+	return RET_OK;
+}
+
+/* Removes the elements at the given (ascending) indices in a single
+   pass. If out is given, the removed elements are copied there in order
+   and left alone, otherwise they are handed to the free function. */
+int dynarr_delete_sparse(dynarr_t *arr, const size_t *indices, const size_t n_indices, void *out) {
+	size_t i, read_pos, write_pos, run_end;
+	uint8_t *bytes, *out_bytes = out;
+
+	if((arr == NULL) || (indices == NULL)) return RET_ERR_NULLPO;
+	if(n_indices == 0) return RET_OK;
+
+	for(i = 0; i < n_indices; i++) {
+		if(indices[i] >= arr->n_used) return RET_ERR_RANGE;
+		if((i > 0) && (indices[i] <= indices[i - 1])) return RET_ERR_INVALID;
+	}
+
+	bytes = arr->data;
+	write_pos = indices[0];
+
+	for(i = 0; i < n_indices; i++) {
+		read_pos = indices[i];
+
+		if(out_bytes != NULL) {
+			memcpy(out_bytes + i * arr->element_size, bytes + read_pos * arr->element_size, arr->element_size);
+		} else {
+			drop_element(arr, bytes + read_pos * arr->element_size);
+		}
+
+		/* Close the gap up to the next deleted element. */
+		run_end = (i + 1 < n_indices) ? indices[i + 1] : arr->n_used;
+		memmove(bytes + write_pos * arr->element_size,
+			bytes + (read_pos + 1) * arr->element_size,
+			(run_end - read_pos - 1) * arr->element_size);
+		write_pos += run_end - read_pos - 1;
+	}
+
+	arr->n_used -= n_indices;
+	return RET_OK;
+}
+
 /**/
 
 dynarr_t *dynarr_new(const size_t chunk_size, const size_t prealloc_size, dynarr_freefunc_t freefunc) {
@@ -188,6 +272,8 @@ dynarr_t *dynarr_new(const size_t chunk_size, const size_t prealloc_size, dynarr
 	out->n_alloced = prealloc_size;
 	out->n_used = 0;
 	out->freefunc = freefunc;
+	out->release = NULL;
+	out->release_ctx = NULL;
 
 	return out;
 
@@ -214,6 +300,14 @@ void dynarr_free(dynarr_t *arr) {
 	free(arr);
 }
 
+/* For elements that may still be in use elsewhere when they're deleted.
+   dynarr_free() still uses the free function. */
+void dynarr_set_release(dynarr_t *arr, dynarr_releasefunc_t release, void *ctx) {
+	if(arr == NULL) return;
+	arr->release = release;
+	arr->release_ctx = ctx;
+}
+
 size_t dynarr_get_size(const dynarr_t *arr) {
 	if(arr == NULL) return 0;
 	return arr->n_used;
@@ -8,12 +8,16 @@
 
 typedef struct dynarr_t dynarr_t;
 typedef void (*dynarr_freefunc_t)(void *);
+typedef void (*dynarr_releasefunc_t)(void *ctx, void *);
 
 dynarr_t *dynarr_new(const size_t chunk_size, const size_t prealloc_size, dynarr_freefunc_t freefunc);
 void dynarr_free(dynarr_t *arr);
+void dynarr_set_release(dynarr_t *arr, dynarr_releasefunc_t release, void *ctx);
 int dynarr_append(dynarr_t *arr, const void *data);
 int dynarr_delete(dynarr_t *arr, const size_t start_index, const size_t end_index);
 int dynarr_insert(dynarr_t *arr, const void *data, const size_t pos);
+int dynarr_insert_range(dynarr_t *arr, const void *data, const size_t n_elements, const size_t pos);
+int dynarr_delete_sparse(dynarr_t *arr, const size_t *indices, const size_t n_indices, void *out);
 int dynarr_move(dynarr_t *arr, const size_t start_index, const size_t end_index, const size_t target_index);
 size_t dynarr_get_size(const dynarr_t *arr);
 void *dynarr_get_element(const dynarr_t *arr, const size_t index);
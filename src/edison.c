@@ -0,0 +1,190 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mem.h"
+
+#include "dynarr.h"
+#include "edison.h"
+#include "ermac.h"
+#include "parser.h"
+#include "repl.h"
+#include "snapshot.h"
+
+struct edison_t {
+	ed_doc_t *document;
+	repl_state_t *state;
+	edps_ctx_t *parser;
+};
+
+/* Handed to the editor when there is no text, so that it never falls
+   back to reading stdin. */
+static const char * const no_text[] = { NULL };
+
+/**/
+
+edison_t *edison_open(const char *filename, const int no_write, int *status) {
+	edison_t *out;
+	FILE *fp;
+
+	if(status == NULL) return NULL;
+
+	*status = RET_ERR_NULLPO;
+	if(filename == NULL) return NULL;
+
+	*status = RET_ERR_MALLOC;
+	if((out = malloc(sizeof(edison_t))) == NULL) return NULL;
+	out->document = NULL;
+	out->state = NULL;
+	out->parser = NULL;
+
+	if((fp = fopen(filename, "rb")) == NULL) {
+		if((out->document = empty_doc(filename)) == NULL) goto fail;
+		out->document->no_write = no_write;
+	} else {
+		out->document = load_doc(fp, filename, no_write);
+		fclose(fp);
+		if(out->document == NULL) {
+			*status = RET_ERR_READ;
+			goto fail;
+		}
+	}
+
+	if((out->state = repl_init(NULL, NULL)) == NULL) goto fail;
+	repl_set_quiet(out->state, REPL_SILENT);
+
+	if((out->parser = edps_new("", NULL, status)) == NULL) goto fail;
+	edps_set_silent(out->parser, 1);
+
+	*status = RET_OK;
+	return out;
+
+fail:
+	edison_close(out);
+	return NULL;
+}
+
+void edison_close(edison_t *ed) {
+	if(ed == NULL) return;
+
+	if(ed->document != NULL) free_doc(ed->document);
+	if(ed->state != NULL) repl_free(ed->state);
+	edps_free(ed->parser);
+	free(ed);
+}
+
+/* Without a filename, the document goes back where it came from. */
+int edison_save(edison_t *ed, const char *filename) {
+	if(ed == NULL) return RET_ERR_NULLPO;
+
+	return save_doc(ed->document, filename, 0, ed->document->n_lines);
+}
+
+/**/
+
+/* Runs one instruction. The instruction isn't changed; text holds the
+   lines an I, A or line edit would otherwise read, and running out of
+   it ends the input like a "." would. */
+int edison_exec(edison_t *ed, const edps_instr_t *instr, const char * const *text, const size_t n_text) {
+	edps_instr_t copy;
+	int status;
+
+	if((ed == NULL) || (instr == NULL)) return RET_ERR_NULLPO;
+	if(repl_done(ed->state)) return RET_ERR_INVALID;
+
+	copy = *instr;
+	repl_set_text(ed->state, text != NULL ? text : no_text, text != NULL ? n_text : 0);
+	status = repl_exec(ed->state, ed->document, &copy);
+	repl_set_text(ed->state, NULL, 0);
+
+	return status;
+}
+
+/* Parses and runs a command line, like it was typed in. Instructions
+   separated by semicolons share the text. The first error ends it. */
+int edison_run(edison_t *ed, const char *command, const char * const *text, const size_t n_text) {
+	int parser_status, status;
+
+	if((ed == NULL) || (command == NULL)) return RET_ERR_NULLPO;
+	if(repl_done(ed->state)) return RET_ERR_INVALID;
+
+	if((status = edps_restart(ed->parser, command)) != RET_OK)
+		return status;
+
+	repl_set_text(ed->state, text != NULL ? text : no_text, text != NULL ? n_text : 0);
+	do {
+		if(((parser_status = edps_parse(ed->parser)) != RET_OK) && (parser_status != RET_MORE)) {
+			status = parser_status;
+			break;
+		}
+
+		status = repl_exec(ed->state, ed->document, edps_get_instr(ed->parser));
+		if((status < 0) && (status != RET_ERR_NOTFOUND)) break;
+	} while((parser_status == RET_MORE) && !repl_done(ed->state));
+	repl_set_text(ed->state, NULL, 0);
+
+	return status;
+}
+
+/**/
+
+uint64_t edison_cursor(const edison_t *ed) {
+	if(ed == NULL) return 0;
+	return repl_cursor(ed->state);
+}
+
+uint64_t edison_n_lines(const edison_t *ed) {
+	if(ed == NULL) return 0;
+	return ed->document->n_lines;
+}
+
+/* Line numbers count from 0, like the cursor. */
+const char *edison_line(const edison_t *ed, const uint64_t line) {
+	char **element;
+
+	if((ed == NULL) || (line >= ed->document->n_lines)) return NULL;
+	if((element = dynarr_get_element(ed->document->lines_arr, line)) == NULL) return NULL;
+
+	return *element;
+}
+
+/* After E or Q, the handle takes no more instructions. */
+int edison_done(const edison_t *ed) {
+	if(ed == NULL) return 1;
+	return repl_done(ed->state);
+}
+
+/**/
+
+int edison_snapshots(edison_t *ed) {
+	if(ed == NULL) return RET_ERR_NULLPO;
+	return repl_snapshots(ed->document);
+}
+
+const edison_snapshot_t *edison_pin(edison_t *ed) {
+	if(ed == NULL) return NULL;
+	return edsn_pin(ed->document->versions);
+}
+
+void edison_unpin(edison_t *ed, const edison_snapshot_t *snapshot) {
+	if(ed == NULL) return;
+	edsn_unpin(ed->document->versions, snapshot);
+}
+
+uint64_t edison_snapshot_n_lines(const edison_snapshot_t *snapshot) {
+	return edsn_n_lines(snapshot);
+}
+
+const char *edison_snapshot_line(const edison_snapshot_t *snapshot, const uint64_t line) {
+	return edsn_line(snapshot, line);
+}
+
+/* Case sensitive, like S without the ? */
+uint64_t edison_snapshot_find(const edison_snapshot_t *snapshot, const uint64_t from, const char *pattern) {
+	return edsn_find(snapshot, from, pattern, 0);
+}
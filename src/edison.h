@@ -0,0 +1,53 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef EDISON_H_
+#define EDISON_H_
+
+/* The editor as a library. A handle holds one open document and the
+   editor state that goes with it (cursor, last search string). Nothing
+   is printed to stdout; every call says how it went in its return value,
+   which is one of the RET_ codes from ermac.h. Instructions that read
+   text (I, A, line edits) take it from the lines passed along, never
+   from stdin. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ermac.h"
+#include "parser.h"
+
+typedef struct edison_t edison_t;
+typedef struct edsn_version_t edison_snapshot_t;
+
+edison_t *edison_open(const char *filename, const int no_write, int *status);
+void edison_close(edison_t *ed);
+int edison_save(edison_t *ed, const char *filename);
+
+int edison_exec(edison_t *ed, const edps_instr_t *instr, const char * const *text, const size_t n_text);
+int edison_run(edison_t *ed, const char *command, const char * const *text, const size_t n_text);
+
+uint64_t edison_cursor(const edison_t *ed);
+uint64_t edison_n_lines(const edison_t *ed);
+const char *edison_line(const edison_t *ed, const uint64_t line);
+int edison_done(const edison_t *ed);
+
+/* Snapshots let other threads read the document while the thread that
+   owns the handle goes on editing it. Once edison_snapshots() has been
+   called, edison_pin() gives the document as of the last instruction
+   that finished, and it stays that way until edison_unpin(). Only these
+   two and the edison_snapshot_ functions may be called from other
+   threads. Everything must be unpinned before edison_close(). */
+#define EDISON_NOT_FOUND	UINT64_MAX
+
+int edison_snapshots(edison_t *ed);
+const edison_snapshot_t *edison_pin(edison_t *ed);
+void edison_unpin(edison_t *ed, const edison_snapshot_t *snapshot);
+
+uint64_t edison_snapshot_n_lines(const edison_snapshot_t *snapshot);
+const char *edison_snapshot_line(const edison_snapshot_t *snapshot, const uint64_t line);
+uint64_t edison_snapshot_find(const edison_snapshot_t *snapshot, const uint64_t from, const char *pattern);
+
+#endif
@@ -8,12 +8,15 @@
 #include <Windows.h>
 #endif
 
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "mem.h"
 
 #include "appinfo.h"
 #include "ermac.h"
+#include "thread.h"
 #include "util.h"
 
 #define iswinderr(err_no) \
@@ -22,6 +25,10 @@
      (err_no == RET_ERR_READ) || \
      (err_no == RET_ERR_WRITE))
 
+/* The file the calling thread is working on, if it's one of several. */
+static ED_THREAD_LOCAL const char *error_source = NULL;
+static ED_THREAD_LOCAL FILE *error_stream = NULL;
+
 static void print_windows_errmsg(const int winderr) {
 #ifdef _WIN32
 	char *winderrstr;
@@ -64,10 +71,8 @@ char *str_error(const int err_no) {
 int print_error(const int err_no) {
 	char *errstr = str_error(err_no);
 
-	fprintf(stderr, "%s: ", APP_NAME);
-
 	if(errstr) {
-		fprintf(stderr, "%s.\n", errstr);
+		print_message("%s.", errstr);
 		free(errstr);
 #ifdef _WIN32
 		if(iswinderr(err_no)) {
@@ -75,9 +80,37 @@ int print_error(const int err_no) {
 		}
 #endif
 	} else {
-		fprintf(stderr, "Double fault. str_error() failed.\n");
+		print_message("Double fault. str_error() failed.");
 		return RET_ERR_DOUBLE;
 	}
 
 	return err_no;
 }
+
+/* Messages from this thread name the file until it's set to NULL again. */
+void set_error_source(const char *source) {
+	error_source = source;
+}
+
+/* Messages from this thread go to fp instead of stderr until it's set
+   to NULL again. */
+void set_error_stream(FILE *fp) {
+	error_stream = fp;
+}
+
+/* One line on stderr, in one piece, so that threads working on
+   different files don't cut into each other's messages. */
+void print_message(const char *format, ...) {
+	FILE *fp = error_stream != NULL ? error_stream : stderr;
+	char message[512];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+
+	if(error_source != NULL)
+		fprintf(fp, "%s: '%s': %s\n", APP_NAME, error_source, message);
+	else
+		fprintf(fp, "%s: %s\n", APP_NAME, message);
+}
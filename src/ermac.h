@@ -6,6 +6,8 @@
 #ifndef ERMAC_H_
 #define ERMAC_H_
 
+#include <stdio.h>
+
 #define RET_NO					0
 #define RET_OK					1
 #define RET_YES					2
@@ -36,4 +38,8 @@
 char *str_error(const int err_no);
 int print_error(const int err_no);
 
+void set_error_source(const char *source);
+void set_error_stream(FILE *fp);
+void print_message(const char *format, ...);
+
 #endif
@@ -0,0 +1,639 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#if defined __NR_io_uring_setup && defined __NR_io_uring_enter
+#include <linux/io_uring.h>
+#define EDIO_URING
+#endif
+#endif
+
+#include "mem.h"
+
+#include "ermac.h"
+#include "fileio.h"
+
+/* Blocks in flight at once, and what their buffers are aligned to. */
+#define EDIO_DEPTH			8
+#define EDIO_ALIGN			4096
+
+#define SLOT_FREE			0
+#define SLOT_BUSY			1
+#define SLOT_DONE			2
+
+#ifdef EDIO_URING
+typedef struct edio_ring_t {
+	int fd;
+	unsigned n_queued, n_busy;
+
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_entries, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+
+	void *sq_map, *cq_map;
+	size_t sq_map_size, cq_map_size, sqes_size;
+} edio_ring_t;
+#else
+typedef struct edio_ring_t edio_ring_t;
+#endif
+
+/* Block number n goes into slot n % EDIO_DEPTH. */
+typedef struct edio_slot_t {
+	char *raw, *data;
+	int state;
+	size_t size;
+	int64_t result;
+	uint64_t offset;
+} edio_slot_t;
+
+struct edio_reader_t {
+	FILE *fp;
+	int fd;
+	edio_ring_t *ring;
+	edio_slot_t slots[EDIO_DEPTH];
+
+	uint64_t start;
+	uint64_t next_block, out_block;
+	int handed_out, at_end;
+};
+
+struct edio_writer_t {
+	FILE *fp;
+	int fd;
+	edio_ring_t *ring;
+	edio_slot_t slots[EDIO_DEPTH];
+
+	uint64_t offset;
+	unsigned current;
+	int tried_ring, status;
+};
+
+/**/
+
+static int alloc_slots(edio_slot_t *slots, const size_t n_slots) {
+	size_t i;
+
+	for(i = 0; i < n_slots; i++) {
+		slots[i].state = SLOT_FREE;
+		slots[i].size = 0;
+		if((slots[i].raw = malloc(EDIO_BLOCK + EDIO_ALIGN)) == NULL) {
+			while(i > 0) free(slots[--i].raw);
+			return RET_ERR_MALLOC;
+		}
+		slots[i].data = slots[i].raw + (EDIO_ALIGN - (uintptr_t)slots[i].raw % EDIO_ALIGN) % EDIO_ALIGN;
+	}
+
+	return RET_OK;
+}
+
+static void free_slots(edio_slot_t *slots, const size_t n_slots) {
+	size_t i;
+
+	for(i = 0; i < n_slots; i++)
+		free(slots[i].raw);
+}
+
+#ifndef _WIN32
+/* Offsets only make sense on regular files; pipes and terminals are
+   read and written the stdio way. */
+static int is_regular(const int fd, off_t *size) {
+	struct stat st;
+
+	if(fstat(fd, &st) != 0) return 0;
+	if(size != NULL) *size = st.st_size;
+	return S_ISREG(st.st_mode);
+}
+#endif
+
+#ifdef EDIO_URING
+
+static int uring_setup(const unsigned entries, struct io_uring_params *params) {
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(const int fd, const unsigned to_submit, const unsigned min_complete) {
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		min_complete > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+static void free_ring(edio_ring_t *ring) {
+	if(ring == NULL) return;
+
+	if(ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+	if((ring->cq_map != MAP_FAILED) && (ring->cq_map != ring->sq_map))
+		munmap(ring->cq_map, ring->cq_map_size);
+	if(ring->sq_map != MAP_FAILED) munmap(ring->sq_map, ring->sq_map_size);
+	if(ring->fd >= 0) close(ring->fd);
+	free(ring);
+}
+
+/* NULL if the kernel doesn't do io_uring, or won't let us. */
+static edio_ring_t *new_ring(void) {
+	struct io_uring_params params;
+	edio_ring_t *out;
+	uint8_t *sq, *cq;
+
+	if((out = malloc(sizeof(edio_ring_t))) == NULL) return NULL;
+	out->sq_map = out->cq_map = MAP_FAILED;
+	out->sqes = MAP_FAILED;
+	out->n_queued = out->n_busy = 0;
+
+	memset(&params, 0, sizeof(params));
+	if((out->fd = uring_setup(EDIO_DEPTH, &params)) < 0) {
+		free_ring(out);
+		return NULL;
+	}
+
+	out->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	out->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	out->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	/* Newer kernels put both rings into one mapping. */
+	if(params.features & IORING_FEAT_SINGLE_MMAP) {
+		if(out->cq_map_size > out->sq_map_size) out->sq_map_size = out->cq_map_size;
+		out->cq_map_size = out->sq_map_size;
+	}
+
+	out->sq_map = mmap(NULL, out->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, out->fd, IORING_OFF_SQ_RING);
+	if(out->sq_map == MAP_FAILED) goto fail;
+
+	if(params.features & IORING_FEAT_SINGLE_MMAP) {
+		out->cq_map = out->sq_map;
+	} else {
+		out->cq_map = mmap(NULL, out->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, out->fd, IORING_OFF_CQ_RING);
+		if(out->cq_map == MAP_FAILED) goto fail;
+	}
+
+	out->sqes = mmap(NULL, out->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, out->fd, IORING_OFF_SQES);
+	if(out->sqes == MAP_FAILED) goto fail;
+
+	sq = out->sq_map;
+	cq = out->cq_map;
+	out->sq_head = (unsigned*)(sq + params.sq_off.head);
+	out->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+	out->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+	out->sq_entries = (unsigned*)(sq + params.sq_off.ring_entries);
+	out->sq_array = (unsigned*)(sq + params.sq_off.array);
+	out->cq_head = (unsigned*)(cq + params.cq_off.head);
+	out->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+	out->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+	out->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+	return out;
+fail:
+	free_ring(out);
+	return NULL;
+}
+
+/* Queues a read or write of a slot. It's only handed to the kernel with
+   the next wait. */
+static int queue(edio_ring_t *ring, const uint8_t opcode, const int fd, edio_slot_t *slot, const unsigned slot_index) {
+	struct io_uring_sqe *sqe;
+	unsigned tail, index;
+
+	tail = *ring->sq_tail;
+	if(tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= *ring->sq_entries)
+		return RET_ERR_OVERFLOW;
+
+	index = tail & *ring->sq_mask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)slot->data;
+	sqe->len = slot->size;
+	sqe->off = slot->offset;
+	sqe->user_data = slot_index;
+	ring->sq_array[index] = index;
+
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->n_queued++;
+	ring->n_busy++;
+	slot->state = SLOT_BUSY;
+
+	return RET_OK;
+}
+
+/* Submits whatever is queued, waits for at least one completion if
+   asked to, and books all that are there. */
+static int wait_ring(edio_ring_t *ring, edio_slot_t *slots, const int block) {
+	struct io_uring_cqe *cqe;
+	unsigned head;
+	int submitted;
+
+	if((ring->n_queued == 0) && !block) return RET_OK;
+
+	for(;;) {
+		submitted = uring_enter(ring->fd, ring->n_queued, block ? 1 : 0);
+		if(submitted >= 0) break;
+		if(errno != EINTR) return RET_ERR_READ;
+	}
+	ring->n_queued -= (unsigned)submitted < ring->n_queued ? (unsigned)submitted : ring->n_queued;
+
+	head = *ring->cq_head;
+	while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		cqe = &ring->cqes[head & *ring->cq_mask];
+		slots[cqe->user_data].result = cqe->res;
+		slots[cqe->user_data].state = SLOT_DONE;
+		ring->n_busy--;
+		head++;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	return RET_OK;
+}
+
+static void drain_ring(edio_ring_t *ring, edio_slot_t *slots) {
+	while(ring->n_busy > 0) {
+		if(wait_ring(ring, slots, 1) != RET_OK) break;
+	}
+}
+
+#endif
+
+/**/
+
+#ifdef EDIO_URING
+
+static void request_block(edio_reader_t *reader) {
+	edio_slot_t *slot;
+	unsigned index;
+
+	index = reader->next_block % EDIO_DEPTH;
+	slot = &reader->slots[index];
+	slot->offset = reader->start + reader->next_block * EDIO_BLOCK;
+	slot->size = EDIO_BLOCK;
+	if(queue(reader->ring, IORING_OP_READ, reader->fd, slot, index) == RET_OK)
+		reader->next_block++;
+}
+
+/* Whatever io_uring didn't read of a block, if anything, is read the
+   old way. Returns how much of it there is. */
+static int64_t finish_block(edio_reader_t *reader, edio_slot_t *slot) {
+	int64_t got = slot->result > 0 ? slot->result : 0;
+	ssize_t n_read;
+
+	if((slot->result < 0) && (slot->result != -EINTR) && (slot->result != -EAGAIN))
+		return slot->result;
+
+	while(got < (int64_t)slot->size) {
+		n_read = pread(reader->fd, slot->data + got, slot->size - got, slot->offset + got);
+		if(n_read < 0) {
+			if(errno == EINTR) continue;
+			return -errno;
+		}
+		if(n_read == 0) break;
+		got += n_read;
+	}
+
+	return got;
+}
+
+static int uring_read(edio_reader_t *reader, const char **data, size_t *size) {
+	edio_slot_t *slot;
+	int64_t got;
+
+	/* The caller is through with the last block, so its slot can be
+	   read into again. */
+	if(reader->handed_out) {
+		reader->slots[reader->out_block % EDIO_DEPTH].state = SLOT_FREE;
+		reader->out_block++;
+		reader->handed_out = 0;
+	}
+	if(reader->at_end) return RET_NO;
+
+	while((reader->next_block < reader->out_block + EDIO_DEPTH) &&
+		(reader->slots[reader->next_block % EDIO_DEPTH].state == SLOT_FREE))
+		request_block(reader);
+
+	slot = &reader->slots[reader->out_block % EDIO_DEPTH];
+	if(slot->state == SLOT_FREE) return RET_ERR_READ;
+	while(slot->state != SLOT_DONE) {
+		if(wait_ring(reader->ring, reader->slots, 1) != RET_OK)
+			return RET_ERR_READ;
+	}
+
+	if((got = finish_block(reader, slot)) < 0)
+		return RET_ERR_READ;
+	if(got < (int64_t)slot->size) reader->at_end = 1;
+	if(got == 0) return RET_NO;
+
+	*data = slot->data;
+	*size = got;
+	reader->handed_out = 1;
+
+	return RET_OK;
+}
+
+#endif
+
+edio_reader_t *edio_reader_new(FILE *fp) {
+	edio_reader_t *out;
+#ifdef EDIO_URING
+	off_t start, size;
+#endif
+
+	if(fp == NULL) return NULL;
+
+	if((out = malloc(sizeof(edio_reader_t))) == NULL) return NULL;
+	out->fp = fp;
+	out->ring = NULL;
+	out->next_block = out->out_block = 0;
+	out->handed_out = out->at_end = 0;
+
+#ifdef EDIO_URING
+	/* A file that fits into one block is one read either way. */
+	out->fd = fileno(fp);
+	if(is_regular(out->fd, &size) && ((start = ftello(fp)) >= 0) && (size - start > EDIO_BLOCK)) {
+		out->start = start;
+		out->ring = new_ring();
+	}
+#endif
+
+	if(alloc_slots(out->slots, out->ring != NULL ? EDIO_DEPTH : 1) != RET_OK) {
+#ifdef EDIO_URING
+		free_ring(out->ring);
+#endif
+		free(out);
+		return NULL;
+	}
+
+	return out;
+}
+
+/* Hands out the next block of the file. It stays valid until the next
+   call. RET_NO at the end of the file. */
+int edio_read(edio_reader_t *reader, const char **data, size_t *size) {
+	size_t n_read;
+
+	if((reader == NULL) || (data == NULL) || (size == NULL)) return RET_ERR_NULLPO;
+
+#ifdef EDIO_URING
+	if(reader->ring != NULL) return uring_read(reader, data, size);
+#endif
+
+	if((n_read = fread(reader->slots[0].data, 1, EDIO_BLOCK, reader->fp)) == 0)
+		return ferror(reader->fp) ? RET_ERR_READ : RET_NO;
+
+	*data = reader->slots[0].data;
+	*size = n_read;
+
+	return RET_OK;
+}
+
+void edio_reader_free(edio_reader_t *reader) {
+	if(reader == NULL) return;
+
+#ifdef EDIO_URING
+	if(reader->ring != NULL) {
+		drain_ring(reader->ring, reader->slots);
+		free_ring(reader->ring);
+		free_slots(reader->slots, EDIO_DEPTH);
+		free(reader);
+		return;
+	}
+#endif
+
+	free_slots(reader->slots, 1);
+	free(reader);
+}
+
+/**/
+
+#ifdef EDIO_URING
+
+/* Whatever io_uring didn't write of a block is written the old way. */
+static void finish_write(edio_writer_t *writer, edio_slot_t *slot) {
+	int64_t done = slot->result > 0 ? slot->result : 0;
+	ssize_t n_written;
+
+	slot->state = SLOT_FREE;
+
+	if((slot->result < 0) && (slot->result != -EINTR) && (slot->result != -EAGAIN)) {
+		writer->status = RET_ERR_WRITE;
+		return;
+	}
+
+	while(done < (int64_t)slot->size) {
+		n_written = pwrite(writer->fd, slot->data + done, slot->size - done, slot->offset + done);
+		if(n_written < 0) {
+			if(errno == EINTR) continue;
+			writer->status = RET_ERR_WRITE;
+			return;
+		}
+		done += n_written;
+	}
+}
+
+static void reap_writes(edio_writer_t *writer) {
+	unsigned i;
+
+	for(i = 0; i < EDIO_DEPTH; i++) {
+		if(writer->slots[i].state == SLOT_DONE)
+			finish_write(writer, &writer->slots[i]);
+	}
+}
+
+/* Sends the current block off and waits until the next one is free. */
+static void uring_flush(edio_writer_t *writer) {
+	edio_slot_t *slot = &writer->slots[writer->current];
+
+	if(slot->size > 0) {
+		slot->offset = writer->offset;
+		if(queue(writer->ring, IORING_OP_WRITE, writer->fd, slot, writer->current) != RET_OK) {
+			writer->status = RET_ERR_WRITE;
+			return;
+		}
+		writer->offset += slot->size;
+		writer->current = (writer->current + 1) % EDIO_DEPTH;
+	}
+
+	if(wait_ring(writer->ring, writer->slots, 0) != RET_OK)
+		writer->status = RET_ERR_WRITE;
+	reap_writes(writer);
+
+	slot = &writer->slots[writer->current];
+	while(slot->state == SLOT_BUSY) {
+		if(wait_ring(writer->ring, writer->slots, 1) != RET_OK) {
+			writer->status = RET_ERR_WRITE;
+			break;
+		}
+		reap_writes(writer);
+	}
+	slot->size = 0;
+}
+
+/* Only once there's more than a block to write is it worth setting up
+   the ring. */
+static void start_ring(edio_writer_t *writer) {
+	off_t start;
+
+	writer->tried_ring = 1;
+
+	writer->fd = fileno(writer->fp);
+	if(!is_regular(writer->fd, NULL)) return;
+	if((fflush(writer->fp) != 0) || ((start = ftello(writer->fp)) < 0)) return;
+	if((writer->ring = new_ring()) == NULL) return;
+
+	if(alloc_slots(writer->slots + 1, EDIO_DEPTH - 1) != RET_OK) {
+		free_ring(writer->ring);
+		writer->ring = NULL;
+		return;
+	}
+	writer->offset = start;
+}
+
+#endif
+
+static void flush_block(edio_writer_t *writer) {
+	edio_slot_t *slot = &writer->slots[writer->current];
+
+#ifdef EDIO_URING
+	if(!writer->tried_ring && (slot->size == EDIO_BLOCK))
+		start_ring(writer);
+	if(writer->ring != NULL) {
+		uring_flush(writer);
+		return;
+	}
+#endif
+
+	if(fwrite(slot->data, 1, slot->size, writer->fp) != slot->size)
+		writer->status = RET_ERR_WRITE;
+	slot->size = 0;
+}
+
+edio_writer_t *edio_writer_new(FILE *fp) {
+	edio_writer_t *out;
+
+	if(fp == NULL) return NULL;
+
+	if((out = malloc(sizeof(edio_writer_t))) == NULL) return NULL;
+	out->fp = fp;
+	out->ring = NULL;
+	out->tried_ring = 0;
+	out->current = 0;
+	out->status = RET_OK;
+
+	if(alloc_slots(out->slots, 1) != RET_OK) {
+		free(out);
+		return NULL;
+	}
+
+	return out;
+}
+
+int edio_write(edio_writer_t *writer, const void *data, const size_t size) {
+	const char *bytes = data;
+	size_t left = size, n_copy;
+	edio_slot_t *slot;
+
+	if((writer == NULL) || (data == NULL)) return RET_ERR_NULLPO;
+
+	while((left > 0) && (writer->status == RET_OK)) {
+		slot = &writer->slots[writer->current];
+		n_copy = EDIO_BLOCK - slot->size < left ? EDIO_BLOCK - slot->size : left;
+		memcpy(slot->data + slot->size, bytes, n_copy);
+		slot->size += n_copy;
+		bytes += n_copy;
+		left -= n_copy;
+
+		if(slot->size == EDIO_BLOCK) flush_block(writer);
+	}
+
+	return writer->status;
+}
+
+/* Writes what's left and waits for all of it. Doesn't close the FILE. */
+int edio_writer_close(edio_writer_t *writer) {
+	int status;
+
+	if(writer == NULL) return RET_ERR_NULLPO;
+
+	if(writer->status == RET_OK) flush_block(writer);
+
+#ifdef EDIO_URING
+	if(writer->ring != NULL) {
+		drain_ring(writer->ring, writer->slots);
+		reap_writes(writer);
+		free_ring(writer->ring);
+		free_slots(writer->slots, EDIO_DEPTH);
+	} else
+#endif
+	free_slots(writer->slots, 1);
+
+	status = writer->status;
+	free(writer);
+
+	return status;
+}
+
+/**/
+
+/* Where the FILE is now, if it can be written to at given offsets from
+   any thread. The FILE's own buffer is flushed first. */
+int edio_can_write_at(FILE *fp, uint64_t *start) {
+#ifdef _WIN32
+	return 0;
+#else
+	off_t pos;
+
+	if((fp == NULL) || !is_regular(fileno(fp), NULL)) return 0;
+	if((fflush(fp) != 0) || ((pos = ftello(fp)) < 0)) return 0;
+	if(start != NULL) *start = pos;
+
+	return 1;
+#endif
+}
+
+int edio_write_at(FILE *fp, const void *data, const size_t size, const uint64_t offset) {
+#ifdef _WIN32
+	return RET_ERR_WRITE;
+#else
+	const char *bytes = data;
+	size_t done = 0;
+	ssize_t n_written;
+
+	if((fp == NULL) || (data == NULL)) return RET_ERR_NULLPO;
+
+	while(done < size) {
+		n_written = pwrite(fileno(fp), bytes + done, size - done, offset + done);
+		if(n_written < 0) {
+			if(errno == EINTR) continue;
+			return RET_ERR_WRITE;
+		}
+		done += n_written;
+	}
+
+	return RET_OK;
+#endif
+}
+
+int edio_same_file(FILE *fp, const char *filename) {
+#ifdef _WIN32
+	return 1;
+#else
+	struct stat open_st, named_st;
+
+	if((fp == NULL) || (filename == NULL)) return 0;
+	if((fstat(fileno(fp), &open_st) != 0) || (stat(filename, &named_st) != 0)) return 0;
+	return (open_st.st_dev == named_st.st_dev) && (open_st.st_ino == named_st.st_ino);
+#endif
+}
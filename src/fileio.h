@@ -0,0 +1,43 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef FILEIO_H_
+#define FILEIO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Reads and writes whole files in big blocks. On Linux, io_uring keeps
+   several blocks in flight while the caller works on the one it has;
+   everywhere else, and whenever io_uring can't be set up, it's plain
+   stdio on the FILE that was handed in. */
+
+#define EDIO_BLOCK			(256 * 1024)
+
+typedef struct edio_reader_t edio_reader_t;
+typedef struct edio_writer_t edio_writer_t;
+
+/* The file is read from where it is now to its end. */
+edio_reader_t *edio_reader_new(FILE *fp);
+int edio_read(edio_reader_t *reader, const char **data, size_t *size);
+void edio_reader_free(edio_reader_t *reader);
+
+/* The file is written from where it is now. It must not be written to
+   through the FILE until the writer is closed. */
+edio_writer_t *edio_writer_new(FILE *fp);
+int edio_write(edio_writer_t *writer, const void *data, const size_t size);
+int edio_writer_close(edio_writer_t *writer);
+
+/* Writes that don't go through the FILE's position, so that threads can
+   write their parts of a file side by side. Not on Windows. */
+int edio_can_write_at(FILE *fp, uint64_t *start);
+int edio_write_at(FILE *fp, const void *data, const size_t size, const uint64_t offset);
+
+/* Whether opening filename would open the file fp has open. On Windows,
+   where that can't be told, it's always yes. */
+int edio_same_file(FILE *fp, const char *filename);
+
+#endif
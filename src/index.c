@@ -0,0 +1,357 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#define EDIX_MMAP
+#endif
+
+#include "mem.h"
+
+#include "ermac.h"
+#include "index.h"
+
+#define EDIX_MAGIC			"EDX1"
+#define EDIX_ORDER			0x01020304
+#define EDIX_VERSION		2
+#define EDIX_BINARY			1
+
+/* How much of the head and the tail of the file is compared. */
+#define EDIX_SAMPLE			(64 * 1024)
+#define PREALLOC_ENTRIES	65536
+
+/* A file written twice in the same second only differs in these. */
+#ifdef __APPLE__
+#define MTIME_NSEC(st)		((st).st_mtimespec.tv_nsec)
+#else
+#define MTIME_NSEC(st)		((st).st_mtim.tv_nsec)
+#endif
+
+/* The index file is this, then where every line starts (uint64_t), then
+   how long every line is (uint32_t), so it can be used as it's mapped. */
+typedef struct edix_header_t {
+	char magic[4];
+	uint32_t order, version, flags;
+	uint64_t file_size;
+	int64_t mtime, mtime_nsec;
+	uint64_t head_hash, tail_hash;
+	uint64_t n_lines;
+} edix_header_t;
+
+struct edix_t {
+	const char *text;
+	size_t text_size;
+	void *map;
+	size_t map_size;
+	const edix_header_t *header;
+	const uint64_t *starts;
+	const uint32_t *lengths;
+};
+
+struct edix_builder_t {
+	edix_header_t header;
+	uint64_t *starts;
+	uint32_t *lengths;
+	size_t n_alloced;
+	int spoiled;
+};
+
+static int sidecars = 0;
+
+/**/
+
+void edix_set_sidecars(const int on) {
+	sidecars = on;
+}
+
+int edix_sidecars(void) {
+	return sidecars;
+}
+
+static char *sidecar_name(const char *filename) {
+	size_t size = strlen(filename) + sizeof(".edx");
+	char *out;
+
+	if((out = malloc(size)) == NULL) return NULL;
+	snprintf(out, size, "%s.edx", filename);
+	return out;
+}
+
+#ifdef EDIX_MMAP
+/* FNV-1a. */
+static uint64_t hash_bytes(const unsigned char *data, const size_t size) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for(i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static int hash_sample(const int fd, const uint64_t offset, const size_t size, uint64_t *hash) {
+	unsigned char *sample;
+	ssize_t got;
+	size_t done = 0;
+
+	if((sample = malloc(size > 0 ? size : 1)) == NULL) return RET_ERR_MALLOC;
+	while(done < size) {
+		if((got = pread(fd, sample + done, size - done, (off_t)(offset + done))) <= 0) {
+			free(sample);
+			return RET_ERR_READ;
+		}
+		done += got;
+	}
+
+	*hash = hash_bytes(sample, size);
+	free(sample);
+	return RET_OK;
+}
+
+/* What the index of the file as it is now would have to say about it. */
+static int describe(const int fd, edix_header_t *header) {
+	struct stat st;
+	size_t sample;
+	int status;
+
+	if((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode)) return RET_NO;
+
+	memset(header, 0, sizeof(edix_header_t));
+	memcpy(header->magic, EDIX_MAGIC, sizeof(header->magic));
+	header->order = EDIX_ORDER;
+	header->version = EDIX_VERSION;
+	header->file_size = st.st_size;
+	header->mtime = st.st_mtime;
+	header->mtime_nsec = MTIME_NSEC(st);
+
+	sample = header->file_size < EDIX_SAMPLE ? header->file_size : EDIX_SAMPLE;
+	if((status = hash_sample(fd, 0, sample, &header->head_hash)) != RET_OK) return status;
+	return hash_sample(fd, header->file_size - sample, sample, &header->tail_hash);
+}
+#endif
+
+/**/
+
+edix_t *edix_open(const char *filename, FILE *fp) {
+#ifdef EDIX_MMAP
+	edix_header_t now;
+	edix_t *out;
+	struct stat st;
+	char *name;
+	uint64_t i;
+	int fd;
+
+	if(!sidecars || (filename == NULL)) return NULL;
+	if((describe(fileno(fp), &now) != RET_OK) || (now.file_size < EDIX_MIN_SIZE)) return NULL;
+
+	if((name = sidecar_name(filename)) == NULL) return NULL;
+	fd = open(name, O_RDONLY);
+	free(name);
+	if(fd < 0) return NULL;
+
+	if((out = calloc(1, sizeof(edix_t))) == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	if((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(edix_header_t))) {
+		close(fd);
+		free(out);
+		return NULL;
+	}
+	out->map_size = st.st_size;
+	out->map = mmap(NULL, out->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(out->map == MAP_FAILED) {
+		free(out);
+		return NULL;
+	}
+
+	/* Stale, or not an index at all. */
+	out->header = out->map;
+	if(memcmp(out->header->magic, now.magic, sizeof(now.magic)) ||
+		(out->header->order != now.order) || (out->header->version != now.version) ||
+		(out->header->file_size != now.file_size) || (out->header->mtime != now.mtime) ||
+		(out->header->mtime_nsec != now.mtime_nsec) ||
+		(out->header->head_hash != now.head_hash) || (out->header->tail_hash != now.tail_hash) ||
+		(out->header->n_lines > (out->map_size - sizeof(edix_header_t)) / (sizeof(uint64_t) + sizeof(uint32_t))) ||
+		(out->map_size != sizeof(edix_header_t) + out->header->n_lines * (sizeof(uint64_t) + sizeof(uint32_t)))) {
+		goto fail;
+	}
+	out->starts = (const uint64_t *)(out->header + 1);
+	out->lengths = (const uint32_t *)(out->starts + out->header->n_lines);
+
+	/* Every line has to be in the file, after the one before it. */
+	for(i = 0; i < out->header->n_lines; i++) {
+		if((out->starts[i] > now.file_size) || (out->lengths[i] > now.file_size - out->starts[i]))
+			goto fail;
+		if((i > 0) && (out->starts[i] < out->starts[i - 1] + out->lengths[i - 1]))
+			goto fail;
+	}
+
+	out->text_size = now.file_size;
+	out->text = mmap(NULL, out->text_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+	if(out->text == MAP_FAILED) goto fail;
+#ifdef MADV_SEQUENTIAL
+	madvise((void *)out->text, out->text_size, MADV_SEQUENTIAL);
+#endif
+
+	return out;
+fail:
+	munmap(out->map, out->map_size);
+	free(out);
+	return NULL;
+#else
+	(void)filename;
+	(void)fp;
+	return NULL;
+#endif
+}
+
+uint64_t edix_n_lines(const edix_t *index) {
+	return index->header->n_lines;
+}
+
+const char *edix_line(const edix_t *index, const uint64_t line, size_t *length) {
+	*length = index->lengths[line];
+	return index->text + index->starts[line];
+}
+
+/* The text before the line has been taken, so its pages can go. */
+void edix_release(const edix_t *index, const uint64_t line) {
+#ifdef EDIX_MMAP
+	long page = sysconf(_SC_PAGESIZE);
+	size_t until;
+
+	if((line >= index->header->n_lines) || (page <= 0)) return;
+	until = index->starts[line] - index->starts[line] % page;
+	if(until > 0) madvise((void *)index->text, until, MADV_DONTNEED);
+#else
+	(void)index;
+	(void)line;
+#endif
+}
+
+int edix_maybe_binary(const edix_t *index) {
+	return (index->header->flags & EDIX_BINARY) != 0;
+}
+
+void edix_close(edix_t *index) {
+	if(index == NULL) return;
+#ifdef EDIX_MMAP
+	munmap((void *)index->text, index->text_size);
+	munmap(index->map, index->map_size);
+#endif
+	free(index);
+}
+
+/**/
+
+edix_builder_t *edix_builder_new(FILE *fp) {
+#ifdef EDIX_MMAP
+	edix_builder_t *out;
+
+	if((out = calloc(1, sizeof(edix_builder_t))) == NULL) return NULL;
+	if((describe(fileno(fp), &out->header) != RET_OK) || (out->header.file_size < EDIX_MIN_SIZE)) {
+		free(out);
+		return NULL;
+	}
+
+	out->n_alloced = PREALLOC_ENTRIES;
+	out->starts = malloc(out->n_alloced * sizeof(uint64_t));
+	out->lengths = malloc(out->n_alloced * sizeof(uint32_t));
+	if((out->starts == NULL) || (out->lengths == NULL)) {
+		edix_builder_free(out);
+		return NULL;
+	}
+
+	return out;
+#else
+	(void)fp;
+	return NULL;
+#endif
+}
+
+int edix_add(edix_builder_t *builder, const uint64_t start, const size_t length) {
+	uint64_t *new_starts;
+	uint32_t *new_lengths;
+	size_t n = builder->header.n_lines;
+
+	if(builder->spoiled) return RET_NO;
+	if(length > UINT32_MAX) {
+		builder->spoiled = 1;
+		return RET_NO;
+	}
+
+	if(n == builder->n_alloced) {
+		if((new_starts = realloc(builder->starts, 2 * n * sizeof(uint64_t))) == NULL) goto fail;
+		builder->starts = new_starts;
+		if((new_lengths = realloc(builder->lengths, 2 * n * sizeof(uint32_t))) == NULL) goto fail;
+		builder->lengths = new_lengths;
+		builder->n_alloced = 2 * n;
+	}
+
+	builder->starts[n] = start;
+	builder->lengths[n] = (uint32_t)length;
+	builder->header.n_lines++;
+	return RET_OK;
+fail:
+	builder->spoiled = 1;
+	return RET_ERR_MALLOC;
+}
+
+void edix_set_binary(edix_builder_t *builder) {
+	builder->header.flags |= EDIX_BINARY;
+}
+
+/* For files whose lines aren't simply a piece of the file each, like
+   those with NULs in them. */
+void edix_spoil(edix_builder_t *builder) {
+	builder->spoiled = 1;
+}
+
+int edix_write(edix_builder_t *builder, const char *filename) {
+	size_t n = builder->header.n_lines;
+	char *name;
+	FILE *fp;
+	int status = RET_OK;
+
+	if(builder->spoiled) return RET_NO;
+	if((name = sidecar_name(filename)) == NULL) return RET_ERR_MALLOC;
+
+	if((fp = fopen(name, "wb")) == NULL) {
+		free(name);
+		return RET_ERR_OPEN;
+	}
+	if((fwrite(&builder->header, sizeof(edix_header_t), 1, fp) != 1) ||
+		(fwrite(builder->starts, sizeof(uint64_t), n, fp) != n) ||
+		(fwrite(builder->lengths, sizeof(uint32_t), n, fp) != n)) {
+		status = RET_ERR_WRITE;
+	}
+	if(fclose(fp) != 0) status = RET_ERR_WRITE;
+
+	/* Half an index is no index. */
+	if(status != RET_OK) remove(name);
+	free(name);
+	return status;
+}
+
+void edix_builder_free(edix_builder_t *builder) {
+	if(builder == NULL) return;
+	free(builder->starts);
+	free(builder->lengths);
+	free(builder);
+}
@@ -0,0 +1,44 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef INDEX_H_
+#define INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* A line index kept next to a big file, as file.edx: where every line
+   of it starts and how long it is, so that the next time the file is
+   opened, nobody has to look for the ends of the lines again. It's only
+   used as long as the file has the same size and time and the same
+   first and last bytes as when the index was written. Not on Windows. */
+
+#define EDIX_MIN_SIZE		(1024 * 1024)
+
+typedef struct edix_t edix_t;
+typedef struct edix_builder_t edix_builder_t;
+
+void edix_set_sidecars(const int on);
+int edix_sidecars(void);
+
+/* The index of the file fp was opened from, if it still fits. */
+edix_t *edix_open(const char *filename, FILE *fp);
+uint64_t edix_n_lines(const edix_t *index);
+const char *edix_line(const edix_t *index, const uint64_t line, size_t *length);
+void edix_release(const edix_t *index, const uint64_t line);
+int edix_maybe_binary(const edix_t *index);
+void edix_close(edix_t *index);
+
+/* Put together while the file is read, from its start, and written when
+   it's all there. NULL if the file is too small to bother. */
+edix_builder_t *edix_builder_new(FILE *fp);
+int edix_add(edix_builder_t *builder, const uint64_t start, const size_t length);
+void edix_set_binary(edix_builder_t *builder);
+void edix_spoil(edix_builder_t *builder);
+int edix_write(edix_builder_t *builder, const char *filename);
+void edix_builder_free(edix_builder_t *builder);
+
+#endif
@@ -3,7 +3,6 @@
  * Copyright (C) 2022-2023  Martin Wolters *
  *******************************************/
 
-#include <ctype.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,25 +15,94 @@
 #include "lexer.h"
 #include "util.h"
 
-#define PREALLOC_LEXEME 16
-
 typedef enum edlx_state_t {
 	EDLX_STATE_START,
 	EDLX_STATE_NUMBER,
 	EDLX_STATE_COMMAND,
 	EDLX_STATE_TEXT,
+	EDLX_STATE_ASK,
+	EDLX_STATE_STRING,
+	EDLX_STATE_STRING_ESCAPE,
+
+	/* Only ever reached as the last state of a token. */
 	EDLX_STATE_DELIM,
 	EDLX_STATE_THIS_LINE,
-	EDLX_STATE_ASK,
 	EDLX_STATE_ASK_REPLACE,
 	EDLX_STATE_ASK_SEARCH,
-	EDLX_STATE_STRING,
-	EDLX_STATE_STRING_ESCAPE,
+	EDLX_STATE_NOCASE,
 	EDLX_STATE_STRING_END,
 	EDLX_STATE_EOL,
-	EDLX_STATE_INVALID
+	EDLX_STATE_INVALID,
+
+	EDLX_N_STATES
 } edlx_state_t;
 
+/* Character classes. Every byte of the command line is mapped to one of
+   these before it is fed to the state table. */
+enum {
+	END, SPC, DIG, CMD, CMR, CMS, ALP, DLM, QUO, BSL, ASK, TIL, DOT, OTH,
+	EDLX_N_CLASSES
+};
+
+static const uint8_t edlx_char_class[256] = {
+	END, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, SPC, SPC, SPC, SPC, SPC, OTH, OTH,
+	OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH,
+	SPC, OTH, QUO, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, DLM, OTH, DOT, OTH,
+	DIG, DIG, DIG, DIG, DIG, DIG, DIG, DIG, DIG, DIG, OTH, DLM, OTH, OTH, OTH, ASK,
+	OTH, CMD, ALP, CMD, CMD, CMD, CMD, CMD, ALP, CMD, ALP, ALP, CMD, CMD, CMD, ALP,
+	CMD, CMD, CMR, CMS, CMD, ALP, ALP, CMD, ALP, ALP, ALP, OTH, BSL, OTH, OTH, OTH,
+	OTH, CMD, ALP, CMD, CMD, CMD, CMD, CMD, ALP, CMD, ALP, ALP, CMD, CMD, CMD, ALP,
+	CMD, CMD, CMD, CMD, CMD, ALP, ALP, CMD, ALP, ALP, ALP, OTH, OTH, OTH, TIL, OTH,
+	OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH,
+	OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH,
+	OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH,
+	OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH,
+	OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH,
+	OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH,
+	OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH,
+	OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH, OTH
+};
+
+/* A transition either names the next state, or ends the token in the
+   given state. TAKE keeps the current character in the token, DONE
+   leaves it for the next one. */
+#define TAKE	0x40
+#define DONE	0x80
+#define NEXT(t)	((t) & 0x3f)
+
+#define S_NUM	EDLX_STATE_NUMBER
+#define S_CMD	EDLX_STATE_COMMAND
+#define S_TXT	EDLX_STATE_TEXT
+#define S_ASK	EDLX_STATE_ASK
+#define S_STR	EDLX_STATE_STRING
+#define S_ESC	EDLX_STATE_STRING_ESCAPE
+
+static const uint8_t edlx_transitions[EDLX_STATE_DELIM][EDLX_N_CLASSES] = {
+	/* START */
+	{ DONE | EDLX_STATE_EOL, TAKE | EDLX_STATE_INVALID, S_NUM, S_CMD, S_CMD, S_CMD, S_TXT,
+	  TAKE | EDLX_STATE_DELIM, S_STR, TAKE | EDLX_STATE_INVALID, S_ASK, TAKE | EDLX_STATE_NOCASE,
+	  TAKE | EDLX_STATE_THIS_LINE, TAKE | EDLX_STATE_INVALID },
+	/* NUMBER */
+	{ DONE | S_NUM, DONE | S_NUM, S_NUM, DONE | S_NUM, DONE | S_NUM, DONE | S_NUM, DONE | S_NUM,
+	  DONE | S_NUM, DONE | S_NUM, DONE | S_NUM, DONE | S_NUM, DONE | S_NUM, DONE | S_NUM, DONE | S_NUM },
+	/* COMMAND: a command letter followed by more letters is just text. */
+	{ DONE | S_CMD, DONE | S_CMD, S_TXT, S_TXT, S_TXT, S_TXT, S_TXT,
+	  DONE | S_CMD, DONE | S_CMD, DONE | S_CMD, DONE | S_CMD, DONE | S_CMD, DONE | S_CMD, DONE | S_CMD },
+	/* TEXT */
+	{ DONE | S_TXT, DONE | S_TXT, S_TXT, S_TXT, S_TXT, S_TXT, S_TXT,
+	  DONE | S_TXT, DONE | S_TXT, DONE | S_TXT, DONE | S_TXT, DONE | S_TXT, DONE | S_TXT, DONE | S_TXT },
+	/* ASK */
+	{ DONE | S_ASK, DONE | S_ASK, DONE | S_ASK, DONE | S_ASK,
+	  TAKE | EDLX_STATE_ASK_REPLACE, TAKE | EDLX_STATE_ASK_SEARCH, DONE | S_ASK,
+	  DONE | S_ASK, DONE | S_ASK, DONE | S_ASK, DONE | S_ASK, DONE | S_ASK, DONE | S_ASK, DONE | S_ASK },
+	/* STRING */
+	{ DONE | EDLX_STATE_INVALID, S_STR, S_STR, S_STR, S_STR, S_STR, S_STR,
+	  S_STR, TAKE | EDLX_STATE_STRING_END, S_ESC, S_STR, S_STR, S_STR, S_STR },
+	/* STRING_ESCAPE */
+	{ DONE | EDLX_STATE_INVALID, S_STR, S_STR, S_STR, S_STR, S_STR, S_STR,
+	  S_STR, S_STR, S_STR, S_STR, S_STR, S_STR, S_STR }
+};
+
 typedef struct edlx_keyword_table_t {
 	const char *keyword;
 	const edlx_token_t token;
@@ -49,12 +117,18 @@ static const edlx_keyword_table_t edlx_keyword_table[] = {
 	{ "d", EDLX_TOKEN_KW_DELETE },
 	{ "E", EDLX_TOKEN_KW_END },
 	{ "e", EDLX_TOKEN_KW_END },
+	{ "F", EDLX_TOKEN_KW_FIND },
+	{ "f", EDLX_TOKEN_KW_FIND },
+	{ "G", EDLX_TOKEN_KW_GLOBAL },
+	{ "g", EDLX_TOKEN_KW_GLOBAL },
 	{ "I", EDLX_TOKEN_KW_INSERT },
 	{ "i", EDLX_TOKEN_KW_INSERT },
 	{ "L", EDLX_TOKEN_KW_LIST },
 	{ "l", EDLX_TOKEN_KW_LIST },
 	{ "M", EDLX_TOKEN_KW_MOVE },
 	{ "m", EDLX_TOKEN_KW_MOVE },
+	{ "N", EDLX_TOKEN_KW_COUNT },
+	{ "n", EDLX_TOKEN_KW_COUNT },
 	{ "P", EDLX_TOKEN_KW_PAGE },
 	{ "p", EDLX_TOKEN_KW_PAGE },
 	{ "Q", EDLX_TOKEN_KW_QUIT },
@@ -97,6 +171,10 @@ void edlx_token_str(const edlx_token_t token) {
 		case EDLX_TOKEN_KW_ASK:				printf("KW_ASK");		break;
 		case EDLX_TOKEN_KW_ASK_REPLACE:		printf("KW_REPLACE?");	break;
 		case EDLX_TOKEN_KW_ASK_SEARCH:		printf("KE_SEARCH?");	break;
+		case EDLX_TOKEN_KW_FIND:			printf("KW_FIND");		break;
+		case EDLX_TOKEN_KW_COUNT:			printf("KW_COUNT");		break;
+		case EDLX_TOKEN_KW_GLOBAL:			printf("KW_GLOBAL");	break;
+		case EDLX_TOKEN_KW_NOCASE:			printf("KW_NOCASE");	break;
 		case EDLX_TOKEN_EOL:				printf("END OF LINE");	break;
 		case EDLX_TOKEN_EOF:				printf("END OF FILE");	break;
 		case EDLX_TOKEN_INVALID:			printf("INVALID");		break;
@@ -105,67 +183,93 @@ void edlx_token_str(const edlx_token_t token) {
 	}
 }
 
-static edlx_token_t get_delim(const char *lexeme) {
-	switch(lexeme[0]) {
+static edlx_token_t get_delim(const char c) {
+	switch(c) {
 		case ',':	return EDLX_TOKEN_DELIM_COMMA;
 		case ';':	return EDLX_TOKEN_DELIM_SEMICOLON;
 	}
 	return EDLX_TOKEN_INVALID;
 }
 
-static edlx_token_t get_command(const char *lexeme) {
+static edlx_token_t get_command(const char *lexeme, const size_t length) {
 	size_t pos, n_tokens;
 
 	n_tokens = sizeof(edlx_keyword_table) / sizeof(edlx_keyword_table_t);
 	for(pos = 0; pos < n_tokens; pos++)
-		if(!strcmp(lexeme, edlx_keyword_table[pos].keyword))
+		if((strlen(edlx_keyword_table[pos].keyword) == length) &&
+		   !memcmp(lexeme, edlx_keyword_table[pos].keyword, length))
 			return edlx_keyword_table[pos].token;
 
 	return EDLX_TOKEN_INVALID;
 }
 
+/* A token is described by where it sits in the command line. The text of
+   a lexeme is only copied out when somebody asks for it. */
+typedef struct edlx_view_t {
+	size_t start, end;
+	size_t lexeme_start, lexeme_size;
+	int escaped;
+	edlx_token_t token;
+} edlx_view_t;
+
 struct edlx_ctx_t {
 	const char *cmdline;
+	size_t cmdline_size;
 
-	char *curr_lexeme;
-	size_t curr_lexeme_alloced, curr_lexeme_size;
-	size_t curr_lexeme_start, curr_lexeme_end;
+	edlx_view_t curr, last;
+	int can_rewind;
 
-	edlx_token_t curr_token;
-
-	struct edlx_ctx_t *last_state;
+	/* Scratch space for one lexeme. No lexeme is longer than the line it
+	   came from, so it only has to grow when a longer line comes in. */
+	char *lexeme;
+	size_t lexeme_alloced;
+	int lexeme_valid;
 };
 
 /**/
 
-static int isdelim(const char c) {
-	size_t i;
-	static const char delim[] = ",;";
+void edlx_ctx_free(edlx_ctx_t *ctx) {
+	if(ctx == NULL) return;
 
-	for(i = 0; i < sizeof(delim); i++)
-		if(c == delim[i]) return 1;
-	return 0;
+	free(ctx->lexeme);
+	free(ctx);
 }
 
-static int iscmd(const char c) {
-	size_t i;
-	static const char cmd[] = "ACDEILMPQRSTW";
+/* Points the lexer at the next command line. */
+int edlx_ctx_restart(edlx_ctx_t *ctx, const char *cmdline) {
+	size_t cmdline_size, new_size;
+	char *new_lexeme;
 
-	for(i = 0; i < sizeof(cmd); i++)
-		if(toupper(c) == cmd[i]) return 1;
-	return 0;
-}
+	if((ctx == NULL) || (cmdline == NULL)) return RET_ERR_NULLPO;
+	cmdline_size = strlen(cmdline);
 
-/**/
+	if(cmdline_size + 1 > ctx->lexeme_alloced) {
+		new_size = ctx->lexeme_alloced > 0 ? ctx->lexeme_alloced : 64;
+		while(new_size < cmdline_size + 1)
+			new_size *= 2;
 
-void edlx_ctx_free(edlx_ctx_t *ctx) {
-	if(ctx == NULL) return;
+		if((new_lexeme = realloc(ctx->lexeme, new_size)) == NULL)
+			return RET_ERR_MALLOC;
+		ctx->lexeme = new_lexeme;
+		ctx->lexeme_alloced = new_size;
+	}
 
-	if(ctx->last_state != NULL)
-		edlx_ctx_free(ctx->last_state);
+	ctx->cmdline = cmdline;
+	ctx->cmdline_size = cmdline_size;
 
-	free(ctx->curr_lexeme);
-	free(ctx);
+	ctx->curr.start = 0;
+	ctx->curr.end = 0;
+	ctx->curr.lexeme_start = 0;
+	ctx->curr.lexeme_size = 0;
+	ctx->curr.escaped = 0;
+	ctx->curr.token = EDLX_TOKEN_INVALID;
+	ctx->last = ctx->curr;
+	ctx->can_rewind = 0;
+
+	ctx->lexeme[0] = '\0';
+	ctx->lexeme_valid = 1;
+
+	return RET_OK;
 }
 
 edlx_ctx_t *edlx_ctx_new(const char *cmdline, int *status) {
@@ -173,301 +277,138 @@ edlx_ctx_t *edlx_ctx_new(const char *cmdline, int *status) {
 
 	if(status == NULL) return NULL;
 
+	*status = RET_ERR_NULLPO;
+	if(cmdline == NULL) return NULL;
+
 	*status = RET_ERR_MALLOC;
 	if((out = malloc(sizeof(edlx_ctx_t))) == NULL) return NULL;
+	out->lexeme = NULL;
+	out->lexeme_alloced = 0;
 
-	out->cmdline = cmdline;
-
-	out->curr_lexeme = NULL;
-	out->curr_lexeme_alloced = 0;
-	out->curr_lexeme_size = 0;
-	out->curr_lexeme_start = 0;
-	out->curr_lexeme_end = 0;
-
-	out->curr_token = EDLX_TOKEN_INVALID;
-	out->last_state = NULL;
+	if((*status = edlx_ctx_restart(out, cmdline)) != RET_OK) {
+		free(out);
+		return NULL;
+	}
 
-	*status = RET_OK;
 	return out;
 }
 
-static char get_char(edlx_ctx_t *ctx) {
-	char ret;
-
-	if(ctx == NULL) return '\0';
-	if(ctx->cmdline == NULL) return '\0';
-
-	if(ctx->curr_lexeme_end >= strlen(ctx->cmdline))
-		ret = '\0';
-	else
-		ret = ctx->cmdline[ctx->curr_lexeme_end];
-
-	ctx->cmdline[ctx->curr_lexeme_end++];
-
-	return ret;
-}
-
-static int extend_lexeme(edlx_ctx_t *ctx, const char newchar) {
-	char *newbuf;
-
-	if(ctx->curr_lexeme_size + 1 >= ctx->curr_lexeme_alloced) {
-		if((newbuf = malloc(ctx->curr_lexeme_alloced + PREALLOC_LEXEME)) == NULL)
-			return RET_ERR_MALLOC;
-		memcpy(newbuf, ctx->curr_lexeme, ctx->curr_lexeme_alloced);
-		free(ctx->curr_lexeme);
-
-		ctx->curr_lexeme = newbuf;
-		ctx->curr_lexeme_alloced += PREALLOC_LEXEME;
-	}
-	ctx->curr_lexeme[ctx->curr_lexeme_size++] = newchar;
-	ctx->curr_lexeme[ctx->curr_lexeme_size] = '\0';
-	return RET_OK;
-}
-
 /**/
 
-static void prepare_ctx(edlx_ctx_t *ctx) {
-	edlx_ctx_t *last_state;
-
-	if(ctx->last_state != NULL)
-		edlx_ctx_free(ctx->last_state);
-
-	/* Save current state to enable rewinding. */
-	if((ctx->last_state = malloc(sizeof(edlx_ctx_t))) == NULL) {
-		fprintf(stderr, "%s: Couldn't save lexer state.\n", APP_NAME);
-	} else {
-		last_state = ctx->last_state;
-
-		if((last_state->curr_lexeme = malloc(ctx->curr_lexeme_alloced)) == NULL) {
-			fprintf(stderr, "%s: Couldn't save previous lexeme.\n", APP_NAME);
-			goto copy_failed;
-		}
-
-		memcpy(last_state->curr_lexeme, ctx->curr_lexeme, ctx->curr_lexeme_alloced);
-
-		last_state->cmdline = ctx->cmdline;
-		last_state->curr_lexeme_alloced = ctx->curr_lexeme_alloced;
-		last_state->curr_lexeme_size = ctx->curr_lexeme_size;
-		last_state->curr_lexeme_start = ctx->curr_lexeme_start;
-		last_state->curr_lexeme_end = ctx->curr_lexeme_end;
-		last_state->curr_token = ctx->curr_token;
-
-		last_state->last_state = NULL;
+static char unescape(const char c) {
+	switch(c) {
+		case 'a': return '\a';
+		case 'b': return '\b';
+		case 'f': return '\f';
+		case 'n': return '\n';
+		case 'r': return '\r';
+		case 't': return '\t';
+		case 'v': return '\v';
+		case '\\': return '\\';
+		case '\'': return '\'';
+		case '\"': return '\"';
+		case '\?': return '\?';
 	}
-
-copy_failed:
-	free(ctx->curr_lexeme);
-
-	ctx->curr_lexeme = NULL;
-	ctx->curr_lexeme_alloced = 0;
-	ctx->curr_lexeme_size = 0;
-	ctx->curr_lexeme_start = ctx->curr_lexeme_end;
+	return '\\';
 }
 
 int edlx_step(edlx_ctx_t *ctx) {
-	int done = 0, skip = 0, addcurrchar = 0;
-	char curr_char = 0;
-	edlx_state_t state;
-	edlx_token_t token;
-	int status;
+	const uint8_t *cmdline;
+	edlx_view_t *view;
+	size_t pos, overrun = 0;
+	uint8_t state, transition;
+	int escaped = 0;
 
 	if(ctx == NULL) return RET_ERR_NULLPO;
 
-	prepare_ctx(ctx);
+	ctx->last = ctx->curr;
+	ctx->can_rewind = 1;
+	ctx->lexeme_valid = 0;
+
+	cmdline = (const uint8_t*)ctx->cmdline;
+	view = &ctx->curr;
+	pos = view->end;
+
+	/* All that's left after a string that ran into the end of the line
+	   is the end of the line, where it is. */
+	if(pos > ctx->cmdline_size) {
+		view->start = pos;
+		view->lexeme_start = ctx->cmdline_size;
+		view->lexeme_size = 0;
+		view->escaped = 0;
+		view->token = EDLX_TOKEN_EOL;
+		return RET_OK;
+	}
+
+	while(edlx_char_class[cmdline[pos]] == SPC)
+		pos++;
+	view->start = pos;
+
 	state = EDLX_STATE_START;
-	while(done == 0) {
-		curr_char = get_char(ctx);
-
-		addcurrchar = 1;
-
-		switch(state) {
-			case EDLX_STATE_START:
-				if(curr_char == '\0') {
-					state = EDLX_STATE_EOL;
-					addcurrchar = 0;
-					done = 1;
-				} else if(ext_isspace(curr_char)) {
-					ctx->curr_lexeme_start++;
-					addcurrchar = 0;
-				} else if(ext_isdigit(curr_char)) {
-					state = EDLX_STATE_NUMBER;
-				} else if(curr_char == '?') {
-					state = EDLX_STATE_ASK;
-				} else if(curr_char == '.') {
-					state = EDLX_STATE_THIS_LINE;
-				} else if(iscmd(curr_char)) {
-					state = EDLX_STATE_COMMAND;
-				} else if(ext_isalpha(curr_char)) {
-					state = EDLX_STATE_TEXT;
-				} else if(isdelim(curr_char)) {
-					state = EDLX_STATE_DELIM;
-				} else if(curr_char == '"') {
-					addcurrchar = 0;
-					state = EDLX_STATE_STRING;
-				} else {
-					state = EDLX_STATE_INVALID;
-					addcurrchar = 0;
-					skip = 1;
-					done = 1;
-				}
-				break;
-
-			case EDLX_STATE_NUMBER:
-				if(ext_isdigit(curr_char)) {
-					state = EDLX_STATE_NUMBER;
-				} else {
-					addcurrchar = 0;
-					done = 1;
-				}
-				break;
-
-			case EDLX_STATE_DELIM:
-				addcurrchar = 0;
-				done = 1;
-				break;
-
-			case EDLX_STATE_THIS_LINE:
-				addcurrchar = 0;
-				done = 1;
-				break;
-
-			case EDLX_STATE_COMMAND:
-				if(ext_isalnum(curr_char)) {
-					state = EDLX_STATE_TEXT;
-				} else {
-					addcurrchar = 0;
-					done = 1;
-				}
-				break;
-
-			case EDLX_STATE_TEXT:
-				if(ext_isalnum(curr_char)) {
-					state = EDLX_STATE_TEXT;
-				} else {
-					addcurrchar = 0;
-					done = 1;
-				}
-				break;
-
-			case EDLX_STATE_ASK:
-				if(curr_char == 'R') {
-					state = EDLX_STATE_ASK_REPLACE;
-					skip = 1;
-					done = 1;
-				} else if(curr_char == 'S') {
-					state = EDLX_STATE_ASK_SEARCH;
-					skip = 1;
-					done = 1;
-				} else {
-					state = EDLX_STATE_ASK;
-					addcurrchar = 0;
-					done = 1;
-				}
-				break;
-
-			case EDLX_STATE_STRING:
-				if(curr_char == '\0') {
-					state = EDLX_STATE_INVALID;
-				} else if(curr_char == '"') {
-					state = EDLX_STATE_STRING_END;
-					addcurrchar = 0;
-				} else if(curr_char == '\\') {
-					state = EDLX_STATE_STRING_ESCAPE;
-					addcurrchar = 0;
-				}
-				break;
-
-			case EDLX_STATE_STRING_ESCAPE:
-				switch(curr_char) {
-					case 'a': curr_char = '\a'; break;
-					case 'b': curr_char = '\b'; break;
-					case 'f': curr_char = '\f'; break;
-					case 'n': curr_char = '\n'; break;
-					case 'r': curr_char = '\r'; break;
-					case 't': curr_char = '\t'; break;
-					case 'v': curr_char = '\v'; break;
-					case '\\': curr_char = '\\'; break;
-					case '\'': curr_char = '\''; break;
-					case '\"': curr_char = '\"'; break;
-					case '\?': curr_char = '\?'; break;
-					default: curr_char = '\\'; break;
-				}
-				state = EDLX_STATE_STRING;
-				break;
-
-			case EDLX_STATE_STRING_END:
-				addcurrchar = 0;
- 				done = 1;
-				break;
-
-			case EDLX_STATE_INVALID:
-				addcurrchar = 0;
-				done = 1;
-				break;
-		}
+	for(;;) {
+		transition = edlx_transitions[state][edlx_char_class[cmdline[pos]]];
+		if(transition & (TAKE | DONE)) break;
 
-		if(addcurrchar) {
-			if((status = extend_lexeme(ctx, curr_char)) != RET_OK) {
-				ctx->curr_token = EDLX_TOKEN_INVALID;
-				return status;
-			}
-		}
+		state = transition;
+		if(state == EDLX_STATE_STRING_ESCAPE) escaped = 1;
+		pos++;
 	}
 
-	if(skip == 0 && ctx->curr_lexeme_end > 0)
-		ctx->curr_lexeme_end--;
+	/* A string that runs into the end of the line ends one past it, so
+	   that an error points to where the closing quote is missing. A
+	   backslash right before the end takes it as the escaped character,
+	   and the string ends one further on. */
+	if(transition == (DONE | EDLX_STATE_INVALID))
+		overrun = state == EDLX_STATE_STRING_ESCAPE ? 2 : 1;
+	state = NEXT(transition);
 
-	if(ctx->curr_lexeme == NULL) {
-		ctx->curr_lexeme = malloc(1);
-		if(ctx->curr_lexeme == NULL)
-			return RET_ERR_MALLOC;
-		ctx->curr_lexeme[0] = '\0';
-	}
+	/* Don't step over the end of the line. */
+	if((transition & TAKE) && (cmdline[pos] != '\0'))
+		pos++;
+	view->end = pos + overrun;
+
+	view->lexeme_start = view->start;
+	view->lexeme_size = view->end - view->start;
+	view->escaped = 0;
 
 	switch(state) {
-		case EDLX_STATE_INVALID:			token = EDLX_TOKEN_INVALID;				break;
-		case EDLX_STATE_NUMBER:				token = EDLX_TOKEN_NUMBER;				break;
-		case EDLX_STATE_TEXT:				token = EDLX_TOKEN_TEXT;				break;
-		case EDLX_STATE_ASK:				token = EDLX_TOKEN_KW_ASK;				break;
-		case EDLX_STATE_ASK_REPLACE:		token = EDLX_TOKEN_KW_ASK_REPLACE;		break;
-		case EDLX_STATE_ASK_SEARCH:			token = EDLX_TOKEN_KW_ASK_SEARCH;		break;
-		case EDLX_STATE_STRING_END:			token = EDLX_TOKEN_STRING;				break;
-		case EDLX_STATE_THIS_LINE:			token = EDLX_TOKEN_THIS_LINE;			break;
-		case EDLX_STATE_EOL:				token = EDLX_TOKEN_EOL;					break;
-		case EDLX_STATE_DELIM:				token = get_delim(ctx->curr_lexeme);	break;
-		case EDLX_STATE_COMMAND:			token = get_command(ctx->curr_lexeme);	break;
-		default:							token = EDLX_TOKEN_ERROR;
+		case EDLX_STATE_INVALID:		view->token = EDLX_TOKEN_INVALID;
+										view->lexeme_size = 0;						break;
+		case EDLX_STATE_NUMBER:			view->token = EDLX_TOKEN_NUMBER;			break;
+		case EDLX_STATE_TEXT:			view->token = EDLX_TOKEN_TEXT;				break;
+		case EDLX_STATE_ASK:			view->token = EDLX_TOKEN_KW_ASK;			break;
+		case EDLX_STATE_ASK_REPLACE:	view->token = EDLX_TOKEN_KW_ASK_REPLACE;	break;
+		case EDLX_STATE_ASK_SEARCH:		view->token = EDLX_TOKEN_KW_ASK_SEARCH;		break;
+		case EDLX_STATE_NOCASE:			view->token = EDLX_TOKEN_KW_NOCASE;			break;
+		case EDLX_STATE_THIS_LINE:		view->token = EDLX_TOKEN_THIS_LINE;			break;
+		case EDLX_STATE_EOL:			view->token = EDLX_TOKEN_EOL;				break;
+		case EDLX_STATE_DELIM:			view->token = get_delim(cmdline[view->start]);	break;
+		case EDLX_STATE_COMMAND:
+			view->token = get_command(ctx->cmdline + view->start, view->lexeme_size);
+			break;
+		case EDLX_STATE_STRING_END:
+			/* The lexeme is what's between the quotes. */
+			view->token = EDLX_TOKEN_STRING;
+			view->lexeme_start++;
+			view->lexeme_size -= 2;
+			view->escaped = escaped;
+			break;
+		default:						view->token = EDLX_TOKEN_ERROR;
 	}
 
-	ctx->curr_token = token;
 	return RET_OK;
 }
 
 int edlx_rewind(edlx_ctx_t *ctx) {
-	edlx_ctx_t *last_state;
-
 	if(ctx == NULL) return RET_ERR_NULLPO;
-	if(ctx->last_state == NULL) {
+	if(ctx->can_rewind == 0) {
 		fprintf(stderr, "%s: Couldn't rewind lexer state. No previous state saved.\n", APP_NAME);
 		return RET_ERR_NULLPO;
 	}
 
-	last_state = ctx->last_state;
-	free(ctx->curr_lexeme);
-
-	if((ctx->curr_lexeme = malloc(last_state->curr_lexeme_alloced)) == NULL) {
-		fprintf(stderr, "%s: Couldn't rewind lexer state. Couldn't allocate lexeme.\n", APP_NAME);
-		return RET_ERR_MALLOC;
-	}
-	memcpy(ctx->curr_lexeme, last_state->curr_lexeme, last_state->curr_lexeme_size);
-	ctx->curr_lexeme_alloced = last_state->curr_lexeme_alloced;
-	ctx->curr_lexeme_size = last_state->curr_lexeme_size;
-	ctx->curr_lexeme_start = last_state->curr_lexeme_start;
-	ctx->curr_lexeme_end = last_state->curr_lexeme_end;
-	ctx->curr_token = last_state->curr_token;
-	ctx->last_state = NULL;
-	
-	edlx_ctx_free(last_state);
+	ctx->curr = ctx->last;
+	ctx->can_rewind = 0;
+	ctx->lexeme_valid = 0;
 
 	return RET_OK;
 }
@@ -488,7 +429,7 @@ void edlx_print_error(edlx_ctx_t *ctx, const char *errmsg, const int printline,
 		printf("%s\n", ctx->cmdline);
 	}
 
-	pointer_pos = ctx->curr_lexeme_end + add_pad;
+	pointer_pos = ctx->curr.end + add_pad;
 	if(pointer_pos > 0) pointer_pos--;
 
 	for(i = 0; i < pointer_pos; i++)
@@ -508,7 +449,7 @@ edlx_token_t edlx_get_token(edlx_ctx_t *ctx, int *status) {
 		return EDLX_TOKEN_ERROR;
 	}
 	*status = RET_OK;
-	return ctx->curr_token;
+	return ctx->curr.token;
 }
 
 int edlx_get_required_token(edlx_ctx_t *ctx, edlx_token_t expect) {
@@ -533,7 +474,8 @@ char edlx_get_lookahead(edlx_ctx_t *ctx, int *status) {
 	if(ctx == NULL) return '\0';
 
 	*status = RET_OK;
-	seek_pos = ctx->curr_lexeme_end;
+	seek_pos = ctx->curr.end;
+	if(seek_pos > ctx->cmdline_size) return '\0';
 	do {
 		curr_char = ctx->cmdline[seek_pos++];
 	} while(ext_isspace(curr_char) && (curr_char != '\0'));
@@ -542,6 +484,38 @@ char edlx_get_lookahead(edlx_ctx_t *ctx, int *status) {
 }
 
 char *edlx_get_lexeme(edlx_ctx_t *ctx) {
+	const char *in;
+	char *out;
+	size_t i;
+
 	if(ctx == NULL) return NULL;
-	return ctx->curr_lexeme;
+	if(ctx->lexeme_valid) return ctx->lexeme;
+
+	in = ctx->cmdline + ctx->curr.lexeme_start;
+	if(ctx->curr.escaped == 0) {
+		memcpy(ctx->lexeme, in, ctx->curr.lexeme_size);
+		ctx->lexeme[ctx->curr.lexeme_size] = '\0';
+	} else {
+		out = ctx->lexeme;
+		for(i = 0; i < ctx->curr.lexeme_size; i++) {
+			if(in[i] == '\\')
+				*out++ = unescape(in[++i]);
+			else
+				*out++ = in[i];
+		}
+		*out = '\0';
+	}
+
+	ctx->lexeme_valid = 1;
+	return ctx->lexeme;
+}
+
+/* The raw lexeme, as it appears on the command line. Escapes in strings
+   are left alone. */
+int edlx_get_view(edlx_ctx_t *ctx, size_t *offset, size_t *length) {
+	if((ctx == NULL) || (offset == NULL) || (length == NULL)) return RET_ERR_NULLPO;
+
+	*offset = ctx->curr.lexeme_start;
+	*length = ctx->curr.lexeme_size;
+	return RET_OK;
 }
@@ -6,6 +6,8 @@
 #ifndef LEXER_H_
 #define LEXER_H_
 
+#include <stddef.h>
+
 typedef enum edlx_token_t {
 	EDLX_TOKEN_INVALID = -1,
 	EDLX_TOKEN_ERROR = -2,
@@ -18,7 +20,7 @@ typedef enum edlx_token_t {
 	EDLX_TOKEN_DELIM_COMMA,
 	EDLX_TOKEN_DELIM_SEMICOLON,
 
-	/* ACDEILMPQRSTW */
+	/* ACDEFGILMNPQRSTW */
 	EDLX_TOKEN_KW_APPEND,
 	EDLX_TOKEN_KW_COPY,
 	EDLX_TOKEN_KW_DELETE,
@@ -35,6 +37,10 @@ typedef enum edlx_token_t {
 	EDLX_TOKEN_KW_ASK,
 	EDLX_TOKEN_KW_ASK_REPLACE,
 	EDLX_TOKEN_KW_ASK_SEARCH,
+	EDLX_TOKEN_KW_FIND,
+	EDLX_TOKEN_KW_COUNT,
+	EDLX_TOKEN_KW_NOCASE,
+	EDLX_TOKEN_KW_GLOBAL,
 
 	EDLX_TOKEN_EOL = 100,
 	EDLX_TOKEN_EOF = 101
@@ -46,12 +52,14 @@ void edlx_token_str(const edlx_token_t token);
 
 edlx_ctx_t *edlx_ctx_new(const char *cmdline, int *status);
 void edlx_ctx_free(edlx_ctx_t *ctx);
+int edlx_ctx_restart(edlx_ctx_t *ctx, const char *cmdline);
 int edlx_step(edlx_ctx_t *ctx);
 int edlx_rewind(edlx_ctx_t *ctx);
 
 edlx_token_t edlx_get_token(edlx_ctx_t *ctx, int *status);
 int edlx_get_required_token(edlx_ctx_t *ctx, edlx_token_t expect);
 char *edlx_get_lexeme(edlx_ctx_t *ctx);
+int edlx_get_view(edlx_ctx_t *ctx, size_t *offset, size_t *length);
 char edlx_get_lookahead(edlx_ctx_t *ctx, int *status);
 
 void edlx_print_error(edlx_ctx_t *ctx, const char *errmsg, const int printline, const char *prompt);
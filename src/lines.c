@@ -0,0 +1,780 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+#define EDLN_SCRATCH
+#endif
+
+#ifdef __linux__
+#include <sys/vfs.h>
+#define EDLN_TMPFS_MAGIC	0x01021994
+#endif
+
+#include "mem.h"
+
+#include "ermac.h"
+#include "lines.h"
+#include "thread.h"
+
+#define PREALLOC_SHARED		1024
+#define PREALLOC_TEXTS		4096
+#define PREALLOC_BLOCKS		16
+
+#define POOL_BLOCK			(1024 * 1024)
+#define POOL_MAX_LINE		(POOL_BLOCK / 16)
+#define COMPACT_MIN			(4 * 1024 * 1024)
+
+/* How many places have a line that's in more than one. */
+typedef struct edln_entry_t {
+	char *line;
+	size_t refs;
+} edln_entry_t;
+
+/* An interned line. It's in the table for as long as it's anywhere. */
+typedef struct edln_text_t {
+	char *line;
+	uint32_t hash;
+	size_t refs;
+} edln_text_t;
+
+/* Both are open addressing, the first on the pointer, the second on the
+   text. They're freed whenever they run empty, so there's nothing left
+   over at the end. */
+typedef struct edln_table_t {
+	edln_entry_t *entries;
+	size_t n_used, n_alloced;
+} edln_table_t;
+
+typedef struct edln_texts_t {
+	edln_text_t *entries;
+	size_t n_used, n_alloced;
+	size_t n_refs, bytes_saved;
+} edln_texts_t;
+
+/* Lines read from files are packed one after the other into big blocks
+   of text, which keeps them next to each other in memory and saves a
+   malloc() for each one. The room of a dead line isn't used again; a
+   block is freed once all of its text is dead, and compaction moves the
+   lines that are left out of blocks that are mostly dead. */
+typedef struct edln_block_t {
+	char *text;
+	size_t used, dead;
+	struct edln_block_t *newer, *older;
+	int moving, resident;
+} edln_block_t;
+
+/* Sorted by address. New lines go into the current block. Out of core,
+   the blocks are mapped from a scratch file, and only the ones that were
+   written to or let go of most recently stay in memory, up to the
+   budget; the others are left to the file until they're needed. */
+typedef struct edln_pool_t {
+	edln_block_t **blocks;
+	size_t n_blocks, n_alloced;
+	edln_block_t *current;
+	size_t used, dead, compact_at;
+
+	int fd;
+	uint64_t file_size;
+	size_t budget, n_resident;
+	edln_block_t *newest, *oldest;
+	time_t trimmed_at;
+} edln_pool_t;
+
+static edln_table_t shared = { NULL, 0, 0 };
+static edln_texts_t texts = { NULL, 0, 0, 0, 0 };
+static edln_pool_t pool = { NULL, 0, 0, NULL, 0, 0, COMPACT_MIN, -1, 0, 0, 0, NULL, NULL, 0 };
+static int interning = 0;
+static ed_lock_t shared_lock = ED_LOCK_INITIALIZER;
+
+/**/
+
+static uint64_t read64(const char *p) {
+	uint64_t out;
+
+	memcpy(&out, p, sizeof(out));
+	return out;
+}
+
+/* Multiplies and folds the halves together, the way wyhash does. */
+static uint64_t mix(const uint64_t a, const uint64_t b) {
+#ifdef __SIZEOF_INT128__
+	__uint128_t product = (__uint128_t)a * b;
+
+	return (uint64_t)product ^ (uint64_t)(product >> 64);
+#else
+	uint64_t lo = a * b, hi = (a >> 32) * (b >> 32) + (((a >> 32) * (b & 0xffffffff)) >> 32) + (((a & 0xffffffff) * (b >> 32)) >> 32);
+
+	return lo ^ hi;
+#endif
+}
+
+static uint32_t hash_text(const char *text, const size_t length) {
+	const uint64_t p0 = 0xa0761d6478bd642fULL, p1 = 0xe7037ed1a0b428dbULL;
+	const uint64_t p2 = 0x8ebc6af09c88c6e3ULL, p3 = 0x589965cc75374cc3ULL;
+	uint64_t seed = length * p0, a, b;
+	char tail[16];
+	size_t pos = 0;
+
+	for(; pos + 16 <= length; pos += 16)
+		seed = mix(read64(text + pos) ^ p1, read64(text + pos + 8) ^ seed);
+
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, text + pos, length - pos);
+	a = read64(tail);
+	b = read64(tail + 8);
+
+	return mix(mix(a ^ p2, b ^ seed) ^ p1, length ^ p3) >> 32;
+}
+
+static size_t slot_of(const char *line, const size_t n_alloced) {
+	uint64_t hash = (uintptr_t)line;
+
+	hash = (hash >> 4) * 0x9e3779b97f4a7c15ULL;
+	return (hash >> 32) & (n_alloced - 1);
+}
+
+static edln_entry_t *find(const char *line) {
+	size_t i;
+
+	if(shared.n_used == 0) return NULL;
+
+	for(i = slot_of(line, shared.n_alloced); shared.entries[i].line != NULL; i = (i + 1) & (shared.n_alloced - 1)) {
+		if(shared.entries[i].line == line) return &shared.entries[i];
+	}
+
+	return NULL;
+}
+
+static void put(edln_entry_t *entries, const size_t n_alloced, const edln_entry_t *entry) {
+	size_t i;
+
+	for(i = slot_of(entry->line, n_alloced); entries[i].line != NULL; i = (i + 1) & (n_alloced - 1));
+	entries[i] = *entry;
+}
+
+static int grow(void) {
+	edln_entry_t *new_entries;
+	size_t new_size, i;
+
+	new_size = shared.n_alloced > 0 ? shared.n_alloced * 2 : PREALLOC_SHARED;
+	if((new_entries = calloc(new_size, sizeof(edln_entry_t))) == NULL) return 0;
+
+	for(i = 0; i < shared.n_alloced; i++) {
+		if(shared.entries[i].line != NULL)
+			put(new_entries, new_size, &shared.entries[i]);
+	}
+
+	free(shared.entries);
+	shared.entries = new_entries;
+	shared.n_alloced = new_size;
+	return 1;
+}
+
+/* Takes the entry out and moves up the ones after it that would
+   otherwise no longer be found. */
+static void remove_entry(edln_entry_t *entry) {
+	size_t hole = entry - shared.entries, i, home;
+
+	if(--shared.n_used == 0) {
+		free(shared.entries);
+		shared.entries = NULL;
+		shared.n_alloced = 0;
+		return;
+	}
+
+	for(i = (hole + 1) & (shared.n_alloced - 1); shared.entries[i].line != NULL; i = (i + 1) & (shared.n_alloced - 1)) {
+		home = slot_of(shared.entries[i].line, shared.n_alloced);
+		if(((i - home) & (shared.n_alloced - 1)) >= ((i - hole) & (shared.n_alloced - 1))) {
+			shared.entries[hole] = shared.entries[i];
+			hole = i;
+		}
+	}
+	shared.entries[hole].line = NULL;
+}
+
+/**/
+
+/* The interned line with this text, or, with same_line set, this very
+   interned line. */
+static edln_text_t *find_text(const char *line, const size_t length, const uint32_t hash, const int same_line) {
+	edln_text_t *entry;
+	size_t i;
+
+	if(texts.n_used == 0) return NULL;
+
+	for(i = hash & (texts.n_alloced - 1); texts.entries[i].line != NULL; i = (i + 1) & (texts.n_alloced - 1)) {
+		entry = &texts.entries[i];
+		if(entry->hash != hash) continue;
+
+		if(same_line) {
+			if(entry->line == line) return entry;
+		} else if(!strncmp(entry->line, line, length) && (entry->line[length] == '\0')) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static void put_text(edln_text_t *entries, const size_t n_alloced, const edln_text_t *entry) {
+	size_t i;
+
+	for(i = entry->hash & (n_alloced - 1); entries[i].line != NULL; i = (i + 1) & (n_alloced - 1));
+	entries[i] = *entry;
+}
+
+static int grow_texts(void) {
+	edln_text_t *new_entries;
+	size_t new_size, i;
+
+	new_size = texts.n_alloced > 0 ? texts.n_alloced * 2 : PREALLOC_TEXTS;
+	if((new_entries = calloc(new_size, sizeof(edln_text_t))) == NULL) return 0;
+
+	for(i = 0; i < texts.n_alloced; i++) {
+		if(texts.entries[i].line != NULL)
+			put_text(new_entries, new_size, &texts.entries[i]);
+	}
+
+	free(texts.entries);
+	texts.entries = new_entries;
+	texts.n_alloced = new_size;
+	return 1;
+}
+
+static void remove_text(edln_text_t *entry) {
+	size_t hole = entry - texts.entries, i, home;
+
+	if(--texts.n_used == 0) {
+		free(texts.entries);
+		texts.entries = NULL;
+		texts.n_alloced = 0;
+		return;
+	}
+
+	for(i = (hole + 1) & (texts.n_alloced - 1); texts.entries[i].line != NULL; i = (i + 1) & (texts.n_alloced - 1)) {
+		home = texts.entries[i].hash & (texts.n_alloced - 1);
+		if(((i - home) & (texts.n_alloced - 1)) >= ((i - hole) & (texts.n_alloced - 1))) {
+			texts.entries[hole] = texts.entries[i];
+			hole = i;
+		}
+	}
+	texts.entries[hole].line = NULL;
+}
+
+static int add_text(char *line, const uint32_t hash) {
+	edln_text_t new_text;
+
+	if(((texts.n_used + 1) * 4 > texts.n_alloced * 3) && !grow_texts())
+		return 0;
+
+	new_text.line = line;
+	new_text.hash = hash;
+	new_text.refs = 1;
+	put_text(texts.entries, texts.n_alloced, &new_text);
+	texts.n_used++;
+	texts.n_refs++;
+	return 1;
+}
+
+/* Another line with the text of one that's already interned. */
+static char *use_text(edln_text_t *text, const size_t length) {
+	text->refs++;
+	texts.n_refs++;
+	texts.bytes_saved += length + 1;
+	return text->line;
+}
+
+static edln_text_t *find_interned(const char *line, size_t *length) {
+	if(texts.n_used == 0) return NULL;
+
+	*length = strlen(line);
+	return find_text(line, *length, hash_text(line, *length), 1);
+}
+
+/**/
+
+/* Where the block with this text is or would go. */
+static size_t block_slot(const char *text) {
+	size_t lo = 0, hi = pool.n_blocks, mid;
+
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(pool.blocks[mid]->text <= text) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return lo;
+}
+
+/* The block the line is in, if it's in the pool at all. */
+static edln_block_t *find_block(const char *line) {
+	edln_block_t *block;
+	size_t i;
+
+	if((pool.n_blocks == 0) || ((i = block_slot(line)) == 0)) return NULL;
+
+	block = pool.blocks[i - 1];
+	return line < block->text + block->used ? block : NULL;
+}
+
+static void unlink_block(edln_block_t *block) {
+	if(block->newer != NULL) block->newer->older = block->older;
+	else pool.newest = block->older;
+	if(block->older != NULL) block->older->newer = block->newer;
+	else pool.oldest = block->newer;
+
+	block->newer = block->older = NULL;
+}
+
+/* The pages are written to the scratch file if they have to be, and
+   they're read back in when a line in the block is used again. */
+static void drop_pages(char *text) {
+#ifdef EDLN_SCRATCH
+#ifdef MADV_PAGEOUT
+	if(madvise(text, POOL_BLOCK, MADV_PAGEOUT) == 0) return;
+#endif
+	madvise(text, POOL_BLOCK, MADV_DONTNEED);
+#else
+	(void)text;
+#endif
+}
+
+static void evict(edln_block_t *block) {
+	unlink_block(block);
+	block->resident = 0;
+	pool.n_resident--;
+	drop_pages(block->text);
+}
+
+/* Out of core, a block that's used goes to the front of the queue, and
+   the ones at the back go out once there are more than the budget. */
+static void touch(edln_block_t *block) {
+	if((pool.fd < 0) || (pool.newest == block)) return;
+
+	if(block->resident) {
+		unlink_block(block);
+	} else {
+		block->resident = 1;
+		pool.n_resident++;
+	}
+
+	block->older = pool.newest;
+	if(pool.newest != NULL) pool.newest->newer = block;
+	else pool.oldest = block;
+	pool.newest = block;
+
+	while((pool.n_resident * POOL_BLOCK > pool.budget) && (pool.oldest != block))
+		evict(pool.oldest);
+}
+
+/* The text of a block, from the heap or, out of core, the scratch file. */
+static char *map_block(void) {
+#ifdef EDLN_SCRATCH
+	void *text;
+
+	if(pool.fd >= 0) {
+		if(ftruncate(pool.fd, (off_t)(pool.file_size + POOL_BLOCK)) != 0) return NULL;
+		text = mmap(NULL, POOL_BLOCK, PROT_READ | PROT_WRITE, MAP_SHARED, pool.fd, (off_t)pool.file_size);
+		if(text == MAP_FAILED) return NULL;
+
+		pool.file_size += POOL_BLOCK;
+		return text;
+	}
+#endif
+
+	return malloc(POOL_BLOCK);
+}
+
+static void unmap_block(char *text) {
+#ifdef EDLN_SCRATCH
+	if(pool.fd >= 0) {
+#ifdef MADV_REMOVE
+		/* Gives the room in the scratch file back, where that works. */
+		madvise(text, POOL_BLOCK, MADV_REMOVE);
+#endif
+		munmap(text, POOL_BLOCK);
+		return;
+	}
+#endif
+
+	free(text);
+}
+
+static void free_block(edln_block_t *block) {
+	size_t i = block_slot(block->text) - 1;
+
+	pool.used -= block->used;
+	pool.dead -= block->dead;
+	if(block->resident) {
+		unlink_block(block);
+		pool.n_resident--;
+	}
+	if(pool.current == block) pool.current = NULL;
+
+	unmap_block(block->text);
+	free(block);
+
+	memmove(&pool.blocks[i], &pool.blocks[i + 1], (pool.n_blocks - i - 1) * sizeof(edln_block_t*));
+	if(--pool.n_blocks == 0) {
+		free(pool.blocks);
+		pool.blocks = NULL;
+		pool.n_alloced = 0;
+	}
+}
+
+/* A dead line's text stays where it is until its whole block goes. */
+static int release(const char *line) {
+	edln_block_t *block;
+	size_t size;
+
+	if((block = find_block(line)) == NULL) return 0;
+
+	size = strlen(line) + 1;
+	block->dead += size;
+	pool.dead += size;
+
+	if(block->dead == block->used) free_block(block);
+	else touch(block);
+
+	return 1;
+}
+
+static edln_block_t *new_block(void) {
+	edln_block_t **new_blocks, *block;
+	size_t new_size, i;
+
+	if(pool.n_blocks == pool.n_alloced) {
+		new_size = pool.n_alloced > 0 ? pool.n_alloced * 2 : PREALLOC_BLOCKS;
+		if((new_blocks = realloc(pool.blocks, new_size * sizeof(edln_block_t*))) == NULL)
+			return NULL;
+		pool.blocks = new_blocks;
+		pool.n_alloced = new_size;
+	}
+
+	if((block = malloc(sizeof(edln_block_t))) == NULL) return NULL;
+	if((block->text = map_block()) == NULL) {
+		free(block);
+		return NULL;
+	}
+	block->used = block->dead = 0;
+	block->newer = block->older = NULL;
+	block->moving = block->resident = 0;
+
+	i = block_slot(block->text);
+	memmove(&pool.blocks[i + 1], &pool.blocks[i], (pool.n_blocks - i) * sizeof(edln_block_t*));
+	pool.blocks[i] = block;
+	pool.n_blocks++;
+
+	pool.current = block;
+	return block;
+}
+
+/* Room for a line in the pool, or NULL if it should be malloc()ed. */
+static char *pool_alloc(const size_t size) {
+	edln_block_t *block = pool.current;
+	char *out;
+
+	if(size > POOL_MAX_LINE) return NULL;
+
+	if((block == NULL) || (POOL_BLOCK - block->used < size)) {
+		if((block = new_block()) == NULL) return NULL;
+	}
+	touch(block);
+
+	out = block->text + block->used;
+	block->used += size;
+	pool.used += size;
+	return out;
+}
+
+/**/
+
+/* The line is in one more place. NULL if that couldn't be noted. */
+char *edln_share(char *line) {
+	edln_entry_t *entry, new_entry;
+	edln_text_t *text;
+	size_t length;
+
+	if(line == NULL) return NULL;
+
+	ed_lock(&shared_lock);
+	if((text = find_interned(line, &length)) != NULL) {
+		text->refs++;
+		texts.n_refs++;
+		texts.bytes_saved += length + 1;
+	} else if((entry = find(line)) != NULL) {
+		entry->refs++;
+	} else {
+		if((shared.n_used + 1) * 4 > shared.n_alloced * 3) {
+			if(!grow()) {
+				ed_unlock(&shared_lock);
+				return NULL;
+			}
+		}
+		new_entry.line = line;
+		new_entry.refs = 2;
+		put(shared.entries, shared.n_alloced, &new_entry);
+		shared.n_used++;
+	}
+	ed_unlock(&shared_lock);
+
+	return line;
+}
+
+/* The line is in one place less. */
+void edln_free(char *line) {
+	edln_entry_t *entry;
+	edln_text_t *text;
+	size_t length;
+
+	if(line == NULL) return;
+
+	ed_lock(&shared_lock);
+	if((text = find_interned(line, &length)) != NULL) {
+		texts.n_refs--;
+		if(--text->refs > 0) {
+			texts.bytes_saved -= length + 1;
+			ed_unlock(&shared_lock);
+			return;
+		}
+		remove_text(text);
+	} else if((entry = find(line)) != NULL) {
+		if(--entry->refs == 1) remove_entry(entry);
+		ed_unlock(&shared_lock);
+		return;
+	}
+	if(release(line)) {
+		ed_unlock(&shared_lock);
+		return;
+	}
+	ed_unlock(&shared_lock);
+
+	free(line);
+}
+
+/* For tables of lines. */
+void edln_free_element(void *element) {
+	char **line = element;
+
+	edln_free(*line);
+}
+
+/**/
+
+void edln_set_interning(const int on) {
+	interning = on;
+}
+
+/* Hands back the interned line with the same text as this new one, which
+   is freed, if there is one. Otherwise, this one is interned. If that
+   doesn't work out, it simply stays a line of its own. Out of core, the
+   new line is moved to the pool, with the lines that were loaded. */
+char *edln_intern(char *line) {
+	edln_text_t *text;
+	char *out;
+	size_t length;
+	uint32_t hash = 0;
+
+	if((line == NULL) || (!interning && (pool.fd < 0))) return line;
+
+	length = strlen(line);
+	if(interning) hash = hash_text(line, length);
+
+	ed_lock(&shared_lock);
+	if(interning && ((text = find_text(line, length, hash, 0)) != NULL)) {
+		out = use_text(text, length);
+		ed_unlock(&shared_lock);
+
+		free(line);
+		return out;
+	}
+
+	if((pool.fd >= 0) && ((out = pool_alloc(length + 1)) != NULL)) {
+		memcpy(out, line, length + 1);
+		free(line);
+		line = out;
+	}
+
+	if(interning) add_text(line, hash);
+	ed_unlock(&shared_lock);
+
+	return line;
+}
+
+/* A new line with length bytes of text, packed into the pool. With
+   interning on, the interned line with that text if there is one. */
+char *edln_new(const char *text, const size_t length) {
+	edln_text_t *found;
+	uint32_t hash = 0;
+	char *out;
+
+	if(interning) hash = hash_text(text, length);
+
+	ed_lock(&shared_lock);
+	if(interning && ((found = find_text(text, length, hash, 0)) != NULL)) {
+		out = use_text(found, length);
+		ed_unlock(&shared_lock);
+		return out;
+	}
+
+	if(((out = pool_alloc(length + 1)) == NULL) && ((out = malloc(length + 1)) == NULL)) {
+		ed_unlock(&shared_lock);
+		return NULL;
+	}
+	memcpy(out, text, length);
+	out[length] = '\0';
+
+	if(interning) add_text(out, hash);
+	ed_unlock(&shared_lock);
+
+	return out;
+}
+
+/* How many lines are interned, how many different texts they have, and
+   how many bytes of text they'd take up on their own on top of that. */
+void edln_stats(size_t *n_lines, size_t *n_texts, size_t *bytes_saved) {
+	ed_lock(&shared_lock);
+	if(n_lines != NULL) *n_lines = texts.n_refs;
+	if(n_texts != NULL) *n_texts = texts.n_used;
+	if(bytes_saved != NULL) *bytes_saved = texts.bytes_saved;
+	ed_unlock(&shared_lock);
+}
+
+/**/
+
+/* Once there's more dead text in the pool than live, the lines that are
+   left in blocks that are mostly dead are moved to the current one, and
+   those blocks are freed. Lines that are in more than one place stay put,
+   and so do lines of other tables. Nothing else may be looking at the
+   table's lines while this runs. */
+int edln_compact(dynarr_t *lines) {
+	edln_block_t *block;
+	char **line, *moved;
+	size_t n_lines, n_moving = 0, size, length, i;
+	int status = RET_OK;
+
+	ed_lock(&shared_lock);
+	if((pool.dead < pool.compact_at) || (pool.dead < pool.used - pool.dead)) {
+		ed_unlock(&shared_lock);
+		return RET_NO;
+	}
+
+	for(i = 0; i < pool.n_blocks; i++) {
+		block = pool.blocks[i];
+		block->moving = (block != pool.current) && (block->dead * 2 > block->used);
+		if(block->moving) n_moving++;
+	}
+
+	n_lines = n_moving > 0 ? dynarr_get_size(lines) : 0;
+	for(i = 0; i < n_lines; i++) {
+		line = dynarr_get_element(lines, i);
+		if(((block = find_block(*line)) == NULL) || !block->moving) continue;
+		if((find(*line) != NULL) || (find_interned(*line, &length) != NULL)) continue;
+
+		size = strlen(*line) + 1;
+		if((moved = pool_alloc(size)) == NULL) {
+			status = RET_ERR_MALLOC;
+			break;
+		}
+		memcpy(moved, *line, size);
+
+		block->dead += size;
+		pool.dead += size;
+		*line = moved;
+	}
+
+	for(i = pool.n_blocks; i > 0; i--) {
+		block = pool.blocks[i - 1];
+		if(block->moving && (block->dead == block->used)) free_block(block);
+		else block->moving = 0;
+	}
+
+	/* If the lines that are left belong to someone else, this would
+	   otherwise be tried again after every command. */
+	pool.compact_at = pool.dead + COMPACT_MIN;
+	ed_unlock(&shared_lock);
+
+	return status;
+}
+
+/* Out of core, reading lines brings their pages back in without the
+   queue knowing. Every second or so, the pages of the blocks that aren't
+   in it are dropped again. */
+void edln_trim(void) {
+	time_t now;
+	size_t i;
+
+	if(pool.fd < 0) return;
+
+	ed_lock(&shared_lock);
+	now = time(NULL);
+	if(now != pool.trimmed_at) {
+		for(i = 0; i < pool.n_blocks; i++) {
+			if(!pool.blocks[i]->resident)
+				drop_pages(pool.blocks[i]->text);
+		}
+		pool.trimmed_at = now;
+	}
+	ed_unlock(&shared_lock);
+}
+
+/* Out of core: the text of the lines goes to a scratch file in $TMPDIR,
+   or next to the given file if that isn't set (in the current directory
+   without one), and about budget bytes of it are kept in memory. /tmp is
+   often a tmpfs, which would keep all of it in memory after all. This
+   has to be set up before there are any lines. */
+int edln_out_of_core(const size_t budget, const char *near) {
+#ifdef EDLN_SCRATCH
+	const char *dir, *slash;
+	char *path;
+	size_t size, dir_length;
+#ifdef EDLN_TMPFS_MAGIC
+	struct statfs fs;
+#endif
+
+	if((pool.n_blocks > 0) || (pool.fd >= 0)) return RET_ERR_INVALID;
+
+	if(((dir = getenv("TMPDIR")) != NULL) && (*dir != '\0')) {
+		dir_length = strlen(dir);
+	} else if((near != NULL) && ((slash = strrchr(near, '/')) != NULL)) {
+		dir = near;
+		dir_length = slash > near ? (size_t)(slash - near) : 1;
+	} else {
+		dir = ".";
+		dir_length = 1;
+	}
+
+	size = dir_length + sizeof("/edison-XXXXXX");
+	if((path = malloc(size)) == NULL) return RET_ERR_MALLOC;
+	snprintf(path, size, "%.*s/edison-XXXXXX", (int)dir_length, dir);
+
+	/* Nobody else needs to see it, and it's gone once the editor is. */
+	pool.fd = mkstemp(path);
+	if(pool.fd >= 0) unlink(path);
+	free(path);
+	if(pool.fd < 0) return RET_ERR_OPEN;
+
+#ifdef EDLN_TMPFS_MAGIC
+	if((fstatfs(pool.fd, &fs) == 0) && (fs.f_type == EDLN_TMPFS_MAGIC))
+		print_message("Warning! The scratch file is on a tmpfs, which keeps it in memory.");
+#endif
+
+	pool.budget = budget > 2 * POOL_BLOCK ? budget : 2 * POOL_BLOCK;
+	return RET_OK;
+#else
+	(void)budget;
+	(void)near;
+	return RET_ERR_INVALID;
+#endif
+}
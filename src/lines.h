@@ -0,0 +1,39 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef LINES_H_
+#define LINES_H_
+
+#include <stddef.h>
+
+#include "dynarr.h"
+
+/* The text of a line is never changed in place; an edit always puts a
+   new string into the table. So a line that's copied can simply be in
+   the table more than once, and it's only freed when the last place
+   that has it lets go of it. Lines that are only in one place are plain
+   malloc()ed strings and cost nothing extra, or else they're in a pool
+   of text with the lines that were read along with them. */
+
+char *edln_new(const char *text, const size_t length);
+char *edln_share(char *line);
+void edln_free(char *line);
+void edln_free_element(void *element);
+
+/* With interning on, new lines (loaded, typed in or the result of a
+   replace) with the same text all become the same line. */
+void edln_set_interning(const int on);
+char *edln_intern(char *line);
+void edln_stats(size_t *n_lines, size_t *n_texts, size_t *bytes_saved);
+
+int edln_compact(dynarr_t *lines);
+
+/* Keeps the text of the lines in a scratch file, and only about budget
+   bytes of it in memory. The file goes to $TMPDIR, or next to near.
+   Not on Windows. */
+int edln_out_of_core(const size_t budget, const char *near);
+void edln_trim(void);
+
+#endif
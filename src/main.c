@@ -14,9 +14,14 @@
 #include "appinfo.h"
 #include "ermac.h"
 #include "getopt.h"
+#include "index.h"
 #include "lexer.h"
+#include "lines.h"
 #include "parser.h"
 #include "repl.h"
+#include "script.h"
+#include "server.h"
+#include "tasks.h"
 #include "util.h"
 
 #ifdef AFL_BUILD
@@ -30,13 +35,35 @@ static void print_version(void) {
 	printf("(Version 2.0 of the license only.)\n");
 }
 
+/* How much interning saved, as of the end of the session. */
+static void print_interning(void) {
+	size_t n_lines, n_texts, bytes_saved;
+
+	edln_stats(&n_lines, &n_texts, &bytes_saved);
+	fprintf(stderr, "%s: %zu line%s, %zu different, %.1f%% deduplicated, %zu bytes saved.\n", APP_NAME,
+		n_lines, n_lines == 1 ? "" : "s", n_texts,
+		n_lines > 0 ? 100.0 * (n_lines - n_texts) / n_lines : 0.0, bytes_saved);
+}
+
 static void usage(const char *argv) {
-	printf("USAGE: %s [drive:][path]filename [-b] [-c] [-p]\n", argv);
+	printf("USAGE: %s [-b] [-c] [-i] [-j threads] [-m MiB] [-p] [-q] [-s script [-k cachedir] [-O] | -S socket] [-x] [drive:][path]filename\n", argv);
+	printf("       %s -f -s script [-k cachedir] [-O] < input > output\n", argv);
+	printf("       %s -s script [-j threads] [-k cachedir] [-O] filename filename...\n", argv);
 	printf("\t-b\tIgnore End-of-file (CTRL-Z/CTRL-D) characters.\n");
 	printf("\t-c\tChange the cursor. Default: \"%s\".\n", DEFAULT_PROMPT);
+	printf("\t-f\tFilter: run the script on stdin and write the result to stdout.\n");
 	printf("\t-h\tPrint this help.\n");
+	printf("\t-i\tKeep lines with the same text only once.\n");
+	printf("\t-j\tUse this many threads. Default: one per CPU.\n");
+	printf("\t-k\tKeep compiled scripts in this directory.\n");
+	printf("\t-m\tKeep only about this much text in memory, the rest in a scratch file.\n");
+	printf("\t-O\tMerge script commands that can run together.\n");
 	printf("\t-p\tChange the prompt. Default: \"%s\".\n", DEFAULT_CURSOR);
+	printf("\t-q\tQuiet: no prompts, no echo, yes to every question.\n");
+	printf("\t-s\tRun the commands in this script instead of reading them, on every file given.\n");
+	printf("\t-S\tServe the file to edison-client on this socket.\n");
 	printf("\t-v\tPrint version and licensing information.\n");
+	printf("\t-x\tKeep a line index next to big files, to open them faster.\n");
 }
 
 int main(int argc, char **argv) {
@@ -44,15 +71,18 @@ int main(int argc, char **argv) {
 	char *prompt = NULL;
 	char *filename = NULL;
 	char *cursor = NULL;
+	char *script_name = NULL, *cache_dir = NULL, *socket_path = NULL;
+	edsc_script_t *script = NULL;
 	ed_doc_t *document;
 	FILE *fp;
-	int no_write = 0;
+	int no_write = 0, optimize = 0, quiet = 0, n_threads = 0, intern = 0, filter = 0, batch = 0;
+	size_t budget = 0;
 #ifdef AFL_BUILD
 	char *input_line;
 	FILE *afl_fp;
 #endif
 
-	while((i = getopt(argc, argv, "bc:hnp:v")) != -1) {
+	while((i = getopt(argc, argv, "bc:fhij:k:m:nOp:qs:S:vx")) != -1) {
 		switch(i) {
 			case 'b':
 				ignore_eof = 1;
@@ -62,32 +92,118 @@ int main(int argc, char **argv) {
 				cursor = optarg;
 				break;
 
+			case 'f':
+				filter = 1;
+				break;
+
 			case 'h':
 				usage(argv[0]);
 				return EXIT_SUCCESS;
 
+			case 'i':
+				intern = 1;
+				break;
+
+			case 'j':
+				n_threads = atoi(optarg);
+				break;
+
+			case 'k':
+				cache_dir = optarg;
+				break;
+
+			case 'm':
+				budget = (size_t)atoi(optarg) * 1024 * 1024;
+				break;
+
 			case 'n':
 				no_write = 1;
 				break;
 
+			case 'O':
+				optimize = 1;
+				break;
+
 			case 'p':
 				prompt = optarg;
 				break;
 
+			case 'q':
+				quiet = 1;
+				break;
+
+			case 's':
+				script_name = optarg;
+				break;
+
+			case 'S':
+				socket_path = optarg;
+				break;
+
 			case 'v':
 				print_version();
 				return EXIT_SUCCESS;
 
+			case 'x':
+				edix_set_sidecars(1);
+				break;
+
 			default:
 				usage(argv[0]);
 				return EXIT_FAILURE;
 		}
 	}
 
-	if((filename = argv[optind]) == NULL) {
+	if(filter) {
+		if(script_name == NULL) {
+			fprintf(stderr, "-f needs a script (-s).\n");
+			return EXIT_FAILURE;
+		}
+		if(argv[optind] != NULL) {
+			fprintf(stderr, "With -f, the file is read from stdin.\n");
+			return EXIT_FAILURE;
+		}
+	} else if((filename = argv[optind]) == NULL) {
 		fprintf(stderr, "File name must be specified.\n");
 		return EXIT_FAILURE;
+	} else if(argc - optind > 1) {
+		if(script_name == NULL) {
+			fprintf(stderr, "More than one file needs a script (-s).\n");
+			return EXIT_FAILURE;
+		}
+		batch = 1;
+	}
+
+	edtk_init(n_threads > 0 ? n_threads : 0);
+	edln_set_interning(intern);
+	if((budget > 0) && (edln_out_of_core(budget, filename) != RET_OK)) {
+		fprintf(stderr, "Can't set up a scratch file.\n");
+		return EXIT_FAILURE;
+	}
+
+	/* Compile the script first, so a broken one doesn't touch the file. */
+	if(script_name != NULL) {
+		if((script = edsc_load(script_name, cache_dir, prompt, &i)) == NULL)
+			return EXIT_FAILURE;
+		/* Over several files, a bare W writes a different one each time. */
+		if(optimize && (edsc_optimize(script, batch ? NULL : filename, stderr) != RET_OK)) {
+			edsc_free(script);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(filter || batch) {
+		if(filter) i = edsc_filter(script, stdin, stdout, prompt, cursor);
+		else i = edsc_batch(script, (const char * const *)argv + optind, argc - optind, prompt, cursor, no_write);
+		edsc_free(script);
+		if(intern) print_interning();
+		edtk_shutdown();
+#if defined _DEBUG
+		mem_summary(stderr, RET_YES);
+#endif
+		return i == RET_OK ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
+
 #ifdef AFL_BUILD
 	printf("AFL_BUILD! Creating temp file '%s'.\n", AFL_TEMPFILE);
 	if((afl_fp = fopen(filename, "rb")) == NULL)
@@ -112,13 +228,21 @@ int main(int argc, char **argv) {
 		printf("New file\n");
 		document = empty_doc(filename);
 	} else {
-		if((document = load_doc(fp, filename, no_write)) == NULL) return EXIT_FAILURE;
-		fclose(fp);
+		/* Reading goes on in the background while the first commands run. */
+		if((document = open_doc(fp, filename, no_write)) == NULL) return EXIT_FAILURE;
 	}
 
-	repl_main(stdin, document, prompt, cursor);
+	if(script != NULL) {
+		edsc_run(script, document, prompt, cursor, quiet);
+		edsc_free(script);
+	} else if(socket_path != NULL) {
+		edsv_serve(socket_path, document, prompt, cursor, quiet);
+	} else {
+		repl_main(stdin, document, prompt, cursor, quiet);
+	}
+	if(intern) print_interning();
 	free_doc(document);
-
+	edtk_shutdown();
 
 #if defined _DEBUG
 	mem_summary(stderr, RET_YES);
@@ -9,6 +9,7 @@
 #include <string.h>
 
 #include "mem_bst.h"
+#include "thread.h"
 
 #define CANARY_SIZE	8
 
@@ -22,6 +23,9 @@ static size_t cum_allocated = 0;
 static size_t n_allocs = 0;
 static size_t n_frees = 0;
 
+/* Worker threads allocate too. */
+static ed_lock_t mem_lock = ED_LOCK_INITIALIZER;
+
 static char *filefrompath(const char *path) {
 	size_t idx;
 
@@ -38,6 +42,7 @@ void mem_free(void *ptr) {
 	mt_node_t *node;
 	mt_data_t *data;
 
+	ed_lock(&mem_lock);
 	if((node = mt_lookup_node(ptr)) != NULL) {
 		data = node->data;
 		n = data->n;
@@ -49,6 +54,7 @@ void mem_free(void *ptr) {
 		mem_allocated -= n;
 		n_frees++;
 	}
+	ed_unlock(&mem_lock);
 }
 
 void *mem_alloc(const size_t n, const char *file, const int line) {
@@ -66,6 +72,7 @@ void *mem_alloc(const size_t n, const char *file, const int line) {
 
 	memcpy((uint8_t *)new + n, mem_canary, CANARY_SIZE);
 
+	ed_lock(&mem_lock);
 	if(mt_ins(new, n, line, filefrompath(file))) {
 		mem_allocated += n;
 		cum_allocated += n;
@@ -73,6 +80,7 @@ void *mem_alloc(const size_t n, const char *file, const int line) {
 			max_allocated = mem_allocated;
 	}
 	n_allocs++;
+	ed_unlock(&mem_lock);
 	return new;
 }
 
@@ -89,12 +97,16 @@ void *mem_calloc(const size_t num, const size_t size, const char *file, const in
 void *mem_realloc(void *ptr, const size_t n, const char *file, const int line) {
 	void *new = mem_alloc(n, file, line);
 	mt_data_t *entry;
+	size_t old_n = 0;
 
-	if(ptr)
-		entry = mt_lookup(ptr);
-	else
+	if(ptr == NULL)
 		return new;
 
+	ed_lock(&mem_lock);
+	if((entry = mt_lookup(ptr)) != NULL)
+		old_n = entry->n;
+	ed_unlock(&mem_lock);
+
 	if(n == 0) {
 		mem_free(ptr);
 		return NULL;
@@ -107,7 +119,7 @@ void *mem_realloc(void *ptr, const size_t n, const char *file, const int line) {
 	}
 
 	if(new) {
-		memcpy(new, ptr, entry->n > n ? n : entry->n);
+		memcpy(new, ptr, old_n > n ? n : old_n);
 		mem_free(ptr);
 		return new;
 	}
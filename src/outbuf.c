@@ -0,0 +1,126 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+
+#include "ermac.h"
+#include "outbuf.h"
+
+#define DEFAULT_OUTBUF_SIZE	65536
+#define MAX_DIGITS			20
+
+/* Collects output in one big block and hands it to stdio
+   in a single call, instead of one printf per item. */
+struct outbuf_t {
+	FILE *fp;
+	char *data;
+	size_t used, size;
+};
+
+int outbuf_flush(outbuf_t *ob) {
+	size_t written = 0, n;
+
+	if(ob == NULL) return RET_ERR_NULLPO;
+
+	while(written < ob->used) {
+		if((n = fwrite(ob->data + written, 1, ob->used - written, ob->fp)) == 0) {
+			ob->used = 0;
+			return RET_ERR_WRITE;
+		}
+		written += n;
+	}
+
+	ob->used = 0;
+	fflush(ob->fp);
+	return RET_OK;
+}
+
+int outbuf_write(outbuf_t *ob, const char *data, const size_t len) {
+	int status;
+
+	if((ob == NULL) || (data == NULL)) return RET_ERR_NULLPO;
+
+	if(ob->used + len > ob->size)
+		if((status = outbuf_flush(ob)) != RET_OK)
+			return status;
+
+	/* Too big to bother copying. */
+	if(len > ob->size) {
+		if(fwrite(data, 1, len, ob->fp) != len)
+			return RET_ERR_WRITE;
+		return RET_OK;
+	}
+
+	memcpy(ob->data + ob->used, data, len);
+	ob->used += len;
+	return RET_OK;
+}
+
+int outbuf_puts(outbuf_t *ob, const char *str) {
+	if(str == NULL) return RET_ERR_NULLPO;
+	return outbuf_write(ob, str, strlen(str));
+}
+
+int outbuf_putc(outbuf_t *ob, const char c) {
+	int status;
+
+	if(ob == NULL) return RET_ERR_NULLPO;
+
+	if(ob->used == ob->size)
+		if((status = outbuf_flush(ob)) != RET_OK)
+			return status;
+
+	ob->data[ob->used++] = c;
+	return RET_OK;
+}
+
+/* Right aligned decimal number, padded with spaces to width. */
+int outbuf_number(outbuf_t *ob, const size_t n, const size_t width) {
+	char digits[MAX_DIGITS];
+	size_t n_digits = 0, rest = n, i;
+	int status;
+
+	do {
+		digits[MAX_DIGITS - 1 - n_digits++] = '0' + rest % 10;
+		rest /= 10;
+	} while(rest);
+
+	for(i = n_digits; i < width; i++)
+		if((status = outbuf_putc(ob, ' ')) != RET_OK)
+			return status;
+
+	return outbuf_write(ob, digits + MAX_DIGITS - n_digits, n_digits);
+}
+
+/**/
+
+outbuf_t *outbuf_new(FILE *fp, const size_t size) {
+	outbuf_t *out;
+
+	if(fp == NULL) return NULL;
+	if((out = malloc(sizeof(outbuf_t))) == NULL) return NULL;
+
+	out->size = size ? size : DEFAULT_OUTBUF_SIZE;
+	if((out->data = malloc(out->size)) == NULL) {
+		free(out);
+		return NULL;
+	}
+
+	out->fp = fp;
+	out->used = 0;
+	return out;
+}
+
+void outbuf_free(outbuf_t *ob) {
+	if(ob == NULL) return;
+
+	outbuf_flush(ob);
+	free(ob->data);
+	free(ob);
+}
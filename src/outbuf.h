@@ -0,0 +1,22 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef OUTBUF_H_
+#define OUTBUF_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+typedef struct outbuf_t outbuf_t;
+
+outbuf_t *outbuf_new(FILE *fp, const size_t size);
+void outbuf_free(outbuf_t *ob);
+int outbuf_flush(outbuf_t *ob);
+int outbuf_write(outbuf_t *ob, const char *data, const size_t len);
+int outbuf_puts(outbuf_t *ob, const char *str);
+int outbuf_putc(outbuf_t *ob, const char c);
+int outbuf_number(outbuf_t *ob, const size_t n, const size_t width);
+
+#endif
@@ -3,6 +3,7 @@
  * Copyright (C) 2022-2023  Martin Wolters *
  *******************************************/
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,17 +24,17 @@ static void print_instr(edps_instr_t *instr) {
 		case EDPS_CMD_NONE:
 			printf("\tCmd: none. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d\n", instr->only_line);
+				printf("Line: %lld\n", (long long)instr->only_line);
 			else
-				printf("Line: %d\n", instr->end_line);
+				printf("Line: %lld\n", (long long)instr->end_line);
 			break;
 	
 		case EDPS_CMD_APPEND:
 			printf("\tCmd: Append. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d\n", instr->only_line);
+				printf("Line: %lld\n", (long long)instr->only_line);
 			else
-				printf("Line: %d\n", instr->end_line);
+				printf("Line: %lld\n", (long long)instr->end_line);
 			break;
 
 		case EDPS_CMD_ASK:
@@ -43,20 +44,20 @@ static void print_instr(edps_instr_t *instr) {
 		case EDPS_CMD_COPY:
 			printf("\tCmd: Copy. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d. ", instr->only_line);
+				printf("Line: %lld. ", (long long)instr->only_line);
 			else
-				printf("Lines: %d to %d. ", instr->start_line, instr->end_line);
+				printf("Lines: %lld to %lld. ", (long long)instr->start_line, (long long)instr->end_line);
 
-			printf("Target: %d. ", instr->target_line);
+			printf("Target: %lld. ", (long long)instr->target_line);
 			printf("Repeat: %d.\n", instr->repeat);
 			break;
 
 		case EDPS_CMD_DELETE:
 			printf("\tCmd: Delete. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d.\n", instr->only_line);
+				printf("Line: %lld.\n", (long long)instr->only_line);
 			else
-				printf("Line: %d to %d.\n", instr->start_line, instr->end_line);
+				printf("Line: %lld to %lld.\n", (long long)instr->start_line, (long long)instr->end_line);
 			break;
 
 		case EDPS_CMD_END:
@@ -66,34 +67,34 @@ static void print_instr(edps_instr_t *instr) {
 		case EDPS_CMD_INSERT:
 			printf("\tCmd: Insert. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d.\n", instr->only_line);
+				printf("Line: %lld.\n", (long long)instr->only_line);
 			else
-				printf("Line: %d\n", instr->end_line);
+				printf("Line: %lld\n", (long long)instr->end_line);
 			break;
 
 		case EDPS_CMD_LIST:
 			printf("\tCmd: List. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d.\n", instr->only_line);
+				printf("Line: %lld.\n", (long long)instr->only_line);
 			else
-				printf("Line: %d to %d.\n", instr->start_line, instr->end_line);
+				printf("Line: %lld to %lld.\n", (long long)instr->start_line, (long long)instr->end_line);
 			break;
 
 		case EDPS_CMD_MOVE:
 			printf("\tCmd: Move. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d. ", instr->only_line);
+				printf("Line: %lld. ", (long long)instr->only_line);
 			else
-				printf("Line: %d to %d. ", instr->start_line, instr->end_line);
-			printf("Target: %d.\n", instr->target_line);
+				printf("Line: %lld to %lld. ", (long long)instr->start_line, (long long)instr->end_line);
+			printf("Target: %lld.\n", (long long)instr->target_line);
 			break;
 
 		case EDPS_CMD_PAGE:
 			printf("\tCmd: Page. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d.\n", instr->only_line);
+				printf("Line: %lld.\n", (long long)instr->only_line);
 			else
-				printf("Line: %d to %d.\n", instr->start_line, instr->end_line);
+				printf("Line: %lld to %lld.\n", (long long)instr->start_line, (long long)instr->end_line);
 			break;
 
 		case EDPS_CMD_QUIT:
@@ -101,30 +102,60 @@ static void print_instr(edps_instr_t *instr) {
 			break;
 
 		case EDPS_CMD_REPLACE:
-			printf("\tCmd: Replace%s. ",
-				instr->ask ? " (Interactive)" : "");
+			printf("\tCmd: Replace%s%s. ",
+				instr->ask ? " (Interactive)" : "",
+				instr->nocase ? " (Ignore case)" : "");
 			printf("Search: '%s'. ", instr->search_str);
 			printf("Replace: '%s'. ", instr->replace_str);
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d.\n", instr->only_line);
+				printf("Line: %lld.\n", (long long)instr->only_line);
 			else
-				printf("Line: %d to %d.\n", instr->start_line, instr->end_line);
+				printf("Line: %lld to %lld.\n", (long long)instr->start_line, (long long)instr->end_line);
 			break;
 
 		case EDPS_CMD_SEARCH:
-			printf("\tCommand: Search%s. ",
-				instr->ask ? " (Interactive)" : "");
+			printf("\tCommand: Search%s%s. ",
+				instr->ask ? " (Interactive)" : "",
+				instr->nocase ? " (Ignore case)" : "");
 			printf("Search: '%s'. ", instr->search_str);
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d.\n", instr->only_line);
+				printf("Line: %lld.\n", (long long)instr->only_line);
 			else
-				printf("Line: %d to %d.\n", instr->start_line, instr->end_line);
+				printf("Line: %lld to %lld.\n", (long long)instr->start_line, (long long)instr->end_line);
+			break;
+
+		case EDPS_CMD_COUNT:
+		case EDPS_CMD_FIND:
+			printf("\tCommand: %s. ",
+				instr->command == EDPS_CMD_COUNT ? "Count" : "Find");
+			printf("Search: '%s'. ", instr->search_str);
+			if(instr->only_line != EDPS_NO_LINE)
+				printf("Line: %lld.\n", (long long)instr->only_line);
+			else
+				printf("Line: %lld to %lld.\n", (long long)instr->start_line, (long long)instr->end_line);
+			break;
+
+		case EDPS_CMD_GLOBAL:
+			printf("\tCommand: Global%s. ",
+				instr->nocase ? " (Ignore case)" : "");
+			printf("Pattern: '%s'. ", instr->global_str);
+			switch(instr->global_cmd) {
+				case EDPS_CMD_COPY:		printf("Then: Copy to %lld, %u times. ", (long long)instr->target_line, instr->repeat); break;
+				case EDPS_CMD_DELETE:	printf("Then: Delete. "); break;
+				case EDPS_CMD_MOVE:		printf("Then: Move to %lld. ", (long long)instr->target_line); break;
+				case EDPS_CMD_REPLACE:	printf("Then: Replace '%s' with '%s'. ", instr->search_str, instr->replace_str); break;
+				default:				printf("Then: ?. ");
+			}
+			if(instr->only_line != EDPS_NO_LINE)
+				printf("Line: %lld.\n", (long long)instr->only_line);
+			else
+				printf("Line: %lld to %lld.\n", (long long)instr->start_line, (long long)instr->end_line);
 			break;
 
 		case EDPS_CMD_TRANSFER:
 			printf("\tCommand: Transfer. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d. ", instr->only_line);
+				printf("Line: %lld. ", (long long)instr->only_line);
 			if(instr->filename != NULL)
 				printf("File: %s.", instr->filename);
 			printf("\n");
@@ -133,41 +164,32 @@ static void print_instr(edps_instr_t *instr) {
 		case EDPS_CMD_WRITE:
 			printf("\tCommand: Write. ");
 			if(instr->only_line != EDPS_NO_LINE)
-				printf("Line: %d.\n", instr->only_line);
+				printf("Line: %lld.\n", (long long)instr->only_line);
 			else
-				printf("Line: %d\n", instr->end_line);
+				printf("Line: %lld\n", (long long)instr->end_line);
 			break;
 	}
 }
 
 static void edps_instr_free(edps_instr_t *instr) {
-	if(instr == NULL) return;
-
-	if(instr->filename != NULL) free(instr->filename);
-	if(instr->search_str != NULL) free(instr->search_str);
-	if(instr->replace_str != NULL) free(instr->replace_str);
-
 	free(instr);
 }
 
+/* The strings belong to the parser context, so nothing is freed here. */
 static void instr_reset(edps_instr_t *instr) {
-	if(instr->search_str != NULL)
-		free(instr->search_str);
-	if(instr->replace_str != NULL)
-		free(instr->replace_str);
-	if(instr->filename != NULL)
-		free(instr->filename);
-
 	instr->start_line = EDPS_NO_LINE;
 	instr->end_line = EDPS_NO_LINE;
 	instr->only_line = EDPS_NO_LINE;
 	instr->target_line = EDPS_NO_LINE;
 	instr->command = EDPS_CMD_NONE;
+	instr->global_cmd = EDPS_CMD_NONE;
 	instr->ask = 0;
+	instr->nocase = 0;
 	instr->repeat = 1;
 	instr->search_str = NULL;
 	instr->replace_str = NULL;
 	instr->filename = NULL;
+	instr->global_str = NULL;
 }
 
 static edps_instr_t *instr_new(void) {
@@ -175,21 +197,28 @@ static edps_instr_t *instr_new(void) {
 
 	if((instr = malloc(sizeof(edps_instr_t))) == NULL) {
 		fprintf(stderr, "%s: Failed to set up an instruction context.\n", APP_NAME);
+		return NULL;
 	}
 
-	instr->search_str = NULL;
-	instr->replace_str = NULL;
-	instr->filename = NULL;
-
 	instr_reset(instr);
 	return instr;
 }
 
 /**/
 
-static int ps_set_start_range(edps_instr_t *instr, const int line) {
+/* Only for lexemes is_good_integer() let through. */
+static edps_line_t parse_line(const char *lexeme) {
+	edps_line_t out = 0;
+
+	for(; *lexeme != '\0'; lexeme++)
+		out = 10 * out + (*lexeme - '0');
+
+	return out;
+}
+
+static int ps_set_start_range(edps_instr_t *instr, const edps_line_t line) {
 #ifdef DEBUG_VERBOSE
-	printf("PARSER: ps_set_start_range(%d)\n", line);
+	printf("PARSER: ps_set_start_range(%lld)\n", (long long)line);
 #endif
 
 	if(line == 0) return RET_ERR_SYNTAX;
@@ -202,9 +231,9 @@ static int ps_set_start_range(edps_instr_t *instr, const int line) {
 	return RET_OK;
 }
 
-static int ps_set_end_range(edps_instr_t *instr, const int line) {
+static int ps_set_end_range(edps_instr_t *instr, const edps_line_t line) {
 #ifdef DEBUG_VERBOSE
-	printf("PARSER: ps_set_end_range(%d)\n", line);
+	printf("PARSER: ps_set_end_range(%lld)\n", (long long)line);
 #endif
 
 	if(line == 0) return RET_ERR_SYNTAX;
@@ -217,9 +246,9 @@ static int ps_set_end_range(edps_instr_t *instr, const int line) {
 	return RET_OK;
 }
 
-static int ps_set_only_line(edps_instr_t *instr, const int line) {
+static int ps_set_only_line(edps_instr_t *instr, const edps_line_t line) {
 #ifdef DEBUG_VERBOSE
-	printf("PARSER: ps_set_only_line(%d)\n", line);
+	printf("PARSER: ps_set_only_line(%lld)\n", (long long)line);
 #endif
 
 	if(line == 0) return RET_ERR_SYNTAX;
@@ -234,9 +263,9 @@ static int ps_set_only_line(edps_instr_t *instr, const int line) {
 	return RET_OK;
 }
 
-static int ps_set_target(edps_instr_t *instr, const int line) {
+static int ps_set_target(edps_instr_t *instr, const edps_line_t line) {
 #ifdef DEBUG_VERBOSE
-	printf("PARSER: ps_set_target(%d)\n", line);
+	printf("PARSER: ps_set_target(%lld)\n", (long long)line);
 #endif
 
 	if(line == 0) return RET_ERR_SYNTAX;
@@ -249,18 +278,19 @@ static int ps_set_target(edps_instr_t *instr, const int line) {
 	return RET_OK;
 }
 
-static int ps_set_repeat(edps_instr_t *instr, const int n) {
+static int ps_set_repeat(edps_instr_t *instr, const edps_line_t n) {
 #ifdef DEBUG_VERBOSE
-	printf("PARSER: ps_set_repeat(%d)\n", n);
+	printf("PARSER: ps_set_repeat(%lld)\n", (long long)n);
 #endif
 
 	if(n == 0) return RET_ERR_SYNTAX;
+	if(n > UINT32_MAX) return RET_ERR_OVERFLOW;
 
 	if(instr->repeat != 1) {
 		fprintf(stderr, "Parser: Encountered multiple repetitions.\n");
 		return print_error(RET_ERR_PARSER);
 	}
-	instr->repeat = n;
+	instr->repeat = (uint32_t)n;
 	return RET_OK;
 }
 
@@ -290,7 +320,34 @@ static int ps_set_ask(edps_instr_t *instr) {
 	return RET_OK;
 }
 
-static int ps_set_search(edps_instr_t *instr, const char *search_str) {
+static int ps_set_nocase(edps_instr_t *instr) {
+#ifdef DEBUG_VERBOSE
+	printf("PARSER: ps_set_nocase()\n");
+#endif
+
+	if(instr->nocase != 0) {
+		fprintf(stderr, "Parser: Encountered multiple case modifiers.\n");
+		return print_error(RET_ERR_PARSER);
+	}
+	instr->nocase = 1;
+	return RET_OK;
+}
+
+static char *ps_keep(edps_ctx_t *ctx, const char *str) {
+	size_t size = strlen(str) + 1;
+	char *out;
+
+	if(ctx->strings_used + size > ctx->strings_alloced) return NULL;
+
+	out = ctx->strings + ctx->strings_used;
+	memcpy(out, str, size);
+	ctx->strings_used += size;
+	return out;
+}
+
+static int ps_set_search(edps_ctx_t *ctx, const char *search_str) {
+	edps_instr_t *instr = ctx->instr;
+
 #ifdef DEBUG_VERBOSE
 	printf("PARSER: ps_set_search(\"%s\")\n", search_str);
 #endif
@@ -301,7 +358,7 @@ static int ps_set_search(edps_instr_t *instr, const char *search_str) {
 	}
 
 	if(search_str != NULL) {
-		if((instr->search_str = str_alloc_copy(search_str)) == NULL) {
+		if((instr->search_str = ps_keep(ctx, search_str)) == NULL) {
 			fprintf(stderr, "Parser: Couldn't save the search string.\n");
 			return print_error(RET_ERR_MALLOC);
 		}
@@ -311,7 +368,9 @@ static int ps_set_search(edps_instr_t *instr, const char *search_str) {
 	return RET_OK;
 }
 
-static int ps_set_replace(edps_instr_t *instr, const char *replace_str) {
+static int ps_set_replace(edps_ctx_t *ctx, const char *replace_str) {
+	edps_instr_t *instr = ctx->instr;
+
 #ifdef DEBUG_VERBOSE
 	printf("PARSER: ps_set_replace(\"%s\")\n", replace_str);
 #endif
@@ -322,7 +381,7 @@ static int ps_set_replace(edps_instr_t *instr, const char *replace_str) {
 	}
 
 	if(replace_str != NULL) {
-		if((instr->replace_str = str_alloc_copy(replace_str)) == NULL) {
+		if((instr->replace_str = ps_keep(ctx, replace_str)) == NULL) {
 			fprintf(stderr, "Parser: Couldn't save the replacement string.\n");
 			return print_error(RET_ERR_MALLOC);
 		}
@@ -332,7 +391,28 @@ static int ps_set_replace(edps_instr_t *instr, const char *replace_str) {
 	return RET_OK;
 }
 
-static int ps_set_filename(edps_instr_t *instr, const char *filename_str) {
+static int ps_set_global(edps_ctx_t *ctx, const char *global_str) {
+	edps_instr_t *instr = ctx->instr;
+
+#ifdef DEBUG_VERBOSE
+	printf("PARSER: ps_set_global(\"%s\")\n", global_str);
+#endif
+
+	if(instr->global_str != NULL) {
+		fprintf(stderr, "Parser: Encountered multiple global patterns.\n");
+		return print_error(RET_ERR_PARSER);
+	}
+
+	if((instr->global_str = ps_keep(ctx, global_str)) == NULL) {
+		fprintf(stderr, "Parser: Couldn't save the global pattern.\n");
+		return print_error(RET_ERR_MALLOC);
+	}
+	return RET_OK;
+}
+
+static int ps_set_filename(edps_ctx_t *ctx, const char *filename_str) {
+	edps_instr_t *instr = ctx->instr;
+
 #ifdef DEBUG_VERBOSE
 	printf("PARSER: ps_set_filename(\"%s\")\n", filename_str);
 #endif
@@ -343,7 +423,7 @@ static int ps_set_filename(edps_instr_t *instr, const char *filename_str) {
 	}
 
 	if(filename_str != NULL) {
-		if((instr->filename = str_alloc_copy(filename_str)) == NULL) {
+		if((instr->filename = ps_keep(ctx, filename_str)) == NULL) {
 			fprintf(stderr, "Parser: Couldn't save the input filename.\n");
 			return print_error(RET_ERR_MALLOC);
 		}
@@ -421,6 +501,8 @@ static int ps_after_range(edps_ctx_t *ctx) {
 
 		case EDLX_TOKEN_KW_ASK_SEARCH:
 		case EDLX_TOKEN_KW_SEARCH:
+		case EDLX_TOKEN_KW_COUNT:
+		case EDLX_TOKEN_KW_FIND:
 			edlx_rewind(ctx->edlx_ctx);
 			status = ps_search(ctx);
 			break;
@@ -431,6 +513,16 @@ static int ps_after_range(edps_ctx_t *ctx) {
 			status = ps_replace(ctx);
 			break;
 
+		case EDLX_TOKEN_KW_NOCASE:
+			edlx_rewind(ctx->edlx_ctx);
+			status = ps_nocase(ctx);
+			break;
+
+		case EDLX_TOKEN_KW_GLOBAL:
+			edlx_rewind(ctx->edlx_ctx);
+			status = ps_global(ctx);
+			break;
+
 		default:
 			status = RET_ERR_SYNTAX;
 	}
@@ -451,6 +543,55 @@ static int ps_copy(edps_ctx_t *ctx) {
 	return ps_set_command(ctx->instr, EDPS_CMD_COPY);
 }
 
+static int ps_global(edps_ctx_t *ctx) {
+	edlx_token_t token;
+	char *lexeme;
+	int status;
+
+#ifdef DEBUG_VERBOSE
+	printf("PARSER: ps_global()\n");
+#endif
+
+	if((status = edlx_get_required_token(ctx->edlx_ctx, EDLX_TOKEN_KW_GLOBAL)) != RET_OK)
+		return status;
+	if((status = edlx_get_required_token(ctx->edlx_ctx, EDLX_TOKEN_STRING)) != RET_OK)
+		return RET_ERR_SYNTAX;
+	lexeme = edlx_get_lexeme(ctx->edlx_ctx);
+	if((status = ps_set_global(ctx, lexeme)) != RET_OK)
+		return status;
+
+	if((status = edlx_step(ctx->edlx_ctx)) != RET_OK)
+		return status;
+	token = edlx_get_token(ctx->edlx_ctx, &status);
+	if(status != RET_OK) return status;
+
+	/* The command to apply is parsed as if it stood on its own and
+	   then moved into the global slot. */
+	switch(token) {
+		case EDLX_TOKEN_KW_DELETE:
+			status = ps_set_command(ctx->instr, EDPS_CMD_DELETE);
+			break;
+
+		case EDLX_TOKEN_KW_REPLACE:
+			edlx_rewind(ctx->edlx_ctx);
+			status = ps_replace(ctx);
+			break;
+
+		case EDLX_TOKEN_DELIM_COMMA:
+			status = ps_target(ctx);
+			break;
+
+		default:
+			status = RET_ERR_SYNTAX;
+	}
+
+	if(status != RET_OK) return status;
+
+	ctx->instr->global_cmd = ctx->instr->command;
+	ctx->instr->command = EDPS_CMD_GLOBAL;
+	return RET_OK;
+}
+
 static int ps_move(edps_ctx_t *ctx) {
 	int status;
 
@@ -464,6 +605,51 @@ static int ps_move(edps_ctx_t *ctx) {
 	return ps_set_command(ctx->instr, EDPS_CMD_MOVE);
 }
 
+static int ps_nocase(edps_ctx_t *ctx) {
+	edlx_token_t token;
+	int status;
+
+#ifdef DEBUG_VERBOSE
+	printf("PARSER: ps_nocase()\n");
+#endif
+
+	if((status = edlx_get_required_token(ctx->edlx_ctx, EDLX_TOKEN_KW_NOCASE)) != RET_OK)
+		return status;
+	if((status = ps_set_nocase(ctx->instr)) != RET_OK)
+		return status;
+
+	if((status = edlx_step(ctx->edlx_ctx)) != RET_OK)
+		return status;
+	token = edlx_get_token(ctx->edlx_ctx, &status);
+	if(status != RET_OK) return status;
+
+	switch(token) {
+		case EDLX_TOKEN_KW_ASK_SEARCH:
+		case EDLX_TOKEN_KW_SEARCH:
+		case EDLX_TOKEN_KW_COUNT:
+		case EDLX_TOKEN_KW_FIND:
+			edlx_rewind(ctx->edlx_ctx);
+			status = ps_search(ctx);
+			break;
+
+		case EDLX_TOKEN_KW_ASK_REPLACE:
+		case EDLX_TOKEN_KW_REPLACE:
+			edlx_rewind(ctx->edlx_ctx);
+			status = ps_replace(ctx);
+			break;
+
+		case EDLX_TOKEN_KW_GLOBAL:
+			edlx_rewind(ctx->edlx_ctx);
+			status = ps_global(ctx);
+			break;
+
+		default:
+			status = RET_ERR_SYNTAX;
+	}
+
+	return status;
+}
+
 static int ps_range_end(edps_ctx_t *ctx) {
 	edlx_token_t token;
 	char *lexeme;
@@ -494,13 +680,17 @@ static int ps_range_end(edps_ctx_t *ctx) {
 				status = RET_ERR_OVERFLOW;
 				break;
 			}
-			status = ps_set_end_range(ctx->instr, atoi(lexeme));
+			status = ps_set_end_range(ctx->instr, parse_line(lexeme));
 			break;
 
 		case EDLX_TOKEN_KW_COPY:
+		case EDLX_TOKEN_KW_COUNT:
 		case EDLX_TOKEN_KW_DELETE:
+		case EDLX_TOKEN_KW_FIND:
+		case EDLX_TOKEN_KW_GLOBAL:
 		case EDLX_TOKEN_KW_LIST:
 		case EDLX_TOKEN_KW_MOVE:
+		case EDLX_TOKEN_KW_NOCASE:
 		case EDLX_TOKEN_KW_PAGE:
 		case EDLX_TOKEN_KW_REPLACE:
 		case EDLX_TOKEN_KW_SEARCH:
@@ -559,9 +749,9 @@ static int ps_range_start(edps_ctx_t *ctx) {
 				break;
 			}
 			if(end_of_range == 0)
-				status = ps_set_start_range(ctx->instr, atoi(lexeme));
+				status = ps_set_start_range(ctx->instr, parse_line(lexeme));
 			else
-				status = ps_set_only_line(ctx->instr, atoi(lexeme));
+				status = ps_set_only_line(ctx->instr, parse_line(lexeme));
 			break;
 
 		default:
@@ -591,7 +781,7 @@ static int ps_repeat(edps_ctx_t *ctx) {
 	if(is_good_integer(lexeme) == RET_NO)
 		return RET_ERR_OVERFLOW;
 
-	if((status = ps_set_repeat(ctx->instr, atoi(lexeme))) != RET_OK)
+	if((status = ps_set_repeat(ctx->instr, parse_line(lexeme))) != RET_OK)
 		return status;
 
 	return ps_copy(ctx);
@@ -633,14 +823,14 @@ static int ps_replace(edps_ctx_t *ctx) {
 	switch(token) {
 		/* If the search string is omitted, make it the empty string */
 		case EDLX_TOKEN_DELIM_COMMA:
-			if((status = ps_set_search(ctx->instr, "")) != RET_OK)
+			if((status = ps_set_search(ctx, "")) != RET_OK)
 				return status;
 			edlx_rewind(ctx->edlx_ctx);
 			break;
 
 		case EDLX_TOKEN_STRING:
 			lexeme = edlx_get_lexeme(ctx->edlx_ctx);
-			if((status = ps_set_search(ctx->instr, lexeme)) != RET_OK)
+			if((status = ps_set_search(ctx, lexeme)) != RET_OK)
 				return status;
 			break;
 	}
@@ -656,13 +846,13 @@ static int ps_replace(edps_ctx_t *ctx) {
 	switch(token) {
 		case EDLX_TOKEN_STRING:
 			lexeme = edlx_get_lexeme(ctx->edlx_ctx);
-			status = ps_set_replace(ctx->instr, lexeme);
+			status = ps_set_replace(ctx, lexeme);
 			break;
 
 		case EDLX_TOKEN_DELIM_COMMA:
 		case EDLX_TOKEN_EOL:
 			edlx_rewind(ctx->edlx_ctx);
-			status = ps_set_replace(ctx->instr, "");
+			status = ps_set_replace(ctx, "");
 			break;
 
 		default:
@@ -674,6 +864,7 @@ static int ps_replace(edps_ctx_t *ctx) {
 
 static int ps_search(edps_ctx_t *ctx) {
 	edlx_token_t token;
+	edps_cmd_t command = EDPS_CMD_SEARCH;
 	char *lexeme, lookahead;
 	int status;
 
@@ -692,6 +883,11 @@ static int ps_search(edps_ctx_t *ctx) {
 				return status;
 
 		case EDLX_TOKEN_KW_SEARCH:
+		case EDLX_TOKEN_KW_COUNT:
+		case EDLX_TOKEN_KW_FIND:
+			if(token == EDLX_TOKEN_KW_COUNT) command = EDPS_CMD_COUNT;
+			if(token == EDLX_TOKEN_KW_FIND) command = EDPS_CMD_FIND;
+
 			if((lookahead = edlx_get_lookahead(ctx->edlx_ctx, &status)) == '\"') {
 				if((status = edlx_get_required_token(ctx->edlx_ctx, EDLX_TOKEN_STRING)) != RET_OK)
 					return RET_ERR_SYNTAX;
@@ -700,9 +896,9 @@ static int ps_search(edps_ctx_t *ctx) {
 				lexeme = NULL;
 			}
 
-			if((status = ps_set_search(ctx->instr, lexeme)) != RET_OK)
+			if((status = ps_set_search(ctx, lexeme)) != RET_OK)
 				return status;
-			if((status = ps_set_command(ctx->instr, EDPS_CMD_SEARCH)) != RET_OK)
+			if((status = ps_set_command(ctx->instr, command)) != RET_OK)
 				return status;
 			break;
 
@@ -781,10 +977,22 @@ static int ps_statement(edps_ctx_t *ctx) {
 
 		case EDLX_TOKEN_KW_ASK_SEARCH:
 		case EDLX_TOKEN_KW_SEARCH:
+		case EDLX_TOKEN_KW_COUNT:
+		case EDLX_TOKEN_KW_FIND:
 			edlx_rewind(ctx->edlx_ctx);
 			status = ps_search(ctx);
 			break;
 
+		case EDLX_TOKEN_KW_NOCASE:
+			edlx_rewind(ctx->edlx_ctx);
+			status = ps_nocase(ctx);
+			break;
+
+		case EDLX_TOKEN_KW_GLOBAL:
+			edlx_rewind(ctx->edlx_ctx);
+			status = ps_global(ctx);
+			break;
+
 		case EDLX_TOKEN_KW_APPEND:
 		case EDLX_TOKEN_KW_COPY:
 		case EDLX_TOKEN_KW_DELETE:
@@ -861,7 +1069,7 @@ static int ps_target(edps_ctx_t *ctx) {
 				status = RET_ERR_OVERFLOW;
 				break;
 			}
-			status = ps_set_target(ctx->instr, atoi(lexeme));
+			status = ps_set_target(ctx->instr, parse_line(lexeme));
 			break;
 
 		default:
@@ -908,7 +1116,7 @@ static int ps_transfer(edps_ctx_t *ctx) {
 	if((status = edlx_get_required_token(ctx->edlx_ctx, EDLX_TOKEN_STRING)) != RET_OK)
 		return status;
 	lexeme = edlx_get_lexeme(ctx->edlx_ctx);
-	return ps_set_filename(ctx->instr, lexeme);
+	return ps_set_filename(ctx, lexeme);
 }
 
 static int ps_write(edps_ctx_t *ctx) {
@@ -933,7 +1141,7 @@ static int ps_write(edps_ctx_t *ctx) {
 	switch(token) {
 		case EDLX_TOKEN_STRING:
 			lexeme = edlx_get_lexeme(ctx->edlx_ctx);
-			status = ps_set_filename(ctx->instr, lexeme);
+			status = ps_set_filename(ctx, lexeme);
 			break;
 
 		case EDLX_TOKEN_EOL:
@@ -955,9 +1163,10 @@ int edps_parse(edps_ctx_t *ctx) {
 	if(ctx == NULL) return RET_ERR_NULLPO;
 
 	instr_reset(ctx->instr);
+	ctx->strings_used = 0;
 
 	if((status = ps_statement(ctx)) != RET_OK) {
-		if(status == RET_ERR_SYNTAX)
+		if((status == RET_ERR_SYNTAX) && !ctx->silent)
 			edlx_print_error(ctx->edlx_ctx, "Syntax error.", ctx->n_subexpr, ctx->prompt);
 		return status;
 	}
@@ -982,9 +1191,41 @@ void edps_free(edps_ctx_t *ctx) {
 
 	if(ctx->edlx_ctx != NULL) edlx_ctx_free(ctx->edlx_ctx);
 	if(ctx->instr != NULL) edps_instr_free(ctx->instr);
+	free(ctx->strings);
 	free(ctx);
 }
 
+/* Sets the context up for the next command line. The buffers only grow
+   if the line is longer than any before it, so a parser that is kept
+   around for a whole session or script stops allocating quickly. */
+int edps_restart(edps_ctx_t *ctx, const char *cmdline) {
+	size_t needed, new_size;
+	char *new_strings;
+	int status;
+
+	if((ctx == NULL) || (cmdline == NULL)) return RET_ERR_NULLPO;
+
+	if((status = edlx_ctx_restart(ctx->edlx_ctx, cmdline)) != RET_OK)
+		return status;
+
+	needed = 4 * (strlen(cmdline) + 1);
+	if(needed > ctx->strings_alloced) {
+		new_size = ctx->strings_alloced > 0 ? ctx->strings_alloced : 256;
+		while(new_size < needed)
+			new_size *= 2;
+
+		if((new_strings = realloc(ctx->strings, new_size)) == NULL)
+			return RET_ERR_MALLOC;
+		ctx->strings = new_strings;
+		ctx->strings_alloced = new_size;
+	}
+
+	instr_reset(ctx->instr);
+	ctx->strings_used = 0;
+	ctx->n_subexpr = 0;
+	return RET_OK;
+}
+
 edps_ctx_t *edps_new(const char *cmdline, const char *prompt, int *status) {
 	edps_ctx_t *ctx;
 
@@ -995,6 +1236,10 @@ edps_ctx_t *edps_new(const char *cmdline, const char *prompt, int *status) {
 		fprintf(stderr, "%s: Failed to set up a parser context.\n", APP_NAME);
 		return NULL;
 	}
+	ctx->strings = NULL;
+	ctx->strings_alloced = 0;
+	ctx->prompt = prompt;
+	ctx->silent = 0;
 
 	if((ctx->edlx_ctx = edlx_ctx_new(cmdline, status)) == NULL) {
 		fprintf(stderr, "%s: Failed to set up a lexer context.\n", APP_NAME);
@@ -1008,13 +1253,19 @@ edps_ctx_t *edps_new(const char *cmdline, const char *prompt, int *status) {
 		return NULL;
 	}
 
-	ctx->prompt = prompt;
+	if((*status = edps_restart(ctx, cmdline)) != RET_OK) {
+		edps_free(ctx);
+		return NULL;
+	}
 
-	ctx->n_subexpr = 0;
-	*status = RET_OK;
 	return ctx;
 }
 
+/* Syntax errors are only returned, not shown. */
+void edps_set_silent(edps_ctx_t *ctx, const int silent) {
+	ctx->silent = silent;
+}
+
 edps_instr_t *edps_get_instr(edps_ctx_t *ctx) {
 	return ctx->instr;
 }
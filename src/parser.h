@@ -15,9 +15,12 @@ typedef enum edps_cmd_t {
 	EDPS_CMD_APPEND,
 	EDPS_CMD_ASK,
 	EDPS_CMD_COPY,
+	EDPS_CMD_COUNT,
 	EDPS_CMD_DELETE,
 	EDPS_CMD_EDIT,
 	EDPS_CMD_END,
+	EDPS_CMD_FIND,
+	EDPS_CMD_GLOBAL,
 	EDPS_CMD_INSERT,
 	EDPS_CMD_LIST,
 	EDPS_CMD_MOVE,
@@ -31,12 +34,15 @@ typedef enum edps_cmd_t {
 	EDPS_CMD_NONE = -1
 } edps_cmd_t;
 
+/* Line numbers, counting from 0, or one of the two above. */
+typedef int64_t edps_line_t;
+
 typedef struct edps_instr_t {
-	int start_line, end_line, only_line, target_line;
-	edps_cmd_t command;
+	edps_line_t start_line, end_line, only_line, target_line;
+	edps_cmd_t command, global_cmd;
 	uint32_t repeat;
-	int ask;
-	char *search_str, *replace_str;
+	int ask, nocase;
+	char *search_str, *replace_str, *global_str;
 	char *filename;
 } edps_instr_t;
 
@@ -44,6 +50,8 @@ typedef struct edps_ctx_t edps_ctx_t;
 
 void edps_free(edps_ctx_t *ctx);
 edps_ctx_t *edps_new(const char *cmdline, const char *prompt, int *status);
+int edps_restart(edps_ctx_t *ctx, const char *cmdline);
+void edps_set_silent(edps_ctx_t *ctx, const int silent);
 int edps_parse(edps_ctx_t *ctx);
 edps_instr_t *edps_get_instr(edps_ctx_t *ctx);
 
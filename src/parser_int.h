@@ -13,11 +13,20 @@ struct edps_ctx_t {
 	edps_instr_t *instr;
 	int n_subexpr;
 	const char *prompt;
+	int silent;
+
+	/* The strings of the current instruction. Four of them at most, none
+	   longer than the command line, so this never grows while a line is
+	   being parsed and the instruction can point into it. */
+	char *strings;
+	size_t strings_used, strings_alloced;
 };
 
 static int ps_after_range(edps_ctx_t *ctx);
 static int ps_copy(edps_ctx_t *ctx);
+static int ps_global(edps_ctx_t *ctx);
 static int ps_move(edps_ctx_t *ctx);
+static int ps_nocase(edps_ctx_t *ctx);
 static int ps_range_end(edps_ctx_t *ctx);
 static int ps_range_start(edps_ctx_t *ctx);
 static int ps_repeat(edps_ctx_t *ctx);
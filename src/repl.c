@@ -4,6 +4,7 @@
  *******************************************/
 
 #include <ctype.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,12 +13,22 @@
 
 #include "appinfo.h"
 #include "ermac.h"
+#include "fileio.h"
+#include "index.h"
 #include "lexer.h"
+#include "lines.h"
+#include "outbuf.h"
 #include "parser.h"
 #include "repl.h"
+#include "search.h"
+#include "tasks.h"
+#include "thread.h"
 #include "util.h"
 
 #define PREALLOC_LINES				16
+#define PARALLEL_LINES				4096
+#define PAGE_LINES					25
+#define ALL_LINES					UINT64_MAX
 #define ERRSTR						"<ERROR>"
 
 #define RANGE_CLASS_ERROR			-1
@@ -27,21 +38,39 @@
 #define RANGE_CLASS_ENDONLY			3
 #define RANGE_CLASS_STARTEND		4
 
-typedef struct repl_state_t {
-	uint32_t cursor;
+struct repl_state_t {
+	uint64_t cursor;
 	int quit;
 	char *search_str;
+	int search_nocase;
+	edsr_memo_t *search_memo;
 	const char *prompt;
 	const char *cursor_marker;
-} repl_state_t;
 
-static void indent(const uint32_t n) {
+	/* Text for I, A and line edits that doesn't come from stdin. */
+	const char * const *text_lines;
+	size_t n_text_lines, next_text_line;
+	char *(*next_line)(void *ctx);
+	void *next_line_ctx;
+
+	/* Batch mode: no prompts, no echo and yes to every question. Silent
+	   on top of that prints nothing at all to stdout. */
+	int quiet, piped;
+	uint32_t n_commands, n_errors;
+
+	/* Where lines are shown, and, for repl_read(), the version of the
+	   document that L, P and S look at instead of the document itself. */
+	FILE *out;
+	const edsn_version_t *view;
+};
+
+static void indent(FILE *out, const uint64_t n) {
 	uint32_t i, l = num_len(n);
 
 	if(l > 8) l = 8;
 
 	for(i = 0; i < 8 - l; i++)
-		printf(" ");
+		fprintf(out, " ");
 }
 
 static void manual(void) {
@@ -50,34 +79,45 @@ static void manual(void) {
 	printf("Copy                        [startline],[endline],toline[,times]C\n");
 	printf("Delete                      [startline][,endline]D\n");
 	printf("Quit and save changes       E\n");
+	printf("Find all                    [startline][,endline][~]F[text]\n");
+	printf("Global                      [startline][,endline][~]Gtext{D|Rold,new|,tolineC|,tolineM}\n");
 	printf("Insert                      [line]I\n");
 	printf("List                        [startline][,endline]L\n");
 	printf("Move                        [startline],[endline],tolineM\n");
+	printf("Number of matches           [startline][,endline][~]N[text]\n");
 	printf("Page                        [startline][,endline]P\n");
 	printf("Quit and discard changes    Q\n");
-	printf("Search and replace          [startline][,endline][?]Roldtext,newtext\n");
-	printf("Search                      [startline][,endline][?]Stext\n");
+	printf("Search and replace          [startline][,endline][~][?]Roldtext,newtext\n");
+	printf("Search                      [startline][,endline][~][?]Stext\n");
 	printf("Transfer                    [toline]Tfilename\n");
 	printf("Write                       [#lines]W[filename]\n");
 }
 
-static int ask(const char *prompt, FILE *input) {
+static int ask(const repl_state_t *state, const char *prompt, FILE *input) {
 	int status;
 	char reply;
 
 #ifdef AFL_BUILD
 	return RET_YES;
 #else
+	if(state->quiet) return RET_YES;
+
+	/* Input that isn't the terminal can't answer, just like a pipe. */
+	if(state->next_line != NULL) {
+		fprintf(state->out, "%s (Y/N)? ?\n", prompt);
+		return RET_ERR_INVALID;
+	}
+
 	for(;;) {
-		printf("%s (Y/N)? ", prompt);
-		fflush(stdout);
+		fprintf(state->out, "%s (Y/N)? ", prompt);
+		fflush(state->out);
 
 		reply = get_key(&status);
 		if(status != RET_OK) {
-			printf("?\n");
+			fprintf(state->out, "?\n");
 			return RET_ERR_INVALID;
 		}
-		printf("%c\n", reply);
+		fprintf(state->out, "%c\n", reply);
 
 		if(toupper(reply) == 'Y') return RET_YES;
 		if(toupper(reply) == 'N') return RET_NO;
@@ -86,7 +126,7 @@ static int ask(const char *prompt, FILE *input) {
 	return 0;
 }
 
-static void print_cursor(const uint32_t line_number, const repl_state_t *state) {
+static void print_cursor(const uint64_t line_number, const repl_state_t *state) {
 	size_t cursor_length, i;
 
 	if(state == NULL) return;
@@ -94,39 +134,79 @@ static void print_cursor(const uint32_t line_number, const repl_state_t *state)
 	cursor_length = strlen(state->cursor_marker);
 
 	if(line_number == state->cursor) {
-		printf("%s", state->cursor_marker);
+		fprintf(state->out, "%s", state->cursor_marker);
 	} else {
 		for(i = 0; i < cursor_length; i++) {
-			printf(" ");
+			fprintf(state->out, " ");
 		}
 	}
 }
 
-static void print_line(const repl_state_t *state, const char *line, const uint32_t line_number) {
+static void not_found(const repl_state_t *state) {
+	if(state->quiet != REPL_SILENT)
+		print_message("Not found.");
+}
+
+static void print_line(const repl_state_t *state, const char *line, const uint64_t line_number) {
 	if((state == NULL) || (line == NULL)) return;
+	if(state->quiet == REPL_SILENT) return;
 
-	indent(line_number + 1);
-	printf("%d:", line_number + 1);
+	indent(state->out, line_number + 1);
+	fprintf(state->out, "%" PRIu64 ":", line_number + 1);
 
 	print_cursor(line_number, state);
 
-	printf("%s\n", line);
+	fprintf(state->out, "%s\n", line);
+}
+
+static uint64_t n_lines_of(const repl_state_t *state, const ed_doc_t *document) {
+	return state->view != NULL ? edsn_n_lines(state->view) : document->n_lines;
+}
+
+static const char *line_of(const repl_state_t *state, const ed_doc_t *document, const uint64_t line_number) {
+	char **line;
+
+	if(state->view != NULL) return edsn_line(state->view, line_number);
+	if((line = dynarr_get_element(document->lines_arr, line_number)) == NULL) return NULL;
+	return *line;
 }
 
 /*/*/
 
-static char *text_prompt(const uint32_t line_number, const char *cursor_marker) {
+static char *text_prompt(repl_state_t *state, const uint64_t line_number) {
+	const char *queued;
 	char *read_line;
 
-	indent(line_number);
-	printf("%d:%s", line_number, cursor_marker);
+	if(!state->quiet) {
+		indent(stdout, line_number);
+		printf("%" PRIu64 ":%s", line_number, state->cursor_marker);
+	}
+
+	if(state->text_lines != NULL) {
+		/* Running out of queued text ends the input. */
+		if(state->next_text_line < state->n_text_lines)
+			queued = state->text_lines[state->next_text_line++];
+		else
+			queued = ".";
 
-	if((read_line = get_line(stdin)) == NULL) {
+		if(!state->quiet) printf("%s\n", queued);
+		return str_alloc_copy(queued);
+	}
+
+	/* Input from somewhere else ends when it has no more lines. */
+	if(state->next_line != NULL) {
+		if((read_line = state->next_line(state->next_line_ctx)) == NULL)
+			return NULL;
+	} else {
+		read_line = get_line(stdin);
+	}
+
+	if(read_line == NULL) {
 		print_error(RET_ERR_MALLOC);
 		return NULL;
 	}
 
-	if(is_piped(stdin))
+	if(state->piped && !state->quiet)
 		printf("%s\n", read_line);
 
 	return read_line;
@@ -206,14 +286,14 @@ static int resolve_lines(repl_state_t *state, edps_instr_t *instr) {
 	printf("Resolver:");
 	if(n_subs > 0) {
 		if(n_subs & sub_only)
-			printf(" Line %d", instr->only_line + 1);
+			printf(" Line %lld", (long long)instr->only_line + 1);
 
 		if((n_subs & sub_start) || (n_subs & sub_end))
-			printf(" Range From %d to %d",
-				instr->start_line + 1, instr->end_line + 1);
+			printf(" Range From %lld to %lld",
+				(long long)instr->start_line + 1, (long long)instr->end_line + 1);
 
 		if(n_subs & sub_target)
-			printf(" Target %d", instr->target_line + 1);
+			printf(" Target %lld", (long long)instr->target_line + 1);
 
 		printf("\n");
 	} else {
@@ -226,10 +306,118 @@ static int resolve_lines(repl_state_t *state, edps_instr_t *instr) {
 	return RET_OK;
 }
 
+static int search_flags(const edps_instr_t *instr) {
+	return instr->nocase ? EDSR_NOCASE : 0;
+}
+
+/* A command without a search string goes on with the last one, and
+   ignores case if that one did, or if it's told to with ~. */
+static int remember_search(repl_state_t *state, const char *search_str, const int nocase) {
+	if(state->search_str == NULL) {
+		/* Nothing searched before.        */
+		/* Empty search string is invalid. */
+		if((search_str == NULL) || (search_str[0] == '\0')) {
+			not_found(state);
+			return RET_ERR_SYNTAX;
+		}
+		if((state->search_str = str_alloc_copy(search_str)) == NULL)
+			return RET_ERR_MALLOC;
+		state->search_nocase = nocase;
+	} else {
+		/* Search string already set. */
+		/* Update the string          */
+		if((search_str != NULL) && (search_str[0] != '\0')) {
+			free(state->search_str);
+			if((state->search_str = str_alloc_copy(search_str)) == NULL)
+				return RET_ERR_MALLOC;
+			state->search_nocase = nocase;
+		} else if(nocase) {
+			state->search_nocase = 1;
+		}
+	}
+
+	return RET_OK;
+}
+
+/* Leaves the instruction with the case rule of the search it ends up
+   using. */
+static int set_search_str(repl_state_t *state, edps_instr_t *instr) {
+	int status;
+
+	if((status = remember_search(state, instr->search_str, instr->nocase)) != RET_OK)
+		return status;
+	instr->nocase = state->search_nocase;
+	return RET_OK;
+}
+
+/* Start and (exclusive) end of the lines to look at for commands
+   that default to the whole document. */
+static int scan_range(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr,
+	uint64_t *start, uint64_t *end) {
+	int status;
+
+	if((status = resolve_lines(state, instr)) != RET_OK)
+		return status;
+
+	switch(classify_range(instr)) {
+		case RANGE_CLASS_NONE:
+			*start = 0;
+			*end = document->n_lines;
+			break;
+
+		case RANGE_CLASS_SINGLELINE:
+			*start = instr->only_line;
+			*end = instr->only_line + 1;
+			break;
+
+		case RANGE_CLASS_STARTONLY:
+			*start = instr->start_line;
+			*end = document->n_lines;
+			break;
+
+		case RANGE_CLASS_ENDONLY:
+			*start = 0;
+			*end = instr->end_line + 1;
+			break;
+
+		case RANGE_CLASS_STARTEND:
+			*start = instr->start_line;
+			*end = instr->end_line + 1;
+			break;
+
+		default:
+			return RET_ERR_RANGE;
+	}
+
+	if(*end > document->n_lines)
+		*end = document->n_lines;
+	if(*start > *end)
+		*start = *end;
+
+	return RET_OK;
+}
+
+/* Every command that changes the line table reports the edit here,
+   so that the search memo and the snapshots can follow it. */
+static void lines_changed(repl_state_t *state, ed_doc_t *document,
+	const size_t first, const size_t n_removed, const size_t n_inserted) {
+	edsr_memo_update(state->search_memo, document->lines_arr, first, n_removed, n_inserted);
+	edsn_changed(document->versions, first, n_removed, n_inserted);
+}
+
+/* A line taken out of the table by hand. With snapshots, a reader might
+   still be looking at it. */
+static void drop_line(ed_doc_t *document, char *line) {
+	if(document->versions != NULL)
+		edsn_retire(document->versions, line);
+	else
+		edln_free(line);
+}
+
 /**/
 
 static int append(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t n_lines = 0xffffffff, curr_line;
+	uint64_t n_lines = ALL_LINES, curr_line, first_line;
 	char *entered_line;
 	int range_class, status;
 
@@ -239,7 +427,7 @@ static int append(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr)
 	range_class = classify_range(instr);
 	switch(range_class) {
 		case RANGE_CLASS_NONE:
-			n_lines = 0xffffffff;
+			n_lines = ALL_LINES;
 			break;
 
 		case RANGE_CLASS_SINGLELINE:
@@ -255,17 +443,20 @@ static int append(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr)
 			return print_error(RET_ERR_RANGE);
 	}
 
+	first_line = document->n_lines;
 	curr_line = document->n_lines + 1;
 	do {
-		entered_line = text_prompt(curr_line, state->cursor_marker);
+		entered_line = text_prompt(state, curr_line);
 
 		if(is_empty(entered_line) == RET_YES) {
 			free(entered_line);
 			break;
 		}
 
+		entered_line = edln_intern(entered_line);
 		if((status = dynarr_append(document->lines_arr, &entered_line)) != RET_OK) {
-			free(entered_line);
+			edln_free(entered_line);
+			lines_changed(state, document, first_line, 0, document->n_lines - first_line);
 			return print_error(status);
 		}
 		document->n_lines++;
@@ -274,16 +465,27 @@ static int append(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr)
 		n_lines--;
 	} while(n_lines);
 
+	lines_changed(state, document, first_line, 0, document->n_lines - first_line);
+	return RET_OK;
+}
+
+/* Room for repeat copies of n_lines lines, unless there can't be that
+   many. */
+static int alloc_copies(const size_t n_lines, const uint32_t repeat, char ***copies) {
+	if((repeat > 0) && (n_lines > SIZE_MAX / sizeof(char*) / repeat))
+		return RET_ERR_OVERFLOW;
+
+	if((*copies = malloc(n_lines * repeat * sizeof(char*))) == NULL)
+		return RET_ERR_MALLOC;
 	return RET_OK;
 }
 
 static int copy(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t start, end;
-	uint32_t target = instr->target_line;
-	uint32_t read_line;
-	size_t i, rep, copy_size, count = 0, skip = 0;
-	char **read_element, *write_element;
-	int status;
+	uint64_t start, end;
+	uint64_t target = instr->target_line;
+	size_t i, rep, copy_size, n_copies = 0;
+	char **line, **copies;
+	int status = RET_OK;
 
 	if(document->n_lines == 0) return print_error(RET_ERR_RANGE);
 
@@ -301,76 +503,101 @@ static int copy(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 		return print_error(RET_ERR_RANGE);
 
 	copy_size = (end - start) + 1;
-	if(target <= start) skip = 1;
-
-	for(rep = 0; rep < instr->repeat; rep++) {
-		for(i = 0; i < copy_size; i++) {
-			read_line = start + skip * rep * copy_size + (skip + 1) * i;
 
-			if((read_element = dynarr_get_element(document->lines_arr, read_line)) == NULL)
-				return print_error(RET_ERR_INTERNAL);
+	/* The copies are the lines themselves, shared until one of them is
+	   edited, and they all go in with one insert. */
+	if((status = alloc_copies(copy_size, instr->repeat, &copies)) != RET_OK)
+		return print_error(status);
 
-			if((write_element = str_alloc_copy(*read_element)) == NULL)
-				return print_error(RET_ERR_MALLOC);
+	for(rep = 0; (rep < instr->repeat) && (status == RET_OK); rep++) {
+		for(i = 0; i < copy_size; i++) {
+			if((line = dynarr_get_element(document->lines_arr, start + i)) == NULL) {
+				status = RET_ERR_INTERNAL;
+				break;
+			}
+			if((copies[n_copies] = edln_share(*line)) == NULL) {
+				status = RET_ERR_MALLOC;
+				break;
+			}
+			n_copies++;
+		}
+	}
 
-			if((status = dynarr_insert(document->lines_arr, &write_element, target + count++)) != RET_OK)
-				return print_error(status);
+	if(status == RET_OK)
+		status = dynarr_insert_range(document->lines_arr, copies, n_copies, target);
 
-			document->n_lines++;
-		}
+	if(status != RET_OK) {
+		for(i = 0; i < n_copies; i++)
+			edln_free(copies[i]);
+		free(copies);
+		return print_error(status);
 	}
 
+	free(copies);
+	document->n_lines += n_copies;
+	lines_changed(state, document, target, 0, n_copies);
 	state->cursor = target;
 	return RET_OK;
 }
 
-static int delete(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t start = instr->start_line, end = instr->end_line;
-	int range_class, status = RET_OK;
-
-	if(document->n_lines == 0) return RET_OK;
+/* Works out which lines a D takes out of a document of n_lines. */
+static int delete_span(repl_state_t *state, edps_instr_t *instr, const uint64_t n_lines,
+	uint64_t *start, uint64_t *end) {
+	int status;
 
 	if((status = resolve_lines(state, instr)) != RET_OK)
 		return status;
-	range_class = classify_range(instr);
 
-	switch(range_class) {
+	switch(classify_range(instr)) {
 		case RANGE_CLASS_NONE:
-			start = state->cursor;
-			end = state->cursor;
+			*start = state->cursor;
+			*end = state->cursor;
 			break;
 
 		case RANGE_CLASS_SINGLELINE:
-			start = instr->only_line;
-			end = instr->only_line;
+			*start = instr->only_line;
+			*end = instr->only_line;
 			break;
 
 		case RANGE_CLASS_STARTONLY:
-			start = instr->start_line;
-			end = document->n_lines - 1;
+			*start = instr->start_line;
+			*end = n_lines - 1;
 			break;
 
 		case RANGE_CLASS_ENDONLY:
-			start = 0;
-			end = instr->end_line;
+			*start = 0;
+			*end = instr->end_line;
 			break;
 
 		case RANGE_CLASS_STARTEND:
-			start = instr->start_line;
-			end = instr->end_line;
+			*start = instr->start_line;
+			*end = instr->end_line;
 			break;
 
 		default:
 			return print_error(RET_ERR_RANGE);
 	}
 
-	if(end >= document->n_lines)
-		end = document->n_lines - 1;
+	if(*end >= n_lines)
+		*end = n_lines - 1;
+
+	return RET_OK;
+}
+
+static int delete(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
+	uint64_t start, end;
+	int status;
+
+	if(document->n_lines == 0) return RET_OK;
+
+	if((status = delete_span(state, instr, document->n_lines, &start, &end)) != RET_OK)
+		return status;
 
 	if((status = dynarr_delete(document->lines_arr, start, end)) != RET_OK)
 		return print_error(RET_ERR_INVALID);
 
 	document->n_lines -= (end - start) + 1;
+	lines_changed(state, document, start, (end - start) + 1, 0);
 
 	return status;
 }
@@ -388,7 +615,7 @@ static int end(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 }
 
 static int edit(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t n_line;
+	uint64_t n_line;
 	char **line_str, *new_line;
 	int status;
 
@@ -405,14 +632,18 @@ static int edit(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 	if((line_str = dynarr_get_element(document->lines_arr, n_line)) == NULL)
 		return print_error(RET_ERR_NULLPO);
 
-	print_line(state, *line_str, n_line);
-	if((is_empty(new_line = text_prompt(n_line + 1, state->cursor_marker))) == RET_NO) {
+	if(!state->quiet)
+		print_line(state, *line_str, n_line);
+	if((is_empty(new_line = text_prompt(state, n_line + 1))) == RET_NO) {
+		new_line = edln_intern(new_line);
 		if((status = (dynarr_insert(document->lines_arr, &new_line, n_line + 1))) != RET_OK)
 			return print_error(status);
 
 		if((status = dynarr_delete(document->lines_arr, n_line, n_line)) != RET_OK)
 			return print_error(status);
 
+		lines_changed(state, document, n_line, 1, 1);
+
 	} else {
 		free(new_line);
 	}
@@ -421,7 +652,7 @@ static int edit(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 }
 
 static int insert(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t l;
+	uint64_t l, first_line;
 	char *read_line;
 	int range_class, status, goon = 1;
 
@@ -448,17 +679,20 @@ static int insert(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr)
 
 	if(l > document->n_lines)
 		l = document->n_lines;
+	first_line = l;
 
 	do {
-		read_line = text_prompt(l + 1, state->cursor_marker);
+		read_line = text_prompt(state, l + 1);
 
 		if(is_empty(read_line) == RET_YES) {
 			free(read_line);
 			goon = 0;
 		} else {
+			read_line = edln_intern(read_line);
 			if((status = dynarr_insert(document->lines_arr, &read_line, l)) != RET_OK) {
 				print_error(status);
-				free(read_line);
+				edln_free(read_line);
+				lines_changed(state, document, first_line, 0, l - first_line);
 				return status;
 			} else {
 				document->n_lines++;
@@ -467,16 +701,17 @@ static int insert(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr)
 		l++;
 	} while(goon == 1);
 
+	lines_changed(state, document, first_line, 0, l - first_line - 1);
 	return RET_OK;
 }
 
 static int list(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t start, end;
-	uint32_t i, lines_shown = 0;
+	uint64_t start, end;
+	uint64_t i, lines_shown = 0;
 	int range_class;
-	char **line;
+	const char *line;
 
-	if(document->n_lines == 0) return RET_OK;
+	if(n_lines_of(state, document) == 0) return RET_OK;
 
 	/* L command behaviour:
 	 * No arguments:
@@ -549,20 +784,20 @@ static int list(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 			return print_error(RET_ERR_RANGE);
 	}
 
-	if(end > document->n_lines - 1)
-		end = document->n_lines - 1;
+	if(end > n_lines_of(state, document) - 1)
+		end = n_lines_of(state, document) - 1;
 
 	for(i = start; i < end + 1; i++) {
-		if((line = dynarr_get_element(document->lines_arr, i)) == NULL) {
+		if((line = line_of(state, document, i)) == NULL) {
 			print_line(state, ERRSTR, i);
 		} else {
-			print_line(state, *line, i);
+			print_line(state, line, i);
 		}
 
 		lines_shown++;
 
 		if((lines_shown == 24) && (i != end)) {
-		if(ask("Continue", stdin) == RET_NO) return RET_OK;
+		if(ask(state, "Continue", stdin) == RET_NO) return RET_OK;
 		lines_shown = 0;}
 	}
 
@@ -570,9 +805,9 @@ static int list(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 }
 
 static int move(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t start, end;
-	uint32_t target = instr->target_line;
-	uint32_t move_range;
+	uint64_t start, end;
+	uint64_t target = instr->target_line;
+	uint64_t move_range, span_start, span_end;
 	int status;
 
 	if((status = resolve_lines(state, instr)) != RET_OK)
@@ -597,16 +832,22 @@ static int move(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 	if((status = dynarr_move(document->lines_arr, start, end, target)) != RET_OK)
 		return print_error(status);
 
+	/* Everything between the block and its target has shifted. */
+	span_start = target < start ? target : start;
+	span_end = target + move_range > end + 1 ? target + move_range : end + 1;
+	if(span_end > document->n_lines)
+		span_end = document->n_lines;
+	lines_changed(state, document, span_start, span_end - span_start, span_end - span_start);
 	return RET_OK;
 }
 
 static int page(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t start, end;
-	uint32_t i, lines_shown = 0;
+	uint64_t start, end;
+	uint64_t i, lines_shown = 0;
 	int range_class, status;
-	char **line;
+	const char *line;
 
-	if(document->n_lines == 0) return RET_OK;
+	if(n_lines_of(state, document) == 0) return RET_OK;
 
 	/* P command behaviour:
 	*
@@ -665,21 +906,21 @@ static int page(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 			return RET_ERR_RANGE;
 	}
 
-	if(end > document->n_lines - 1)
-		end = document->n_lines - 1;
+	if(end > n_lines_of(state, document) - 1)
+		end = n_lines_of(state, document) - 1;
 
 	for(i = start; i < end + 1; i++) {
-		if((line = dynarr_get_element(document->lines_arr, i)) == NULL) {
+		if((line = line_of(state, document, i)) == NULL) {
 			print_line(state, ERRSTR, i);
 		} else {
-			print_line(state, *line, i);
+			print_line(state, line, i);
 		}
 
 		lines_shown++;
 		state->cursor = i;
 
 		if((lines_shown == 24) && (i != end)) {
-			if(ask("Continue", stdin) == RET_NO) return RET_OK;
+			if(ask(state, "Continue", stdin) == RET_NO) return RET_OK;
 			lines_shown = 0;
 		}
 	}
@@ -688,18 +929,18 @@ static int page(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 }
 
 static int quit(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	if(ask("Abort edit?", stdin) == RET_YES) state->quit = 1;
+	if(ask(state, "Abort edit?", stdin) == RET_YES) state->quit = 1;
 	return RET_OK;
 }
 
-static char *construct_replace(const char *str, const char *search, const char *replace, size_t * match_pos) {
-	char *match;
+static char *construct_replace(const char *str, const char *search, const char *replace, const int flags, size_t * match_pos) {
+	const char *match;
 	size_t out_str_size;
 	char *out;
 
 	if(match_pos == NULL) return NULL;
 
-	if((match = strstr(str + *match_pos, search)) == NULL)
+	if((match = edsr_find(str + *match_pos, search, flags)) == NULL)
 		return NULL;
 
 	*match_pos = match - str;
@@ -716,93 +957,123 @@ static char *construct_replace(const char *str, const char *search, const char *
 	return out;
 }
 
-static int replace(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t start = instr->start_line, end = instr->end_line;
-	uint32_t i;
-	char **line;
+/* Replaces every occurrence of the current search string in one line.
+   Returns RET_YES if the line was changed. */
+static int replace_line(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr, const char *search_str,
+	char **line, const uint64_t line_number, const int verbose, int *found) {
 	size_t match_pos = 0;
 	char *edited_str;
-	int found = 0;
+	int edited = RET_NO;
 
-	start = instr->start_line;
-	if(instr->start_line == EDPS_THIS_LINE) start = state->cursor;
-	if(instr->start_line == EDPS_NO_LINE) start = state->cursor + 1;
-	if(instr->end_line == EDPS_THIS_LINE) end = state->cursor + 1;
-	if(instr->end_line == EDPS_NO_LINE) end = start;
+	do {
+		if((edited_str = construct_replace(*line, search_str, instr->replace_str, search_flags(instr), &match_pos)) != NULL) {
+			*found = 1;
+			if((verbose || (instr->ask == RET_YES)) && !state->quiet)
+				print_line(state, edited_str, line_number);
+
+			if((instr->ask == RET_YES) && (ask(state, "O.K.", stdin) != RET_YES)) {
+				free(edited_str);
+				match_pos += strlen(search_str);
+			} else {
+				drop_line(document, *line);
+				*line = edited_str;
+				match_pos += strlen(instr->replace_str);
+				edited = RET_YES;
+			}
+		}
+		state->cursor = line_number;
+	} while(edited_str != NULL);
 
-	if((instr->start_line == EDPS_NO_LINE) && (instr->end_line == EDPS_THIS_LINE))
-		return RET_ERR_SYNTAX;
+	if(edited == RET_YES) *line = edln_intern(*line);
+	return edited;
+}
 
-	if((instr->start_line == EDPS_NO_LINE) && (instr->end_line == EDPS_NO_LINE)) {
-		start = state->cursor + 1;
-		end = document->n_lines - 1;
-	}
+typedef struct replace_job_t {
+	dynarr_t *lines;
+	const char *search_str, *replace_str;
+	int flags;
 
-	if((instr->replace_str == NULL) || (strlen(instr->replace_str) == 0))
-		return print_error(RET_ERR_SYNTAX);
+	uint64_t start;
+	char **edited;
+} replace_job_t;
 
-	if(state->search_str == NULL) {
-		/* Nothing searched before.        */
-		/* Empty search string is invalid. */
-		if((instr->search_str == NULL) || (instr->search_str[0] == '\0')) {
-			fprintf(stderr, "%s: Not found.\n", APP_NAME);
-			return RET_ERR_SYNTAX;
-		}
-		if((state->search_str = str_alloc_copy(instr->search_str)) == NULL)
-			return RET_ERR_MALLOC;
-	} else {
-		/* Search string already set. */
-		/* Update the string          */
-		if((instr->search_str != NULL) && (instr->search_str[0] != '\0')) {
-			free(state->search_str);
-			if((state->search_str = str_alloc_copy(instr->search_str)) == NULL)
-				return RET_ERR_MALLOC;
-		}
+/* What replace_line() would make of a line, without asking or printing
+   anything. NULL if there's nothing to replace in it. */
+char *repl_replace_all(const char *line, const char *search, const char *replace, const int flags) {
+	char *current = (char*)line, *edited_str;
+	size_t match_pos = 0;
+
+	while((edited_str = construct_replace(current, search, replace, flags, &match_pos)) != NULL) {
+		if(current != line) free(current);
+		current = edited_str;
+		match_pos += strlen(replace);
 	}
-	end++;
 
-	if(end > document->n_lines)
-		end = document->n_lines;
+	return current != line ? current : NULL;
+}
+
+/* Works out what replace_line() would make of each line, without
+   touching the document. */
+static int replace_body(void *ctx, const size_t start, const size_t end, const unsigned worker) {
+	replace_job_t *job = ctx;
+	char **line;
+	size_t i;
 
 	for(i = start; i < end; i++) {
-		if((line = dynarr_get_element(document->lines_arr, i)) == NULL) {
-			print_line(state, ERRSTR, i);
-		} else {
-			match_pos = 0;
-			do {
-				if((edited_str = construct_replace(*line, state->search_str, instr->replace_str, &match_pos)) != NULL) {
-					found = 1;
-					print_line(state, edited_str, i);
-
-					if(instr->ask == RET_YES) {
-						if(ask("O.K.", stdin) == RET_YES) {
-							free(*line);
-							*line = edited_str;
-							match_pos += strlen(instr->replace_str);
-						} else {
-							match_pos += strlen(state->search_str);
-						}
-					} else {
-						free(*line);
-						*line = edited_str;
-						match_pos += strlen(instr->replace_str);
-					}
-				}
-				state->cursor = i;
-			} while(edited_str != NULL);
-		}
+		if((line = dynarr_get_element(job->lines, i)) == NULL) continue;
+		job->edited[i - job->start] = repl_replace_all(*line, job->search_str, job->replace_str, job->flags);
 	}
 
-	if(found == 0)
-		fprintf(stderr, "%s: Not found.\n", APP_NAME);
+	return RET_OK;
+}
 
-	return RET_ERR_NOTFOUND;
+/* With nothing to print and nothing to ask, the lines of a big range
+   are worked on in parallel and put into the document in one go. */
+static int replace_parallel(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr,
+	const uint64_t start, const uint64_t end, int *found, uint64_t *first_edit, uint64_t *last_edit) {
+	replace_job_t job;
+	char **line;
+	uint64_t i;
+	int status;
+
+	job.lines = document->lines_arr;
+	job.search_str = state->search_str;
+	job.replace_str = instr->replace_str;
+	job.flags = search_flags(instr);
+	job.start = start;
+	if((job.edited = calloc(end - start, sizeof(char*))) == NULL)
+		return RET_ERR_MALLOC;
+
+	if((status = edtk_for(start, end, 0, replace_body, &job, NULL)) != RET_OK) {
+		for(i = start; i < end; i++)
+			free(job.edited[i - start]);
+		free(job.edited);
+		return status;
+	}
+
+	for(i = start; i < end; i++) {
+		if(job.edited[i - start] == NULL) continue;
+		if((line = dynarr_get_element(document->lines_arr, i)) == NULL) continue;
+
+		drop_line(document, *line);
+		*line = edln_intern(job.edited[i - start]);
+
+		if(*found == 0) *first_edit = i;
+		*last_edit = i;
+		*found = 1;
+	}
+
+	state->cursor = end - 1;
+	free(job.edited);
+	return RET_OK;
 }
 
-static int search(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t start = instr->start_line, end = instr->end_line;
-	uint32_t i;
+static int replace(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
+	uint64_t start = instr->start_line, end = instr->end_line;
+	uint64_t i;
 	char **line;
+	uint64_t first_edit = 0, last_edit = 0;
+	int found = 0, edited = 0, status;
 
 	start = instr->start_line;
 	if(instr->start_line == EDPS_THIS_LINE) start = state->cursor;
@@ -818,109 +1089,742 @@ static int search(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr)
 		end = document->n_lines - 1;
 	}
 
-	if(state->search_str == NULL) {
-		/* Nothing searched before.        */
-		/* Empty search string is invalid. */
-		if((instr->search_str == NULL) || (instr->search_str[0] == '\0')) {
-			fprintf(stderr, "%s: Not found.\n", APP_NAME);
-			return RET_ERR_SYNTAX;
-		}
-		if((state->search_str = str_alloc_copy(instr->search_str)) == NULL)
-			return RET_ERR_MALLOC;
-	} else {
-		/* Search string already set. */
-		/* Update the string          */
-		if((instr->search_str != NULL) && (instr->search_str[0] != '\0')) {
-			free(state->search_str);
-			if((state->search_str = str_alloc_copy(instr->search_str)) == NULL)
-				return RET_ERR_MALLOC;
-		}
-	}
+	if((instr->replace_str == NULL) || (strlen(instr->replace_str) == 0))
+		return print_error(RET_ERR_SYNTAX);
+
+	if((status = set_search_str(state, instr)) != RET_OK)
+		return status;
 	end++;
 
 	if(end > document->n_lines)
 		end = document->n_lines;
 
-	for(i = start; i < end; i++) {
-		if((line = dynarr_get_element(document->lines_arr, i)) == NULL) {
-			print_line(state, ERRSTR, i);
-		} else if(strstr(*line, state->search_str)) {
-			indent(i + 1);
-			printf("%d: %s\n", i + 1, *line);
-
-			state->cursor = i;
-
-			if(instr->ask == RET_YES) {
-				if(ask("O.K.", stdin) == RET_YES) {
-					return RET_OK;
-				}
+	if(state->quiet && (instr->ask != RET_YES) && (edtk_workers() > 1) &&
+		(end > start) && (end - start >= PARALLEL_LINES)) {
+		if((status = replace_parallel(state, document, instr, start, end, &found, &first_edit, &last_edit)) != RET_OK)
+			return print_error(status);
+		edited = found;
+	} else {
+		for(i = start; i < end; i++) {
+			if((line = dynarr_get_element(document->lines_arr, i)) == NULL) {
+				print_line(state, ERRSTR, i);
 			} else {
-				return RET_OK;
+				if(replace_line(state, document, instr, state->search_str, line, i, !state->quiet, &found) == RET_YES) {
+					if(edited == 0) first_edit = i;
+					last_edit = i;
+					edited = 1;
+				}
 			}
 		}
 	}
 
-	fprintf(stderr, "%s: Not found.\n", APP_NAME);
+	if(edited)
+		lines_changed(state, document, first_edit, last_edit - first_edit + 1, last_edit - first_edit + 1);
+
+	if(found == 0)
+		not_found(state);
 
 	return RET_ERR_NOTFOUND;
 }
 
-static int transfer(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t insert_line;
-	ed_doc_t *new_doc;
-	size_t n_input_lines, input_line = 0;
-	char **input_data, *copy_data;
-	FILE *fp;
+static int count_matches(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
+	uint64_t start, end;
+	size_t n_lines, n_matches;
 	int status;
-	int range_class;
 
-	if((status = resolve_lines(state, instr)) != RET_OK)
+	if((status = set_search_str(state, instr)) != RET_OK)
 		return status;
-	range_class = classify_range(instr);
+	if((status = scan_range(state, document, instr, &start, &end)) != RET_OK)
+		return print_error(status);
 
-	switch(range_class) {
-		case RANGE_CLASS_SINGLELINE:
-			insert_line = instr->only_line;
-			break;
+	if((status = edsr_count_lines(document->lines_arr, start, end, state->search_str, search_flags(instr), &n_lines, &n_matches)) != RET_OK)
+		return print_error(status);
 
-		case RANGE_CLASS_NONE:
-		case RANGE_CLASS_STARTONLY:
-		case RANGE_CLASS_ENDONLY:
-		case RANGE_CLASS_STARTEND:
-		default:
-			return print_error(RET_ERR_RANGE);
+	if(state->quiet != REPL_SILENT)
+		printf("%zu match%s in %zu line%s.\n",
+		n_matches, n_matches == 1 ? "" : "es",
+		n_lines, n_lines == 1 ? "" : "s");
+	return RET_OK;
+}
 
-	}
+static int find(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
+	uint64_t start, end, i;
+	size_t n_found = 0, marker_len, j;
+	outbuf_t *ob;
+	char **line;
+	int status = RET_OK;
 
-	if((fp = fopen(instr->filename, "r")) == NULL)
-		return print_error(RET_ERR_OPEN);
+	if((status = set_search_str(state, instr)) != RET_OK)
+		return status;
+	if((status = scan_range(state, document, instr, &start, &end)) != RET_OK)
+		return print_error(status);
 
-	if((new_doc = load_doc(fp, NULL, 1)) == NULL) {
-		fclose(fp);
-		return print_error(RET_ERR_READ);
+	if(state->quiet == REPL_SILENT) {
+		if((status = edsr_count_lines(document->lines_arr, start, end, state->search_str, search_flags(instr), &n_found, &j)) != RET_OK)
+			return print_error(status);
+		return n_found > 0 ? RET_OK : RET_ERR_NOTFOUND;
 	}
 
-	fclose(fp);
+	if((ob = outbuf_new(stdout, 0)) == NULL)
+		return print_error(RET_ERR_MALLOC);
 
-	n_input_lines = new_doc->n_lines;
-	for(input_line = 0; input_line < n_input_lines; input_line++) {
-		status = RET_ERR_MALLOC;
+	marker_len = strlen(state->cursor_marker);
+	for(i = start; (i < end) && (status == RET_OK); i++) {
+		if((line = dynarr_get_element(document->lines_arr, i)) == NULL) {
+			status = RET_ERR_RANGE;
+			break;
+		}
+		if(edsr_find(*line, state->search_str, search_flags(instr)) == NULL) continue;
 
-		if((input_data = dynarr_get_element(new_doc->lines_arr, input_line)) == NULL) goto fail;
-		if((copy_data = str_alloc_copy(*input_data)) == NULL) goto fail;
-		if((status = dynarr_insert(document->lines_arr, &copy_data, input_line + insert_line)) != RET_OK)
-			goto fail;
-		document->n_lines++;
+		n_found++;
+		status = outbuf_number(ob, i + 1, 8);
+		if(status == RET_OK) status = outbuf_putc(ob, ':');
+		if(i == state->cursor) {
+			if(status == RET_OK) status = outbuf_puts(ob, state->cursor_marker);
+		} else {
+			for(j = 0; (j < marker_len) && (status == RET_OK); j++)
+				status = outbuf_putc(ob, ' ');
+		}
+		if(status == RET_OK) status = outbuf_puts(ob, *line);
+		if(status == RET_OK) status = outbuf_putc(ob, '\n');
 	}
 
-	status = RET_OK;
-fail:
-	free_doc(new_doc);
-	return status;
+	outbuf_free(ob);
+
+	if(status != RET_OK)
+		return print_error(status);
+
+	if(n_found == 0) {
+		not_found(state);
+		return RET_ERR_NOTFOUND;
+	}
+
+	return RET_OK;
+}
+
+/* The global command collects the matching lines of its range in a
+   single scan and then hands the whole list to one of these, so that
+   the line table is rewritten once instead of once per match. */
+
+static int global_copy(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr,
+	const size_t *matches, const size_t n_matches) {
+	size_t i, rep, n_copies = 0;
+	uint64_t target = instr->target_line;
+	char **copies, **line;
+	int status = RET_OK;
+
+	if(target > document->n_lines) return print_error(RET_ERR_RANGE);
+
+	if((status = alloc_copies(n_matches, instr->repeat, &copies)) != RET_OK)
+		return print_error(status);
+
+	for(rep = 0; (rep < instr->repeat) && (status == RET_OK); rep++) {
+		for(i = 0; i < n_matches; i++) {
+			if((line = dynarr_get_element(document->lines_arr, matches[i])) == NULL) {
+				status = RET_ERR_INTERNAL;
+				break;
+			}
+			if((copies[n_copies] = edln_share(*line)) == NULL) {
+				status = RET_ERR_MALLOC;
+				break;
+			}
+			n_copies++;
+		}
+	}
+
+	if(status == RET_OK)
+		status = dynarr_insert_range(document->lines_arr, copies, n_copies, target);
+
+	if(status != RET_OK) {
+		for(i = 0; i < n_copies; i++)
+			edln_free(copies[i]);
+		free(copies);
+		return print_error(status);
+	}
+
+	free(copies);
+	document->n_lines += n_copies;
+	lines_changed(state, document, target, 0, n_copies);
+	state->cursor = target;
+	return RET_OK;
+}
+
+static int global_delete(repl_state_t *state, ed_doc_t *document,
+	const size_t *matches, const size_t n_matches) {
+	size_t span = matches[n_matches - 1] - matches[0] + 1;
+	int status;
+
+	if((status = dynarr_delete_sparse(document->lines_arr, matches, n_matches, NULL)) != RET_OK)
+		return print_error(status);
+
+	document->n_lines -= n_matches;
+	lines_changed(state, document, matches[0], span, span - n_matches);
+
+	state->cursor = matches[0];
+	if((state->cursor >= document->n_lines) && (document->n_lines > 0))
+		state->cursor = document->n_lines - 1;
+	return RET_OK;
+}
+
+static int global_move(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr,
+	const size_t *matches, const size_t n_matches) {
+	uint64_t target = instr->target_line, new_target, span_start, span_end;
+	size_t n_before = 0;
+	char **moved;
+	int status;
+
+	if(target > document->n_lines) return print_error(RET_ERR_RANGE);
+
+	if((moved = malloc(n_matches * sizeof(char*))) == NULL)
+		return print_error(RET_ERR_MALLOC);
+
+	/* The matches keep their order. The target moves up by the number
+	   of matches that were taken out in front of it. */
+	while((n_before < n_matches) && (matches[n_before] < target))
+		n_before++;
+	new_target = target - n_before;
+
+	/* Reinserting can't fail: the space the matches leave is still
+	   allocated. */
+	if((status = dynarr_delete_sparse(document->lines_arr, matches, n_matches, moved)) != RET_OK) {
+		free(moved);
+		return print_error(status);
+	}
+	dynarr_insert_range(document->lines_arr, moved, n_matches, new_target);
+	free(moved);
+
+	span_start = matches[0] < new_target ? matches[0] : new_target;
+	span_end = matches[n_matches - 1] + 1 > target ? matches[n_matches - 1] + 1 : target;
+	lines_changed(state, document, span_start, span_end - span_start, span_end - span_start);
+
+	state->cursor = new_target;
+	return RET_OK;
+}
+
+static int global_replace(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr,
+	const size_t *matches, const size_t n_matches) {
+	size_t i, first_edit = 0, last_edit = 0;
+	char **line;
+	int found = 0, edited = 0;
+
+	for(i = 0; i < n_matches; i++) {
+		if((line = dynarr_get_element(document->lines_arr, matches[i])) == NULL)
+			return print_error(RET_ERR_INTERNAL);
+
+		if(replace_line(state, document, instr, state->search_str, line, matches[i], 0, &found) == RET_YES) {
+			if(edited == 0) first_edit = matches[i];
+			last_edit = matches[i];
+			edited = 1;
+		}
+	}
+
+	if(edited)
+		lines_changed(state, document, first_edit, last_edit - first_edit + 1, last_edit - first_edit + 1);
+
+	if(found == 0) {
+		not_found(state);
+		return RET_ERR_NOTFOUND;
+	}
+	return RET_OK;
+}
+
+static int global(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
+	uint64_t start, end, i;
+	size_t *matches, n_matches = 0;
+	char **line;
+	int status;
+
+	if((status = remember_search(state, instr->global_str, instr->nocase)) != RET_OK)
+		return status;
+	if((status = scan_range(state, document, instr, &start, &end)) != RET_OK)
+		return print_error(status);
+
+	if(instr->global_cmd == EDPS_CMD_REPLACE) {
+		if((instr->replace_str == NULL) || (strlen(instr->replace_str) == 0))
+			return print_error(RET_ERR_SYNTAX);
+		/* Without its own search string, R replaces the pattern. */
+		if((status = set_search_str(state, instr)) != RET_OK)
+			return status;
+	}
+
+	if(start == end) {
+		not_found(state);
+		return RET_ERR_NOTFOUND;
+	}
+
+	if((matches = malloc((end - start) * sizeof(size_t))) == NULL)
+		return print_error(RET_ERR_MALLOC);
+
+	for(i = start; i < end; i++) {
+		if((line = dynarr_get_element(document->lines_arr, i)) == NULL) {
+			free(matches);
+			return print_error(RET_ERR_INTERNAL);
+		}
+		if(edsr_find(*line, instr->global_str, search_flags(instr)) != NULL)
+			matches[n_matches++] = i;
+	}
+
+	if(n_matches == 0) {
+		free(matches);
+		not_found(state);
+		return RET_ERR_NOTFOUND;
+	}
+
+	switch(instr->global_cmd) {
+		case EDPS_CMD_COPY:
+			status = global_copy(state, document, instr, matches, n_matches);
+			break;
+
+		case EDPS_CMD_DELETE:
+			status = global_delete(state, document, matches, n_matches);
+			break;
+
+		case EDPS_CMD_MOVE:
+			status = global_move(state, document, instr, matches, n_matches);
+			break;
+
+		case EDPS_CMD_REPLACE:
+			status = global_replace(state, document, instr, matches, n_matches);
+			break;
+
+		default:
+			status = print_error(RET_ERR_INTERNAL);
+	}
+
+	free(matches);
+	return status;
+}
+
+static int search(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
+	uint64_t start = instr->start_line, end = instr->end_line;
+	uint64_t n_lines = n_lines_of(state, document);
+	size_t i, match;
+	const char *line;
+	int status;
+
+	start = instr->start_line;
+	if(instr->start_line == EDPS_THIS_LINE) start = state->cursor;
+	if(instr->start_line == EDPS_NO_LINE) start = state->cursor + 1;
+	if(instr->end_line == EDPS_THIS_LINE) end = state->cursor + 1;
+	if(instr->end_line == EDPS_NO_LINE) end = start;
+
+	if((instr->start_line == EDPS_NO_LINE) && (instr->end_line == EDPS_THIS_LINE))
+		return RET_ERR_SYNTAX;
+
+	if((instr->start_line == EDPS_NO_LINE) && (instr->end_line == EDPS_NO_LINE)) {
+		start = state->cursor + 1;
+		end = n_lines - 1;
+	}
+
+	if((status = set_search_str(state, instr)) != RET_OK)
+		return status;
+	end++;
+
+	if(end > n_lines)
+		end = n_lines;
+
+	for(i = start; i < end; i = match + 1) {
+		if(state->view != NULL) {
+			/* The memo only knows the document. */
+			for(match = i; match < end; match++) {
+				if(edsr_find(line_of(state, document, match), state->search_str, search_flags(instr)) != NULL)
+					break;
+			}
+			if(match == end) break;
+		} else {
+			status = edsr_memo_next(state->search_memo, document->lines_arr, state->search_str, search_flags(instr), i, end, &match);
+			if(status == RET_ERR_NOTFOUND) break;
+			if(status != RET_OK) return print_error(status);
+		}
+
+		if((line = line_of(state, document, match)) == NULL) {
+			print_line(state, ERRSTR, match);
+			continue;
+		}
+
+		if(state->quiet != REPL_SILENT) {
+			indent(state->out, match + 1);
+			fprintf(state->out, "%zu: %s\n", match + 1, line);
+		}
+
+		state->cursor = match;
+
+		if(instr->ask == RET_YES) {
+			if(ask(state, "O.K.", stdin) == RET_YES) {
+				return RET_OK;
+			}
+		} else {
+			return RET_OK;
+		}
+	}
+
+	not_found(state);
+
+	return RET_ERR_NOTFOUND;
+}
+
+static void binary_warning(void) {
+	print_message("Warning! This might be a binary file.");
+}
+
+/* A file that's still being read. The thread that reads it hands over
+   the lines of every block; the document takes them from there as soon
+   as a command needs them, and whatever is there before every command. */
+struct repl_loader_t {
+	FILE *fp;
+	const char *filename;
+	ed_thread_t thread;
+	ed_lock_t lock;
+	ed_cond_t cond;
+	dynarr_t *ready;
+	int done, cancel, status;
+	int maybe_binary, warned;
+};
+
+/* For tables that don't free their lines themselves. */
+static void free_lines(dynarr_t *lines) {
+	char **line;
+	size_t i;
+
+	for(i = 0; i < dynarr_get_size(lines); i++) {
+		if((line = dynarr_get_element(lines, i)) != NULL)
+			edln_free(*line);
+	}
+}
+
+/* RET_NO once nobody wants the rest of the file any more. */
+static int hand_over(void *ctx, dynarr_t *lines, const int maybe_binary) {
+	repl_loader_t *loader = ctx;
+	size_t n_lines = dynarr_get_size(lines);
+	int status = RET_OK;
+
+	ed_lock(&loader->lock);
+	if(loader->cancel) {
+		status = RET_NO;
+	} else if(n_lines > 0) {
+		if((status = dynarr_insert_range(loader->ready, dynarr_get_element(lines, 0), n_lines, dynarr_get_size(loader->ready))) == RET_OK)
+			dynarr_delete(lines, 0, n_lines - 1);
+	}
+	if(maybe_binary) loader->maybe_binary = 1;
+	ed_cond_broadcast(&loader->cond);
+	ed_unlock(&loader->lock);
+
+	return status;
+}
+
+/* Cuts a file into lines exactly like a loop of get_line() until the end
+   of the file would: fgets() pieces of up to MAXBUF - 1 bytes, nothing
+   after a NUL in a piece, a line ending at the last '\r' (or else '\n')
+   of the piece it's found in, and a last line at the end of the file,
+   even if it's empty. Where the lines start in the file goes into the
+   index, as long as every line is just a piece of the file. */
+typedef struct line_splitter_t {
+	dynarr_t *lines;
+	repl_sink_t sink;
+	void *sink_ctx;
+	edix_builder_t *index;
+	char *line;
+	size_t length, alloced;
+	size_t piece_length, cr_pos;
+	uint64_t consumed, line_start;
+	int piece_nul, maybe_binary;
+} line_splitter_t;
+
+#define NO_CR		((size_t)-1)
+
+static int add_to_line(line_splitter_t *split, const char *data, const size_t size) {
+	const char *cr;
+	char *new_line;
+	size_t new_size;
+
+	if(split->length + size + 1 > split->alloced) {
+		new_size = split->alloced * 2 > split->length + size + 1 ? split->alloced * 2 : split->length + size + 1;
+		if((new_line = realloc(split->line, new_size)) == NULL) return RET_ERR_MALLOC;
+		split->line = new_line;
+		split->alloced = new_size;
+	}
+
+	memcpy(split->line + split->length, data, size);
+	for(cr = memchr(data, '\r', size); cr != NULL; cr = memchr(cr + 1, '\r', size - (cr + 1 - data)))
+		split->cr_pos = split->length + (cr - data);
+	split->length += size;
+
+	return RET_OK;
+}
+
+static int finish_line(line_splitter_t *split) {
+	char *out;
+	size_t i;
+
+	if(split->cr_pos != NO_CR) split->length = split->cr_pos;
+
+	if(!split->maybe_binary) {
+		for(i = 0; i < split->length; i++) {
+			if((uint8_t)split->line[i] > 127) {
+				/* The loader leaves that to take_lines(). */
+				if(split->sink != hand_over) binary_warning();
+				split->maybe_binary = 1;
+				break;
+			}
+		}
+	}
+
+	if((out = edln_new(split->line, split->length)) == NULL) return RET_ERR_MALLOC;
+	if(dynarr_append(split->lines, &out) != RET_OK) {
+		edln_free(out);
+		return RET_ERR_MALLOC;
+	}
+	if(split->index != NULL) edix_add(split->index, split->line_start, split->length);
+
+	split->line_start = split->consumed;
+	split->length = 0;
+	split->cr_pos = NO_CR;
+	return RET_OK;
+}
+
+/* The end of a piece is where get_line() looks for the end of the line. */
+static int end_piece(line_splitter_t *split) {
+	split->piece_length = 0;
+	split->piece_nul = 0;
+
+	if(split->cr_pos != NO_CR) return finish_line(split);
+	if((split->length > 0) && (split->line[split->length - 1] == '\n')) {
+		split->length--;
+		return finish_line(split);
+	}
+
+	return RET_OK;
+}
+
+static int split_block(line_splitter_t *split, const char *data, const size_t size) {
+	const char *newline, *nul;
+	size_t pos = 0, room, piece, keep;
+	int status;
+
+	while(pos < size) {
+		room = MAXBUF - 1 - split->piece_length;
+		piece = size - pos < room ? size - pos : room;
+		if((newline = memchr(data + pos, '\n', piece)) != NULL)
+			piece = newline - (data + pos) + 1;
+
+		if(!split->piece_nul) {
+			keep = piece;
+			if((nul = memchr(data + pos, '\0', piece)) != NULL) {
+				keep = nul - (data + pos);
+				split->piece_nul = 1;
+				if(split->index != NULL) edix_spoil(split->index);
+			}
+			if((status = add_to_line(split, data + pos, keep)) != RET_OK)
+				return status;
+		}
+
+		split->piece_length += piece;
+		split->consumed += piece;
+		pos += piece;
+
+		if((newline != NULL) || (split->piece_length == MAXBUF - 1)) {
+			if((status = end_piece(split)) != RET_OK)
+				return status;
+		}
+	}
+
+	return RET_OK;
+}
+
+/* Appends the lines of the file to the table. With a sink, they're
+   handed over after every block, and the table is left with the rest. */
+static int read_lines(FILE *fp, dynarr_t *lines, repl_sink_t sink, void *ctx, edix_builder_t *index) {
+	edio_reader_t *reader;
+	line_splitter_t split;
+	const char *data;
+	size_t size;
+	int status;
+
+	if((reader = edio_reader_new(fp)) == NULL) return RET_ERR_MALLOC;
+
+	split.lines = lines;
+	split.sink = sink;
+	split.sink_ctx = ctx;
+	split.index = index;
+	split.consumed = split.line_start = 0;
+	split.length = split.piece_length = 0;
+	split.cr_pos = NO_CR;
+	split.piece_nul = split.maybe_binary = 0;
+	split.alloced = MAXBUF;
+	if((split.line = malloc(split.alloced)) == NULL) {
+		edio_reader_free(reader);
+		return RET_ERR_MALLOC;
+	}
+
+	/* The next block is already being read while this one is split. */
+	while((status = edio_read(reader, &data, &size)) == RET_OK) {
+		if((status = split_block(&split, data, size)) != RET_OK) break;
+		if((sink != NULL) && ((status = sink(ctx, lines, split.maybe_binary)) != RET_OK)) break;
+	}
+	if(status == RET_NO)
+		status = finish_line(&split);
+	if((index != NULL) && split.maybe_binary)
+		edix_set_binary(index);
+	if((sink != NULL) && (status == RET_OK))
+		status = sink(ctx, lines, split.maybe_binary);
+
+	free(split.line);
+	edio_reader_free(reader);
+	return status;
+}
+
+#define INDEXED_BATCH	65536
+
+/* The same lines, taken from where the index says they are. */
+static int read_indexed(const edix_t *index, dynarr_t *lines, repl_sink_t sink, void *ctx) {
+	uint64_t i, n_lines = edix_n_lines(index);
+	const char *text;
+	size_t length;
+	char *out;
+	int maybe_binary = edix_maybe_binary(index), status = RET_OK;
+
+	if(maybe_binary && (sink != hand_over)) binary_warning();
+
+	for(i = 0; (i < n_lines) && (status == RET_OK); i++) {
+		text = edix_line(index, i, &length);
+		if((out = edln_new(text, length)) == NULL) return RET_ERR_MALLOC;
+		if(dynarr_append(lines, &out) != RET_OK) {
+			edln_free(out);
+			return RET_ERR_MALLOC;
+		}
+		if((i + 1) % INDEXED_BATCH == 0) {
+			edix_release(index, i + 1);
+			if(sink != NULL) status = sink(ctx, lines, maybe_binary);
+		}
+	}
+	if((sink != NULL) && (status == RET_OK))
+		status = sink(ctx, lines, maybe_binary);
+
+	return status;
+}
+
+/* Like read_lines(), but through the index of the file if there's one
+   that fits, and leaving one behind for the next time if there isn't. */
+static int read_file(FILE *fp, const char *filename, dynarr_t *lines, repl_loader_t *loader) {
+	repl_sink_t sink = loader != NULL ? hand_over : NULL;
+	edix_builder_t *builder = NULL;
+	edix_t *index;
+	int status;
+
+	if(edix_sidecars() && (filename != NULL) && (ftell(fp) == 0)) {
+		if((index = edix_open(filename, fp)) != NULL) {
+			status = read_indexed(index, lines, sink, loader);
+			edix_close(index);
+			return status;
+		}
+		builder = edix_builder_new(fp);
+	}
+
+	status = read_lines(fp, lines, sink, loader, builder);
+
+	/* It's only there to save time, so it's no loss if it can't be
+	   written. */
+	if((builder != NULL) && (status == RET_OK)) edix_write(builder, filename);
+	edix_builder_free(builder);
+	return status;
+}
+
+/* Hands the lines of the file to sink as they're read, cut the same way
+   load_doc() would cut them, without ever keeping more than a block of
+   them. The sink takes them out of the table it's given. */
+int repl_stream(FILE *fp, repl_sink_t sink, void *ctx) {
+	dynarr_t *lines;
+	int status;
+
+	if((lines = dynarr_new(sizeof(char*), PREALLOC_LINES, NULL)) == NULL) return RET_ERR_MALLOC;
+	status = read_lines(fp, lines, sink, ctx, NULL);
+
+	free_lines(lines);
+	dynarr_free(lines);
+	return status;
+}
+
+ED_THREAD_FUNC(load_body, arg) {
+	repl_loader_t *loader = arg;
+	dynarr_t *lines;
+	int status;
+
+	if((lines = dynarr_new(sizeof(char*), PREALLOC_LINES, NULL)) == NULL) {
+		status = RET_ERR_MALLOC;
+	} else {
+		status = read_file(loader->fp, loader->filename, lines, loader);
+
+		/* Whatever couldn't be handed over any more. */
+		free_lines(lines);
+		dynarr_free(lines);
+	}
+
+	ed_lock(&loader->lock);
+	if(loader->status == RET_OK) loader->status = status;
+	loader->done = 1;
+	ed_cond_broadcast(&loader->cond);
+	ed_unlock(&loader->lock);
+
+	ED_THREAD_RETURN;
+}
+
+static int transfer(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
+	uint64_t insert_line;
+	dynarr_t *lines;
+	size_t n_input_lines;
+	FILE *fp;
+	int status;
+	int range_class;
+
+	if((status = resolve_lines(state, instr)) != RET_OK)
+		return status;
+	range_class = classify_range(instr);
+
+	switch(range_class) {
+		case RANGE_CLASS_SINGLELINE:
+			insert_line = instr->only_line;
+			break;
+
+		case RANGE_CLASS_NONE:
+		case RANGE_CLASS_STARTONLY:
+		case RANGE_CLASS_ENDONLY:
+		case RANGE_CLASS_STARTEND:
+		default:
+			return print_error(RET_ERR_RANGE);
+
+	}
+
+	if((fp = fopen(instr->filename, "r")) == NULL)
+		return print_error(RET_ERR_OPEN);
+
+	/* The lines read go straight into the document, all at once. The
+	   table only holds them until then. */
+	if((lines = dynarr_new(sizeof(char*), PREALLOC_LINES, NULL)) == NULL) {
+		fclose(fp);
+		return print_error(RET_ERR_MALLOC);
+	}
+
+	status = read_lines(fp, lines, NULL, NULL, NULL);
+	fclose(fp);
+
+	n_input_lines = dynarr_get_size(lines);
+	if(status != RET_OK) {
+		status = print_error(RET_ERR_READ);
+	} else if((n_input_lines > 0) &&
+		((status = dynarr_insert_range(document->lines_arr, dynarr_get_element(lines, 0), n_input_lines, insert_line)) == RET_OK)) {
+		document->n_lines += n_input_lines;
+		lines_changed(state, document, insert_line, 0, n_input_lines);
+		n_input_lines = 0;
+	}
+
+	if(n_input_lines > 0) free_lines(lines);
+	dynarr_free(lines);
+
+	return status;
 }
 
 static int write(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
-	uint32_t end_line;
+	uint64_t end_line;
 	char *filename;
 	int range_class;
 
@@ -946,34 +1850,232 @@ static int write(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
 	else
 		filename = document->filename;
 
-	save_doc(document, filename, 0, end_line + 1);
-	return RET_OK;
+	/* save_doc() has said what went wrong. */
+	return save_doc(document, filename, 0, end_line + 1);
 }
 
 /*/*/
 
-static void free_element(void *data) {
-	uint8_t **dbl_ptr, *sng_ptr;
+/* The loader is done, one way or the other. */
+static void stop_loading(ed_doc_t *doc) {
+	repl_loader_t *loader = doc->loader;
 
-	dbl_ptr = data;
-	sng_ptr = *dbl_ptr;
-	free(sng_ptr);
+	ed_thread_join(loader->thread);
+	fclose(loader->fp);
+
+	/* The document only has part of the file, which mustn't be written
+	   over all of it. RET_NO is a load that was called off. */
+	if((loader->status != RET_OK) && (loader->status != RET_NO)) {
+		print_error(RET_ERR_READ);
+		doc->no_write = 1;
+	}
+
+	free_lines(loader->ready);
+	dynarr_free(loader->ready);
+	ed_cond_free(&loader->cond);
+	ed_lock_free(&loader->lock);
+	free(loader);
+	doc->loader = NULL;
+}
+
+/* Waits until the document has n_lines, or all of the file if it's
+   shorter than that, and takes all the lines that are there. They go
+   behind everything, where no memo or snapshot has looked yet. */
+static void take_lines(ed_doc_t *doc, const uint64_t n_lines) {
+	repl_loader_t *loader = doc->loader;
+	size_t n_ready;
+	int done, warn = 0;
+
+	if(loader == NULL) return;
+
+	ed_lock(&loader->lock);
+	while(!loader->done && (doc->n_lines + dynarr_get_size(loader->ready) < n_lines))
+		ed_cond_wait(&loader->cond, &loader->lock);
+
+	n_ready = dynarr_get_size(loader->ready);
+	if((n_ready > 0) && (dynarr_insert_range(doc->lines_arr, dynarr_get_element(loader->ready, 0), n_ready, doc->n_lines) == RET_OK)) {
+		doc->n_lines += n_ready;
+		dynarr_delete(loader->ready, 0, n_ready - 1);
+	} else if(n_ready > 0) {
+		loader->status = RET_ERR_MALLOC;
+		loader->cancel = 1;
+	}
+
+	if(loader->maybe_binary && !loader->warned) {
+		loader->warned = 1;
+		warn = 1;
+	}
+	done = loader->done || loader->cancel;
+	ed_unlock(&loader->lock);
+
+	if(warn) binary_warning();
+	if(done) stop_loading(doc);
 }
 
 void free_doc(ed_doc_t *doc) {
 	if(doc == NULL) return;
+	if(doc->loader != NULL) {
+		ed_lock(&doc->loader->lock);
+		doc->loader->cancel = 1;
+		ed_unlock(&doc->loader->lock);
+		stop_loading(doc);
+	}
+	edsn_free(doc->versions);
 	if(doc->filename != NULL) free(doc->filename);
 	if(doc->lines_arr != NULL) dynarr_free(doc->lines_arr);
 	free(doc);
 }
 
-int save_doc(ed_doc_t *doc, const char *filename, const uint32_t start_line, const uint32_t end_line) {
+/* Lines per piece of a parallel save. */
+#define SAVE_CHUNK					4096
+
+typedef struct save_job_t {
+	dynarr_t *lines;
+	FILE *fp;
+	uint64_t first, end, n_lines;
+
+	/* Where each piece starts in the file, and where the last ends. */
+	uint64_t *offsets;
+	char **buffers;
+	size_t *buffer_sizes;
+} save_job_t;
+
+/* Every line but the very last one of the document ends in a newline. */
+static size_t saved_length(const save_job_t *job, const uint64_t line, const char *data) {
+	return strlen(data) + (line < job->n_lines - 1 ? 1 : 0);
+}
+
+static void piece_lines(const save_job_t *job, const size_t piece, uint64_t *first, uint64_t *end) {
+	*first = job->first + piece * SAVE_CHUNK;
+	*end = job->end - *first > SAVE_CHUNK ? *first + SAVE_CHUNK : job->end;
+}
+
+static int measure_body(void *ctx, const size_t start, const size_t end, const unsigned worker) {
+	save_job_t *job = ctx;
+	uint64_t line, first, last;
+	char **line_data;
+	uint64_t size;
+	size_t i;
+
+	for(i = start; i < end; i++) {
+		piece_lines(job, i, &first, &last);
+		for(line = first, size = 0; line < last; line++) {
+			if((line_data = dynarr_get_element(job->lines, line)) != NULL)
+				size += saved_length(job, line, *line_data);
+		}
+		job->offsets[i + 1] = size;
+	}
+
+	return RET_OK;
+}
+
+/* Each worker puts its pieces together in a buffer of its own and
+   writes them where they go. */
+static int write_body(void *ctx, const size_t start, const size_t end, const unsigned worker) {
+	save_job_t *job = ctx;
+	uint64_t line, first, last;
+	char **line_data, *out, *new_buffer;
+	size_t i, size, length;
+	int status;
+
+	for(i = start; i < end; i++) {
+		size = job->offsets[i + 1] - job->offsets[i];
+		if(size > job->buffer_sizes[worker]) {
+			if((new_buffer = realloc(job->buffers[worker], size)) == NULL)
+				return RET_ERR_MALLOC;
+			job->buffers[worker] = new_buffer;
+			job->buffer_sizes[worker] = size;
+		}
+
+		out = job->buffers[worker];
+		piece_lines(job, i, &first, &last);
+		for(line = first; line < last; line++) {
+			if((line_data = dynarr_get_element(job->lines, line)) == NULL) continue;
+
+			length = strlen(*line_data);
+			memcpy(out, *line_data, length);
+			out += length;
+			if(line < job->n_lines - 1) *out++ = '\n';
+		}
+
+		if((status = edio_write_at(job->fp, job->buffers[worker], size, job->offsets[i])) != RET_OK)
+			return status;
+	}
+
+	return RET_OK;
+}
+
+/* Once it's known how long every piece is, where each one goes into the
+   file is too, and the pieces can be put together and written by all
+   the workers at the same time. */
+static int save_parallel(ed_doc_t *doc, FILE *fp, const uint64_t start, const uint64_t first, const uint64_t end) {
+	save_job_t job;
+	size_t n_pieces, i;
+	unsigned worker;
+	int status = RET_ERR_MALLOC;
+
+	job.lines = doc->lines_arr;
+	job.fp = fp;
+	job.first = first;
+	job.end = end;
+	job.n_lines = dynarr_get_size(doc->lines_arr);
+	n_pieces = (end - first + SAVE_CHUNK - 1) / SAVE_CHUNK;
+
+	job.buffers = NULL;
+	job.buffer_sizes = NULL;
+	if((job.offsets = malloc((n_pieces + 1) * sizeof(uint64_t))) == NULL) goto done;
+	if((job.buffers = calloc(edtk_workers(), sizeof(char*))) == NULL) goto done;
+	if((job.buffer_sizes = calloc(edtk_workers(), sizeof(size_t))) == NULL) goto done;
+
+	if((status = edtk_for(0, n_pieces, 1, measure_body, &job, NULL)) != RET_OK) goto done;
+
+	job.offsets[0] = start;
+	for(i = 0; i < n_pieces; i++)
+		job.offsets[i + 1] += job.offsets[i];
+
+	status = edtk_for(0, n_pieces, 1, write_body, &job, NULL);
+
+done:
+	if(job.buffers != NULL) {
+		for(worker = 0; worker < edtk_workers(); worker++)
+			free(job.buffers[worker]);
+	}
+	free(job.buffers);
+	free(job.buffer_sizes);
+	free(job.offsets);
+	return status;
+}
+
+static int save_serial(ed_doc_t *doc, FILE *fp, const uint64_t first, const uint64_t end) {
+	edio_writer_t *writer;
+	uint64_t n_lines, curr_line;
+	char **line_data;
+	int status = RET_OK;
+
+	if((writer = edio_writer_new(fp)) == NULL)
+		return RET_ERR_MALLOC;
+
+	/* Every line but the very last one of the document ends in a
+	   newline. */
+	n_lines = dynarr_get_size(doc->lines_arr);
+	for(curr_line = first; (curr_line < end) && (status == RET_OK); curr_line++) {
+		if((line_data = dynarr_get_element(doc->lines_arr, curr_line)) == NULL) continue;
+
+		status = edio_write(writer, *line_data, strlen(*line_data));
+		if((status == RET_OK) && (curr_line < n_lines - 1))
+			status = edio_write(writer, "\n", 1);
+	}
+
+	if(edio_writer_close(writer) != RET_OK) status = RET_ERR_WRITE;
+	return status;
+}
+
+int save_doc(ed_doc_t *doc, const char *filename, const uint64_t start_line, const uint64_t end_line) {
 	FILE *fp;
 	const char *out_filename = filename;
-	uint32_t n_lines, curr_line;
-	size_t pos, bytes_written, to_write, tmp_size;
-	int fix_line = 0;
-	char **line_data, *tmp_line;
+	uint64_t n_lines, end;
+	uint64_t start;
+	int status;
 
 	if(doc == NULL)
 		return print_error(RET_ERR_INVALID);
@@ -985,6 +2087,14 @@ int save_doc(ed_doc_t *doc, const char *filename, const uint32_t start_line, con
 		if((out_filename = doc->filename) == NULL)
 			return print_error(RET_ERR_INVALID);
 
+	/* Opening the file that's still being read would cut it off under
+	   the loader, and the rest of it would be lost. */
+	if((doc->loader != NULL) && edio_same_file(doc->loader->fp, out_filename)) {
+		take_lines(doc, ALL_LINES);
+		if(doc->no_write != 0)
+			return print_error(RET_ERR_NOWRITE);
+	}
+
 #ifdef AFL_BUILD
 	if((fp = fopen("/dev/null", "wb")) == NULL)
 #else
@@ -993,75 +2103,47 @@ int save_doc(ed_doc_t *doc, const char *filename, const uint32_t start_line, con
 		return print_error(RET_ERR_OPEN);
 
 	n_lines = dynarr_get_size(doc->lines_arr);
-	for(curr_line = 0; curr_line < n_lines; curr_line++) {
-
-		if(curr_line < start_line) continue;
-		if(curr_line >= end_line) break;
+	end = end_line < n_lines ? end_line : n_lines;
 
-		line_data = dynarr_get_element(doc->lines_arr, curr_line);
-
-		if(line_data != NULL) {
-			tmp_size = strlen(*line_data);
-			if((tmp_line = malloc(tmp_size + 1)) == NULL)
-				return print_error(RET_ERR_WRITE);
-
-			memset(tmp_line, 0, tmp_size);
-			memcpy(tmp_line, *line_data, tmp_size);
-
-			if(curr_line < n_lines - 1) {
-				tmp_line[tmp_size] = '\n';
-				to_write = tmp_size + 1;
-			} else {
-				to_write = tmp_size;
-			}
-
-			pos = 0;
-
-			while(to_write > 0) {
-				bytes_written = fwrite(tmp_line, 1, to_write, fp);
-				pos += bytes_written;
-				to_write -= bytes_written;
-			}
-			free(tmp_line);
-		}
-	}
+	if((edtk_workers() > 1) && (end > start_line) && (end - start_line >= PARALLEL_LINES) &&
+		edio_can_write_at(fp, &start))
+		status = save_parallel(doc, fp, start, start_line, end);
+	else if(start_line < end)
+		status = save_serial(doc, fp, start_line, end);
+	else
+		status = RET_OK;
 
-	fclose(fp);
+	if(fclose(fp) != 0) status = RET_ERR_WRITE;
 
+	if(status != RET_OK) return print_error(RET_ERR_WRITE);
 	return RET_OK;
 }
 
+/* The whole document, to a stream that's already open. */
+int write_doc(ed_doc_t *doc, FILE *fp) {
+	take_lines(doc, ALL_LINES);
+	if(doc->n_lines == 0) return RET_OK;
+	return save_serial(doc, fp, 0, doc->n_lines);
+}
+
 ed_doc_t *load_doc(FILE *fp, const char *filename, const int no_write) {
 	ed_doc_t *out;
-	uint8_t *read_line;
-	uint32_t line_number = 0, line_pos;
-	int maybe_binary = 0;
 
 	if((out = malloc(sizeof(ed_doc_t))) == NULL) return NULL;
 
-	if((out->lines_arr = dynarr_new(sizeof(void *), PREALLOC_LINES, free_element)) == NULL)
+	if((out->lines_arr = dynarr_new(sizeof(void *), PREALLOC_LINES, edln_free_element)) == NULL) {
+		free(out);
 		return NULL;
-	out->n_lines = 0;
-
-	while(!feof(fp)) {
-		if((read_line = get_line(fp)) == NULL) goto fail;
-
-		for(line_pos = 0; line_pos < strlen(read_line); line_pos++) {
-			if((maybe_binary == 0) && (read_line[line_pos] > 127)) {
-				printf("Warning! This might be a binary file.\n");
-				maybe_binary = 1;
-			}
-		}
-
-		dynarr_append(out->lines_arr, &read_line);
-		out->n_lines++;
 	}
+	out->filename = NULL;
+	out->versions = NULL;
+	out->loader = NULL;
 
-	if(filename == NULL) {
-		out->filename = NULL;
-	} else if((out->filename = str_alloc_copy(filename)) == NULL) {
+	if(read_file(fp, filename, out->lines_arr, NULL) != RET_OK) goto fail;
+	out->n_lines = dynarr_get_size(out->lines_arr);
+
+	if((filename != NULL) && ((out->filename = str_alloc_copy(filename)) == NULL))
 		goto fail;
-	}
 
 	out->no_write = no_write;
 	return out;
@@ -1071,11 +2153,53 @@ fail:
 	return NULL;
 }
 
+/* Like load_doc(), but the file is read in the background and the
+   document is there right away. Commands wait for the lines they need
+   (see lines_needed()). The document keeps fp and closes it, unless
+   there's no document. */
+ed_doc_t *open_doc(FILE *fp, const char *filename, const int no_write) {
+	repl_loader_t *loader;
+	ed_doc_t *out;
+
+	if((out = empty_doc(filename)) == NULL) return NULL;
+	out->no_write = no_write;
+
+	if((loader = calloc(1, sizeof(repl_loader_t))) == NULL) goto fail;
+	if((loader->ready = dynarr_new(sizeof(char*), PREALLOC_LINES, NULL)) == NULL) {
+		free(loader);
+		goto fail;
+	}
+	loader->fp = fp;
+	loader->filename = out->filename;
+	loader->status = RET_OK;
+	ed_lock_init(&loader->lock);
+	ed_cond_init(&loader->cond);
+	out->loader = loader;
+
+	if(!ed_thread_start(&loader->thread, load_body, loader)) {
+		/* Then it's read right here. */
+		dynarr_free(loader->ready);
+		ed_cond_free(&loader->cond);
+		ed_lock_free(&loader->lock);
+		free(loader);
+		out->loader = NULL;
+
+		if(read_file(fp, out->filename, out->lines_arr, NULL) != RET_OK) goto fail;
+		out->n_lines = dynarr_get_size(out->lines_arr);
+		fclose(fp);
+	}
+
+	return out;
+fail:
+	free_doc(out);
+	return NULL;
+}
+
 ed_doc_t *empty_doc(const char *filename) {
 	ed_doc_t *out;
 
 	if((out = malloc(sizeof(ed_doc_t))) == NULL) return NULL;
-	if((out->lines_arr = dynarr_new(sizeof(void *), PREALLOC_LINES, free)) == NULL) goto fail;
+	if((out->lines_arr = dynarr_new(sizeof(void *), PREALLOC_LINES, edln_free_element)) == NULL) goto fail;
 	if(filename == NULL) {
 		out->filename = NULL;
 	} else {
@@ -1083,6 +2207,9 @@ ed_doc_t *empty_doc(const char *filename) {
 	}
 
 	out->n_lines = 0;
+	out->no_write = 0;
+	out->versions = NULL;
+	out->loader = NULL;
 	return out;
 
 freearr:
@@ -1092,7 +2219,7 @@ fail:
 	return NULL;
 }
 
-static repl_state_t *repl_init(const char *prompt, const char *cursor_marker) {
+repl_state_t *repl_init(const char *prompt, const char *cursor_marker) {
 	repl_state_t *out;
 
 	if((out = malloc(sizeof(repl_state_t))) == NULL) {
@@ -1115,25 +2242,517 @@ static repl_state_t *repl_init(const char *prompt, const char *cursor_marker) {
 	out->quit = 0;
 	out->cursor = 0;
 	out->search_str = NULL;
+	out->search_nocase = 0;
+	out->text_lines = NULL;
+	out->n_text_lines = 0;
+	out->next_text_line = 0;
+	out->next_line = NULL;
+	out->next_line_ctx = NULL;
+	out->quiet = 0;
+	out->piped = is_piped(stdin);
+	out->n_commands = 0;
+	out->n_errors = 0;
+	out->out = stdout;
+	out->view = NULL;
+
+	if((out->search_memo = edsr_memo_new()) == NULL) {
+		fprintf(stderr, "%s: Failed to set up the editor.\n", APP_NAME);
+		free(out);
+		return NULL;
+	}
 
 	return out;
 }
 
-static void repl_free(repl_state_t *state) {
+void repl_free(repl_state_t *state) {
 	if(state == NULL) return;
 	if(state->search_str != NULL) free(state->search_str);
+	edsr_memo_free(state->search_memo);
 	free(state);
 }
 
-int repl_main(FILE *input, ed_doc_t *ed_doc, const char *prompt, const char *cursor_marker) {
+void repl_set_text(repl_state_t *state, const char * const *lines, const size_t n_lines) {
+	state->text_lines = lines;
+	state->n_text_lines = n_lines;
+	state->next_text_line = 0;
+}
+
+/* Reads text from somewhere else than stdin. That input is never a
+   terminal, so the lines are echoed like piped ones. When next_line
+   returns NULL, the text ends there. */
+void repl_set_input(repl_state_t *state, char *(*next_line)(void *ctx), void *ctx) {
+	state->next_line = next_line;
+	state->next_line_ctx = ctx;
+	state->piped = 1;
+}
+
+void repl_set_quiet(repl_state_t *state, const int quiet) {
+	state->quiet = quiet;
+}
+
+/* What a quiet run prints instead of everything it leaves out. */
+void repl_print_summary(const uint32_t n_commands, const uint32_t n_errors, const uint64_t n_lines, const char *filename) {
+	fprintf(stderr, "%s: %u command%s, %u error%s, %" PRIu64 " line%s in '%s'.\n", APP_NAME,
+		n_commands, n_commands == 1 ? "" : "s",
+		n_errors, n_errors == 1 ? "" : "s",
+		n_lines, n_lines == 1 ? "" : "s",
+		filename != NULL ? filename : "stdin");
+}
+
+void repl_summary(const repl_state_t *state, ed_doc_t *document) {
+	take_lines(document, ALL_LINES);
+	repl_print_summary(state->n_commands, state->n_errors, document->n_lines, document->filename);
+}
+
+/* For commands that were left out because they wouldn't have changed
+   anything, so they're counted all the same. */
+void repl_count_skipped(repl_state_t *state, const uint32_t n_commands) {
+	state->n_commands += n_commands;
+}
+
+/* For a line that couldn't be parsed, which never gets to repl_exec(). */
+void repl_count_error(repl_state_t *state) {
+	state->n_errors++;
+}
+
+void repl_counts(const repl_state_t *state, uint32_t *n_commands, uint32_t *n_errors) {
+	*n_commands = state->n_commands;
+	*n_errors = state->n_errors;
+}
+
+uint64_t repl_cursor(const repl_state_t *state) {
+	return state->cursor;
+}
+
+int repl_done(const repl_state_t *state) {
+	return state->quit;
+}
+
+/* How many lines of a file that's still being read a command has to
+   have, so that it does the same as it would with all of them: up to the
+   last line it names (or the cursor), a page more for L and P, and all
+   of them for anything that goes to the end of the file or needs to know
+   where that is. */
+static uint64_t lines_needed(const repl_state_t *state, const edps_instr_t *instr) {
+	const edps_line_t named[] = { instr->start_line, instr->end_line, instr->only_line, instr->target_line };
+	uint64_t last = state->cursor;
+	int range_class = classify_range(instr);
+	size_t i;
+
+	for(i = 0; i < sizeof(named) / sizeof(named[0]); i++) {
+		if((named[i] >= 0) && ((uint64_t)named[i] > last))
+			last = named[i];
+	}
+	if(last >= ALL_LINES - PAGE_LINES) return ALL_LINES;
+
+	switch(instr->command) {
+		case EDPS_CMD_NONE:
+		case EDPS_CMD_ASK:
+		case EDPS_CMD_QUIT:
+			return 0;
+
+		case EDPS_CMD_EDIT:
+		case EDPS_CMD_INSERT:
+		case EDPS_CMD_COPY:
+		case EDPS_CMD_MOVE:
+		case EDPS_CMD_TRANSFER:
+			return last + 2;
+
+		case EDPS_CMD_LIST:
+		case EDPS_CMD_PAGE:
+			return last + PAGE_LINES;
+
+		case EDPS_CMD_DELETE:
+			return range_class == RANGE_CLASS_STARTONLY ? ALL_LINES : last + 2;
+
+		/* A single line number doesn't end the range: like none, it
+		   goes from the line after the cursor to the end of the file. */
+		case EDPS_CMD_SEARCH:
+		case EDPS_CMD_REPLACE:
+			return (range_class == RANGE_CLASS_NONE) || (range_class == RANGE_CLASS_SINGLELINE) ? ALL_LINES : last + 2;
+
+		case EDPS_CMD_COUNT:
+		case EDPS_CMD_FIND:
+			return (range_class == RANGE_CLASS_NONE) || (range_class == RANGE_CLASS_STARTONLY) ? ALL_LINES : last + 2;
+
+		case EDPS_CMD_WRITE:
+			/* A W to the file that's being read waits for all of it
+			   in save_doc(). */
+			return range_class == RANGE_CLASS_SINGLELINE ? last + 2 : ALL_LINES;
+
+		case EDPS_CMD_APPEND:
+		case EDPS_CMD_END:
+		case EDPS_CMD_GLOBAL:
+		default:
+			return ALL_LINES;
+	}
+}
+
+/* Whether the command asks for text when it runs now, and how many lines
+   of it at most. It always stops at a ".", too. This has to agree with
+   what append(), edit() and insert() do, so that input that isn't all
+   there yet can be waited for before the command runs. */
+int repl_wants_text(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr, uint64_t *max_lines) {
+	int range_class;
+
+	*max_lines = 0;
+	switch(instr->command) {
+		case EDPS_CMD_APPEND:
+			range_class = classify_range(instr);
+			if(range_class == RANGE_CLASS_NONE)
+				*max_lines = ALL_LINES;
+			else if((range_class == RANGE_CLASS_SINGLELINE) && (instr->only_line != EDPS_THIS_LINE))
+				*max_lines = instr->only_line + 1;
+			break;
+
+		case EDPS_CMD_EDIT:
+			take_lines(document, lines_needed(state, instr));
+			if((instr->only_line != EDPS_NO_LINE) && (instr->only_line < document->n_lines))
+				*max_lines = 1;
+			break;
+
+		case EDPS_CMD_INSERT:
+			if(resolve_lines(state, instr) != RET_OK) break;
+			range_class = classify_range(instr);
+			if((range_class == RANGE_CLASS_NONE) || (range_class == RANGE_CLASS_SINGLELINE))
+				*max_lines = ALL_LINES;
+			break;
+
+		default:
+			break;
+	}
+
+	return *max_lines > 0 ? RET_YES : RET_NO;
+}
+
+int repl_exec(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr) {
+	int status = RET_OK;
+
+	take_lines(document, lines_needed(state, instr));
+
+	switch(instr->command) {
+		case EDPS_CMD_NONE:
+			/* Nothing to do here. */
+			break;
+
+		case EDPS_CMD_APPEND:
+			status = append(state, document, instr);
+			break;
+
+		case EDPS_CMD_ASK:
+			if(state->quiet != REPL_SILENT) manual();
+			break;
+
+		case EDPS_CMD_COPY:
+			status = copy(state, document, instr);
+			break;
+
+		case EDPS_CMD_COUNT:
+			status = count_matches(state, document, instr);
+			break;
+
+		case EDPS_CMD_DELETE:
+			status = delete(state, document, instr);
+			break;
+
+		case EDPS_CMD_EDIT:
+			status = edit(state, document, instr);
+			break;
+
+		case EDPS_CMD_END:
+			status = end(state, document, instr);
+			break;
+
+		case EDPS_CMD_FIND:
+			status = find(state, document, instr);
+			break;
+
+		case EDPS_CMD_GLOBAL:
+			status = global(state, document, instr);
+			break;
+
+		case EDPS_CMD_INSERT:
+			status = insert(state, document, instr);
+			break;
+
+		case EDPS_CMD_LIST:
+			status = list(state, document, instr);
+			break;
+
+		case EDPS_CMD_MOVE:
+			status = move(state, document, instr);
+			break;
+
+		case EDPS_CMD_PAGE:
+			status = page(state, document, instr);
+			break;
+
+		case EDPS_CMD_QUIT:
+			status = quit(state, document, instr);
+			break;
+
+		case EDPS_CMD_REPLACE:
+			status = replace(state, document, instr);
+			break;
+
+		case EDPS_CMD_SEARCH:
+			status = search(state, document, instr);
+			break;
+
+		case EDPS_CMD_TRANSFER:
+			status = transfer(state, document, instr);
+			break;
+
+		case EDPS_CMD_WRITE:
+			status = write(state, document, instr);
+			break;
+
+	}
+
+	if(instr->command != EDPS_CMD_NONE) {
+		state->n_commands++;
+		if((status < 0) && (status != RET_ERR_NOTFOUND))
+			state->n_errors++;
+	}
+
+	edsn_publish(document->versions, document->n_lines);
+
+	/* Readers of snapshots may have any of the lines, so they stay where
+	   they are as long as there are any. */
+	if(document->versions == NULL)
+		edln_compact(document->lines_arr);
+	edln_trim();
+
+	return status;
+}
+
+/* Whether the command only shows lines (or does nothing at all), and
+   can run on a snapshot. */
+int repl_reads_only(const edps_instr_t *instr) {
+	switch(instr->command) {
+		case EDPS_CMD_NONE:
+		case EDPS_CMD_LIST:
+		case EDPS_CMD_PAGE:
+		case EDPS_CMD_SEARCH:
+			return RET_YES;
+
+		default:
+			return RET_NO;
+	}
+}
+
+/* Runs one of those on a pinned version instead of the document, and
+   shows the lines on out, so that it doesn't have to wait for the thread
+   that edits. The session's cursor and search string move as usual. */
+int repl_read(repl_state_t *state, const edsn_version_t *version, edps_instr_t *instr, FILE *out) {
+	int status;
+
+	if(repl_reads_only(instr) != RET_YES) return RET_ERR_INVALID;
+	if(instr->command == EDPS_CMD_NONE) return RET_OK;
+
+	state->view = version;
+	state->out = out;
+
+	switch(instr->command) {
+		case EDPS_CMD_LIST:
+			status = list(state, NULL, instr);
+			break;
+
+		case EDPS_CMD_PAGE:
+			status = page(state, NULL, instr);
+			break;
+
+		default:
+			status = search(state, NULL, instr);
+			break;
+	}
+
+	state->view = NULL;
+	state->out = stdout;
+
+	state->n_commands++;
+	if((status < 0) && (status != RET_ERR_NOTFOUND))
+		state->n_errors++;
+
+	return status;
+}
+
+/* Lets other threads read the document through snapshots. Until all of
+   the file is there, that's RET_NO: the lines that are still coming
+   would go behind their back. */
+int repl_snapshots(ed_doc_t *document) {
+	take_lines(document, 0);
+	if(document->loader != NULL) return RET_NO;
+	if(document->versions != NULL) return RET_OK;
+
+	if((document->versions = edsn_new(document->lines_arr, document->n_lines)) == NULL)
+		return RET_ERR_MALLOC;
+	return RET_OK;
+}
+
+/* Maps a line number of the document as a row of deletes left it back
+   onto the document before them. Spans are sorted and don't touch. */
+static uint64_t unshift_line(const uint64_t *spans, const size_t n_spans, uint64_t line) {
+	size_t i;
+
+	for(i = 0; i < n_spans; i++) {
+		if(spans[2 * i] > line) break;
+		line += spans[2 * i + 1] - spans[2 * i] + 1;
+	}
+
+	return line;
+}
+
+static void add_span(uint64_t *spans, size_t *n_spans, uint64_t first, uint64_t last) {
+	size_t i, j;
+
+	for(i = 0; (i < *n_spans) && (spans[2 * i + 1] + 1 < first); i++);
+	for(j = i; (j < *n_spans) && (spans[2 * j] <= last + 1); j++);
+
+	if(j > i) {
+		if(spans[2 * i] < first) first = spans[2 * i];
+		if(spans[2 * (j - 1) + 1] > last) last = spans[2 * (j - 1) + 1];
+	}
+
+	memmove(spans + 2 * (i + 1), spans + 2 * j, 2 * (*n_spans - j) * sizeof(uint64_t));
+	*n_spans = *n_spans + 1 - (j - i);
+	spans[2 * i] = first;
+	spans[2 * i + 1] = last;
+}
+
+/* Runs a row of D commands as one splice. Every range is worked out on
+   the document as the deletes before it left it, just like running them
+   one by one, and then mapped back onto the lines as they are now. */
+int repl_delete_group(repl_state_t *state, ed_doc_t *document, edps_instr_t *instrs, const size_t n_instrs) {
+	uint64_t *spans, n_lines, start, end;
+	size_t n_spans = 0, *indices, n_indices, i, j;
+	int status = RET_OK;
+
+	/* The file may still be coming in, and the ranges need all of it. */
+	take_lines(document, ALL_LINES);
+	n_lines = document->n_lines;
+	if((spans = malloc(2 * (n_instrs + 1) * sizeof(uint64_t))) == NULL)
+		return print_error(RET_ERR_MALLOC);
+	state->n_commands += n_instrs;
+
+	for(i = 0; (i < n_instrs) && (n_lines > 0); i++) {
+		if((status = delete_span(state, &instrs[i], n_lines, &start, &end)) != RET_OK)
+			continue;
+		if((start >= n_lines) || (end < start)) {
+			status = print_error(RET_ERR_INVALID);
+			state->n_errors++;
+			continue;
+		}
+
+		n_lines -= (end - start) + 1;
+		start = unshift_line(spans, n_spans, start);
+		end = unshift_line(spans, n_spans, end);
+		add_span(spans, &n_spans, start, end);
+	}
+
+	if(n_spans == 1) {
+		if(dynarr_delete(document->lines_arr, spans[0], spans[1]) != RET_OK)
+			n_spans = 0;
+	} else if(n_spans > 1) {
+		n_indices = document->n_lines - n_lines;
+		if((indices = malloc(n_indices * sizeof(size_t))) == NULL) {
+			free(spans);
+			return print_error(RET_ERR_MALLOC);
+		}
+		for(i = 0, n_indices = 0; i < n_spans; i++)
+			for(j = spans[2 * i]; j <= spans[2 * i + 1]; j++)
+				indices[n_indices++] = j;
+
+		if(dynarr_delete_sparse(document->lines_arr, indices, n_indices, NULL) != RET_OK)
+			n_spans = 0;
+		free(indices);
+	}
+
+	if(n_spans > 0) {
+		document->n_lines = n_lines;
+
+		/* Back to front, so the line numbers still fit. */
+		for(i = n_spans; i > 0; i--)
+			lines_changed(state, document, spans[2 * (i - 1)],
+				spans[2 * (i - 1) + 1] - spans[2 * (i - 1)] + 1, 0);
+		edsn_publish(document->versions, document->n_lines);
+	}
+
+	free(spans);
+	return status;
+}
+
+/* Runs a row of R commands on the same range in a single pass: each line
+   gets all of the replacements, in order, before the next one is looked
+   at. The range has to be given in line numbers and every R needs its
+   own search and replace strings. */
+int repl_replace_group(repl_state_t *state, ed_doc_t *document, edps_instr_t *instrs, const size_t n_instrs) {
+	uint64_t start, end, i, first_edit = 0, last_edit = 0;
+	int *found, edited = 0, status;
+	char **line;
+	size_t j;
+
+	if(n_instrs == 0) return RET_OK;
+	state->n_commands += n_instrs;
+	/* What a single R on the range would wait for; that doesn't wrap
+	   around at the far end. */
+	take_lines(document, lines_needed(state, &instrs[0]));
+
+	start = instrs[0].start_line;
+	end = (uint64_t)instrs[0].end_line + 1;
+	if(end > document->n_lines)
+		end = document->n_lines;
+
+	if((found = calloc(n_instrs, sizeof(int))) == NULL)
+		return print_error(RET_ERR_MALLOC);
+
+	for(i = start; i < end; i++) {
+		if((line = dynarr_get_element(document->lines_arr, i)) == NULL) {
+			print_line(state, ERRSTR, i);
+			continue;
+		}
+
+		for(j = 0; j < n_instrs; j++) {
+			if(replace_line(state, document, &instrs[j], instrs[j].search_str, line, i, !state->quiet, &found[j]) == RET_YES) {
+				if(edited == 0) first_edit = i;
+				last_edit = i;
+				edited = 1;
+			}
+		}
+	}
+
+	if(edited)
+		lines_changed(state, document, first_edit, last_edit - first_edit + 1, last_edit - first_edit + 1);
+	edsn_publish(document->versions, document->n_lines);
+
+	for(j = 0; j < n_instrs; j++) {
+		if(found[j] == 0)
+			not_found(state);
+	}
+	free(found);
+
+	if((status = remember_search(state, instrs[n_instrs - 1].search_str, instrs[n_instrs - 1].nocase)) != RET_OK)
+		return status;
+	return RET_ERR_NOTFOUND;
+}
+
+int repl_main(FILE *input, ed_doc_t *ed_doc, const char *prompt, const char *cursor_marker, const int quiet) {
 	repl_state_t *repl_state;
 	char *cmdline;
 	edps_ctx_t *parser_ctx;
 	edps_instr_t *instruction;
 	int parser_status, status = RET_OK;
+	uint32_t line = 0;
 
 	if((repl_state = repl_init(prompt, cursor_marker)) == NULL)
 		return RET_ERR_INTERNAL;
+	repl_set_quiet(repl_state, quiet);
+
+	if((parser_ctx = edps_new("", prompt, &status)) == NULL) {
+		fprintf(stderr, "%s: Parser initialization failed.\n", APP_NAME);
+		repl_free(repl_state);
+		return status;
+	}
 
 	while(repl_state->quit == 0) {
 		if(feof(input)) {
@@ -1141,28 +2760,35 @@ int repl_main(FILE *input, ed_doc_t *ed_doc, const char *prompt, const char *cur
 			break;
 		}
 
-		printf("%s", repl_state->prompt);
+		if(!quiet) printf("%s", repl_state->prompt);
 		cmdline = get_line(input);
+		line++;
 
-		if(is_piped(stdin))
+		if(repl_state->piped && !quiet)
 			printf("%s\n", cmdline);
 
-		if((parser_ctx = edps_new(cmdline, prompt, &status)) == NULL) {
+		if((status = edps_restart(parser_ctx, cmdline)) != RET_OK) {
 			fprintf(stderr, "%s: Parser initialization failed.\n", APP_NAME);
+			free(cmdline);
 			continue;
 		}
 
 		do {
 			if((parser_status = edps_parse(parser_ctx)) != RET_OK) {
 				switch(parser_status) {
-					case RET_ERR_SYNTAX:
-						print_error(parser_status);
-						continue;
-
 					case RET_ERR_INTERNAL:
 					case RET_ERR_MALLOC:
 						return print_error(parser_status);
-						return status;
+
+					/* Anything else that went wrong, such as a syntax
+					   error or a number out of range, is the input's
+					   fault: the line is skipped. */
+					default:
+						if(parser_status > 0) break;
+						print_error(parser_status);
+						repl_state->n_errors++;
+						if(quiet) fprintf(stderr, "%s: Error in line %u of the input.\n", APP_NAME, line);
+						continue;
 				}
 			}
 
@@ -1171,78 +2797,16 @@ int repl_main(FILE *input, ed_doc_t *ed_doc, const char *prompt, const char *cur
 				return status;
 			}
 
-			switch(instruction->command) {
-				case EDPS_CMD_NONE:
-					/* Nothing to do here. */
-					break;
-
-				case EDPS_CMD_APPEND:
-					status = append(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_ASK:
-					manual();
-					break;
-
-				case EDPS_CMD_COPY:
-					status = copy(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_DELETE:
-					status = delete(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_EDIT:
-					status = edit(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_END:
-					status = end(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_INSERT:
-					status = insert(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_LIST:
-					status = list(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_MOVE:
-					status = move(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_PAGE:
-					status = page(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_QUIT:
-					status = quit(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_REPLACE:
-					status = replace(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_SEARCH:
-					status = search(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_TRANSFER:
-					status = transfer(repl_state, ed_doc, instruction);
-					break;
-
-				case EDPS_CMD_WRITE:
-					status = write(repl_state, ed_doc, instruction);
-					break;
-
-			}
+			status = repl_exec(repl_state, ed_doc, instruction);
+			if(quiet && (status < 0) && (status != RET_ERR_NOTFOUND))
+				fprintf(stderr, "%s: Error in line %u of the input.\n", APP_NAME, line);
 		} while(parser_status == RET_MORE);
 
 		free(cmdline);
-		edps_free(parser_ctx);
 	}
 
+	edps_free(parser_ctx);
+	if(quiet) repl_summary(repl_state, ed_doc);
 	repl_free(repl_state);
 	return status;
 }
@@ -10,22 +10,64 @@
 #include <stdio.h>
 
 #include "dynarr.h"
+#include "parser.h"
+#include "snapshot.h"
 
 #define DEFAULT_CURSOR		"*"
 #define DEFAULT_PROMPT		"*"
 
+#define REPL_QUIET			1
+#define REPL_SILENT			2
+
+typedef struct repl_loader_t repl_loader_t;
+
+/* Takes lines of a file as they're read. */
+typedef int (*repl_sink_t)(void *ctx, dynarr_t *lines, const int maybe_binary);
+
 typedef struct ed_doc_t {
 	dynarr_t *lines_arr;
-	uint32_t n_lines;
+	uint64_t n_lines;
 	char *filename;
 	int no_write;
+
+	/* Only there while somebody reads the document from another thread. */
+	edsn_t *versions;
+
+	/* Only there while the file is still being read. */
+	repl_loader_t *loader;
 } ed_doc_t;
 
 void free_doc(ed_doc_t *doc);
-int save_doc(ed_doc_t *doc, const char *filename, const uint32_t start_line, const uint32_t end_line);
+int save_doc(ed_doc_t *doc, const char *filename, const uint64_t start_line, const uint64_t end_line);
 ed_doc_t *load_doc(FILE *fp, const char *filename, const int n_write);
+ed_doc_t *open_doc(FILE *fp, const char *filename, const int no_write);
 ed_doc_t *empty_doc(const char *filename);
+int write_doc(ed_doc_t *doc, FILE *fp);
+int repl_stream(FILE *fp, repl_sink_t sink, void *ctx);
+char *repl_replace_all(const char *line, const char *search, const char *replace, const int flags);
+
+typedef struct repl_state_t repl_state_t;
+
+repl_state_t *repl_init(const char *prompt, const char *cursor_marker);
+void repl_free(repl_state_t *state);
+void repl_set_text(repl_state_t *state, const char * const *lines, const size_t n_lines);
+void repl_set_input(repl_state_t *state, char *(*next_line)(void *ctx), void *ctx);
+void repl_set_quiet(repl_state_t *state, const int quiet);
+void repl_print_summary(const uint32_t n_commands, const uint32_t n_errors, const uint64_t n_lines, const char *filename);
+void repl_summary(const repl_state_t *state, ed_doc_t *document);
+void repl_count_skipped(repl_state_t *state, const uint32_t n_commands);
+void repl_count_error(repl_state_t *state);
+void repl_counts(const repl_state_t *state, uint32_t *n_commands, uint32_t *n_errors);
+uint64_t repl_cursor(const repl_state_t *state);
+int repl_done(const repl_state_t *state);
+int repl_wants_text(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr, uint64_t *max_lines);
+int repl_exec(repl_state_t *state, ed_doc_t *document, edps_instr_t *instr);
+int repl_reads_only(const edps_instr_t *instr);
+int repl_read(repl_state_t *state, const edsn_version_t *version, edps_instr_t *instr, FILE *out);
+int repl_snapshots(ed_doc_t *document);
+int repl_delete_group(repl_state_t *state, ed_doc_t *document, edps_instr_t *instrs, const size_t n_instrs);
+int repl_replace_group(repl_state_t *state, ed_doc_t *document, edps_instr_t *instrs, const size_t n_instrs);
 
-int repl_main(FILE *input, ed_doc_t *ed_doc, const char *prompt, const char *cursor_marker);
+int repl_main(FILE *input, ed_doc_t *ed_doc, const char *prompt, const char *cursor_marker, const int quiet);
 
 #endif
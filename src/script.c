@@ -0,0 +1,1524 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <time.h>
+#else
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "mem.h"
+
+#include "appinfo.h"
+#include "ermac.h"
+#include "fileio.h"
+#include "lines.h"
+#include "parser.h"
+#include "repl.h"
+#include "script.h"
+#include "search.h"
+#include "tasks.h"
+#include "util.h"
+
+#define EDSC_MAGIC			"EDSC"
+#define EDSC_VERSION		4
+#define EDSC_NONE			0xffffffff
+#define EDSC_EXTENSION		".edc"
+
+#define FNV_OFFSET			0xcbf29ce484222325ULL
+#define FNV_PRIME			0x100000001b3ULL
+
+#define READ_CHUNK			65536
+
+#define EDSC_TEXT			1
+#define EDSC_MAYBE			2
+#define EDSC_BAD			4
+
+#define EDSC_STEP_ONE		0
+#define EDSC_STEP_SKIP		1
+#define EDSC_STEP_DELETE	2
+#define EDSC_STEP_REPLACE	3
+
+#define EDSC_STAGE_REPLACE	0
+#define EDSC_STAGE_DELETE	1
+#define EDSC_STAGE_INSERT	2
+#define EDSC_STAGE_APPEND	3
+
+#define EDSC_STREAM_END		UINT64_MAX
+
+/* A compiled script is a single block of memory: a header, the
+   instructions, a table of text lines and a string pool that all of
+   them point into by offset. That block is also the cache file. */
+typedef struct edsc_header_t {
+	char magic[4];
+	uint32_t version;
+	uint64_t source_hash, body_hash;
+	uint32_t source_size;
+	uint32_t n_records, n_text, pool_size;
+} edsc_header_t;
+
+typedef struct edsc_record_t {
+	int64_t start_line, end_line, only_line, target_line;
+	int32_t command, global_cmd;
+	uint32_t repeat;
+	int32_t ask, nocase;
+	uint32_t search_str, replace_str, global_str, filename;
+
+	/* The command line, if this is the first instruction on it, and
+	   its number in the script. */
+	uint32_t source, line;
+
+	/* Lines of text for I, A and line edits, as far as that's known
+	   before the script runs. When it runs, the text is taken from the
+	   lines that follow, just like from stdin, so a command that fails
+	   leaves them to run as commands. */
+	uint32_t first_text, n_text;
+
+	/* EDSC_TEXT for a line that is the text of a command before it, and
+	   EDSC_MAYBE if that depends on how that command goes. EDSC_BAD for
+	   a line like that which isn't a command, where it stopped. */
+	uint32_t flags;
+} edsc_record_t;
+
+/* The optimizer doesn't change any records, it only groups them into
+   steps that run together. Without it, every record is a step. */
+typedef struct edsc_step_t {
+	uint32_t first, n_records;
+	int kind;
+} edsc_step_t;
+
+struct edsc_script_t {
+	void *blob;
+	size_t blob_size;
+
+	const edsc_header_t *header;
+	const edsc_record_t *records;
+	const uint32_t *text_offsets;
+	char *pool;
+
+	const char **text;
+
+	/* The lines of the script, where text is read from. */
+	const char **lines;
+	uint32_t n_lines;
+
+	edsc_step_t *steps;
+	uint32_t n_steps;
+};
+
+/* A streamed script is a row of stages, one per command, that every
+   line goes through in turn. A stage counts the lines that come by, so
+   it knows them by the numbers the command would see in the document,
+   and does its work on the ones in its range. */
+typedef struct edsc_stage_t {
+	const edsc_record_t *record;
+	int kind;
+	uint64_t start, end, seen;
+
+	/* Lines for I and A. */
+	const char * const *text;
+	uint32_t n_text;
+
+	int started, done, found, failed;
+} edsc_stage_t;
+
+typedef struct edsc_stream_t {
+	const edsc_script_t *script;
+	edsc_stage_t *stages;
+	uint32_t n_stages;
+
+	/* The stages from here on haven't come to their first line yet. Up
+	   to then, they pass every line on as it is, so the count of the
+	   first of them is everybody's. */
+	uint32_t dormant;
+
+	/* The next stage that isn't done, or somewhere before it. */
+	uint32_t *skip;
+
+	edio_writer_t *writer;
+	uint64_t n_out;
+} edsc_stream_t;
+
+typedef struct buf_t {
+	char *data;
+	size_t used, alloced;
+} buf_t;
+
+static int buf_append(buf_t *buf, const void *data, const size_t size) {
+	size_t new_size;
+	char *new_data;
+
+	if(size == 0) return RET_OK;
+
+	if(buf->used + size > buf->alloced) {
+		new_size = buf->alloced > 0 ? buf->alloced : 256;
+		while(new_size < buf->used + size)
+			new_size *= 2;
+
+		if((new_data = realloc(buf->data, new_size)) == NULL)
+			return RET_ERR_MALLOC;
+		buf->data = new_data;
+		buf->alloced = new_size;
+	}
+
+	memcpy(buf->data + buf->used, data, size);
+	buf->used += size;
+	return RET_OK;
+}
+
+static uint64_t hash_bytes(const char *source, const size_t size) {
+	uint64_t hash = FNV_OFFSET;
+	size_t i;
+
+	for(i = 0; i < size; i++) {
+		hash ^= (uint8_t)source[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+static char *read_file(const char *filename, size_t *size) {
+	char *data = NULL, *new_data;
+	size_t alloced = 0, n;
+	FILE *fp;
+
+	*size = 0;
+	if((fp = fopen(filename, "rb")) == NULL) return NULL;
+
+	for(;;) {
+		if(alloced - *size < READ_CHUNK) {
+			alloced = alloced > 0 ? alloced * 2 : READ_CHUNK;
+			if((new_data = realloc(data, alloced)) == NULL) {
+				free(data);
+				fclose(fp);
+				return NULL;
+			}
+			data = new_data;
+		}
+
+		if((n = fread(data + *size, 1, alloced - *size, fp)) == 0) break;
+		*size += n;
+	}
+
+	fclose(fp);
+	return data;
+}
+
+/**/
+
+/* Same rules as get_line(): a line ends at a newline, but if there is
+   a carriage return in it, at the last one of those. A trailing newline
+   leaves an empty last line, just like reading the script from stdin. */
+static int split_lines(const char *source, const size_t size, buf_t *pool, buf_t *lines) {
+	size_t pos = 0, line_end, cut;
+	uint32_t offset;
+	int status;
+
+	for(;;) {
+		line_end = pos;
+		while((line_end < size) && (source[line_end] != '\n'))
+			line_end++;
+
+		cut = line_end;
+		while((cut > pos) && (source[cut - 1] != '\r'))
+			cut--;
+		if(cut == pos) cut = line_end;
+		else cut--;
+
+		offset = pool->used;
+		if((status = buf_append(pool, source + pos, cut - pos)) != RET_OK) return status;
+		if((status = buf_append(pool, "", 1)) != RET_OK) return status;
+		if((status = buf_append(lines, &offset, sizeof(uint32_t))) != RET_OK) return status;
+
+		if(line_end >= size) break;
+		pos = line_end + 1;
+	}
+
+	return RET_OK;
+}
+
+static uint32_t pool_string(buf_t *pool, const char *str, int *status) {
+	uint32_t offset = pool->used;
+
+	if(str == NULL) return EDSC_NONE;
+	if((*status = buf_append(pool, str, strlen(str) + 1)) != RET_OK)
+		return EDSC_NONE;
+	return offset;
+}
+
+static int is_end_of_text(const char *line) {
+	return (line[0] == '.') && (line[1] == '\0');
+}
+
+/* How many of the lines that follow a command are its text, by the
+   same rules as repl_wants_text(). certain is cleared if that depends
+   on the document: a line edit only takes a line if the line is there. */
+static uint32_t count_text(const edps_instr_t *instr, const buf_t *pool,
+	const uint32_t *lines, const uint32_t next_line, const uint32_t n_lines, int *certain) {
+	uint32_t max_lines = n_lines - next_line, n = 0;
+
+	*certain = 1;
+	switch(instr->command) {
+		case EDPS_CMD_EDIT:
+			if((instr->only_line < 0) || (max_lines == 0))
+				return 0;
+			*certain = 0;
+			return 1;
+
+		case EDPS_CMD_APPEND:
+			if(instr->only_line == EDPS_THIS_LINE)
+				return 0;
+			if((instr->only_line == EDPS_NO_LINE) &&
+				((instr->start_line != EDPS_NO_LINE) || (instr->end_line != EDPS_NO_LINE)))
+				return 0;
+			if((instr->only_line >= 0) && ((uint64_t)instr->only_line + 1 < max_lines))
+				max_lines = instr->only_line + 1;
+			break;
+
+		case EDPS_CMD_INSERT:
+			if((instr->only_line == EDPS_NO_LINE) &&
+				((instr->start_line != EDPS_NO_LINE) || (instr->end_line != EDPS_NO_LINE)))
+				return 0;
+			break;
+
+		default:
+			return 0;
+	}
+
+	while(n < max_lines) {
+		if(is_end_of_text(pool->data + lines[next_line + n++]))
+			break;
+	}
+
+	return n;
+}
+
+static edsc_script_t *script_from_blob(void *blob, const size_t blob_size, int *status) {
+	edsc_script_t *out;
+	const edsc_header_t *header = blob;
+	uint8_t *bytes = blob;
+	size_t i;
+
+	*status = RET_ERR_MALLOC;
+	if((out = malloc(sizeof(edsc_script_t))) == NULL) return NULL;
+
+	out->blob = blob;
+	out->blob_size = blob_size;
+	out->header = header;
+	out->records = (const edsc_record_t*)(bytes + sizeof(edsc_header_t));
+	out->text_offsets = (const uint32_t*)(out->records + header->n_records);
+	out->pool = (char*)(out->text_offsets + header->n_text);
+	out->steps = NULL;
+	out->n_steps = 0;
+	out->n_lines = header->n_records > 0 ? out->records[header->n_records - 1].line : 0;
+
+	out->text = malloc((header->n_text + 1) * sizeof(char*));
+	out->lines = malloc((out->n_lines + 1) * sizeof(char*));
+	if((out->text == NULL) || (out->lines == NULL)) {
+		free(out->text);
+		free(out->lines);
+		free(out);
+		return NULL;
+	}
+	for(i = 0; i < header->n_text; i++)
+		out->text[i] = out->pool + out->text_offsets[i];
+	for(i = 0; i < header->n_records; i++) {
+		if(out->records[i].source != EDSC_NONE)
+			out->lines[out->records[i].line - 1] = out->pool + out->records[i].source;
+	}
+
+	*status = RET_OK;
+	return out;
+}
+
+static int check_offset(const uint32_t offset, const uint32_t pool_size) {
+	return (offset == EDSC_NONE) || (offset < pool_size);
+}
+
+/* Cache files come from outside, so they are checked before anything
+   points into them. */
+static int check_blob(const void *blob, const size_t blob_size, const uint64_t hash, const size_t source_size) {
+	const edsc_header_t *header = blob;
+	const edsc_record_t *records;
+	const uint32_t *text_offsets;
+	const char *pool;
+	size_t i;
+
+	if(blob_size < sizeof(edsc_header_t)) return RET_NO;
+	if(memcmp(header->magic, EDSC_MAGIC, 4)) return RET_NO;
+	if(header->version != EDSC_VERSION) return RET_NO;
+	if((header->source_hash != hash) || (header->source_size != source_size)) return RET_NO;
+
+	if(blob_size != sizeof(edsc_header_t) +
+		(size_t)header->n_records * sizeof(edsc_record_t) +
+		(size_t)header->n_text * sizeof(uint32_t) +
+		header->pool_size) return RET_NO;
+	if(hash_bytes((const char*)blob + sizeof(edsc_header_t), blob_size - sizeof(edsc_header_t)) != header->body_hash)
+		return RET_NO;
+
+	records = (const edsc_record_t*)((const uint8_t*)blob + sizeof(edsc_header_t));
+	text_offsets = (const uint32_t*)(records + header->n_records);
+	pool = (const char*)(text_offsets + header->n_text);
+
+	if((header->pool_size == 0) || (pool[header->pool_size - 1] != '\0')) return RET_NO;
+
+	for(i = 0; i < header->n_records; i++) {
+		if(!check_offset(records[i].search_str, header->pool_size) ||
+		   !check_offset(records[i].replace_str, header->pool_size) ||
+		   !check_offset(records[i].global_str, header->pool_size) ||
+		   !check_offset(records[i].filename, header->pool_size) ||
+		   !check_offset(records[i].source, header->pool_size))
+			return RET_NO;
+		if(((uint64_t)records[i].first_text + records[i].n_text) > header->n_text)
+			return RET_NO;
+
+		/* Every line of the script starts with a record that has it. */
+		if((records[i].line == (i > 0 ? records[i - 1].line : 0) + 1) && (records[i].source != EDSC_NONE))
+			continue;
+		if((i == 0) || (records[i].line != records[i - 1].line) || (records[i].source != EDSC_NONE))
+			return RET_NO;
+	}
+
+	for(i = 0; i < header->n_text; i++)
+		if(text_offsets[i] >= header->pool_size) return RET_NO;
+
+	return RET_YES;
+}
+
+/**/
+
+edsc_script_t *edsc_compile(const char *source, const size_t size, const char *prompt, int *status) {
+	buf_t pool = { 0 }, lines = { 0 }, records = { 0 }, text = { 0 }, blob = { 0 }, strings = { 0 };
+	edsc_header_t header;
+	edsc_record_t record, *fixup;
+	edps_ctx_t *parser_ctx = NULL;
+	edps_instr_t *instr;
+	uint32_t *line_offsets, n_lines, line, cmd_line, i, text_offset;
+	uint32_t text_pos, text_until = 0, maybe_until = 0, n_text;
+	int parser_status, first, is_text, maybe, certain;
+
+	if(status == NULL) return NULL;
+	*status = RET_ERR_NULLPO;
+	if(source == NULL) return NULL;
+
+	if((*status = split_lines(source, size, &pool, &lines)) != RET_OK)
+		goto fail;
+	line_offsets = (uint32_t*)lines.data;
+	n_lines = lines.used / sizeof(uint32_t);
+
+	/* One parser for all lines. The strings of the instructions are kept
+	   apart from the lines until the end, since the parser reads from the
+	   line pool and that must not move under it. */
+	if((parser_ctx = edps_new("", prompt, status)) == NULL)
+		goto fail;
+
+	/* Every line is compiled, even the ones that are text, since a
+	   command that fails leaves its text to run as commands. Only lines
+	   that are commands for sure have to be good ones. */
+	line = 0;
+	while(line < n_lines) {
+		is_text = line < text_until;
+		maybe = line < maybe_until;
+
+		if((*status = edps_restart(parser_ctx, pool.data + line_offsets[line])) != RET_OK)
+			goto fail;
+		edps_set_silent(parser_ctx, is_text || maybe);
+		cmd_line = ++line;
+		text_pos = line;
+
+		first = 1;
+		do {
+			memset(&record, 0, sizeof(edsc_record_t));
+			record.source = first ? line_offsets[cmd_line - 1] : EDSC_NONE;
+			record.line = cmd_line;
+			record.flags = (is_text ? EDSC_TEXT : 0) | (maybe ? EDSC_MAYBE : 0);
+			record.search_str = record.replace_str = record.global_str = record.filename = EDSC_NONE;
+			first = 0;
+
+			if((parser_status = edps_parse(parser_ctx)) != RET_OK) {
+				if(parser_status != RET_MORE) {
+					if(!is_text && !maybe) {
+						fprintf(stderr, "%s: Error in line %u of the script.\n", APP_NAME, cmd_line);
+						*status = parser_status;
+						goto fail;
+					}
+
+					/* Only an error if it ever runs as a command. */
+					record.command = EDPS_CMD_NONE;
+					record.flags |= EDSC_BAD;
+					*status = buf_append(&records, &record, sizeof(edsc_record_t));
+					break;
+				}
+			}
+			instr = edps_get_instr(parser_ctx);
+
+			record.start_line = instr->start_line;
+			record.end_line = instr->end_line;
+			record.only_line = instr->only_line;
+			record.target_line = instr->target_line;
+			record.command = instr->command;
+			record.global_cmd = instr->global_cmd;
+			record.repeat = instr->repeat;
+			record.ask = instr->ask;
+			record.nocase = instr->nocase;
+
+			record.search_str = pool_string(&strings, instr->search_str, status);
+			if(*status != RET_OK) break;
+			record.replace_str = pool_string(&strings, instr->replace_str, status);
+			if(*status != RET_OK) break;
+			record.global_str = pool_string(&strings, instr->global_str, status);
+			if(*status != RET_OK) break;
+			record.filename = pool_string(&strings, instr->filename, status);
+			if(*status != RET_OK) break;
+
+			/* The text this command would take if it ran. The lines it
+			   is in doubt about are in doubt for every command that
+			   follows up to them, too. */
+			n_text = count_text(instr, &pool, line_offsets, text_pos, n_lines, &certain);
+			if(!is_text) {
+				record.first_text = text.used / sizeof(uint32_t);
+				record.n_text = n_text;
+				for(i = 0; (i < n_text) && (*status == RET_OK); i++) {
+					text_offset = line_offsets[text_pos + i];
+					*status = buf_append(&text, &text_offset, sizeof(uint32_t));
+				}
+				if(*status != RET_OK) break;
+			}
+			if((!is_text || maybe) && ((!certain || maybe) && (text_pos + n_text > maybe_until)))
+				maybe_until = text_pos + n_text;
+			if(!is_text || maybe) text_pos += n_text;
+
+			if((*status = buf_append(&records, &record, sizeof(edsc_record_t))) != RET_OK)
+				break;
+		} while(parser_status == RET_MORE);
+
+		if(*status != RET_OK) goto fail;
+		if(!is_text) text_until = text_pos;
+	}
+
+	edps_free(parser_ctx);
+	parser_ctx = NULL;
+
+	fixup = (edsc_record_t*)records.data;
+	for(i = 0; i < records.used / sizeof(edsc_record_t); i++) {
+		if(fixup[i].search_str != EDSC_NONE) fixup[i].search_str += pool.used;
+		if(fixup[i].replace_str != EDSC_NONE) fixup[i].replace_str += pool.used;
+		if(fixup[i].global_str != EDSC_NONE) fixup[i].global_str += pool.used;
+		if(fixup[i].filename != EDSC_NONE) fixup[i].filename += pool.used;
+	}
+	if((strings.used > 0) && ((*status = buf_append(&pool, strings.data, strings.used)) != RET_OK))
+		goto fail;
+
+	memcpy(header.magic, EDSC_MAGIC, 4);
+	header.version = EDSC_VERSION;
+	header.source_hash = hash_bytes(source, size);
+	header.source_size = size;
+	header.n_records = records.used / sizeof(edsc_record_t);
+	header.n_text = text.used / sizeof(uint32_t);
+	header.pool_size = pool.used;
+	header.body_hash = 0;
+
+	if(((*status = buf_append(&blob, &header, sizeof(edsc_header_t))) != RET_OK) ||
+	   ((*status = buf_append(&blob, records.data, records.used)) != RET_OK) ||
+	   ((*status = buf_append(&blob, text.data, text.used)) != RET_OK) ||
+	   ((*status = buf_append(&blob, pool.data, pool.used)) != RET_OK))
+		goto fail;
+
+	((edsc_header_t*)blob.data)->body_hash =
+		hash_bytes(blob.data + sizeof(edsc_header_t), blob.used - sizeof(edsc_header_t));
+
+	free(pool.data);
+	free(lines.data);
+	free(records.data);
+	free(text.data);
+	free(strings.data);
+
+	return script_from_blob(blob.data, blob.used, status);
+
+fail:
+	edps_free(parser_ctx);
+	free(pool.data);
+	free(lines.data);
+	free(records.data);
+	free(text.data);
+	free(strings.data);
+	free(blob.data);
+	return NULL;
+}
+
+int edsc_save(const edsc_script_t *script, const char *filename) {
+	FILE *fp;
+	size_t written;
+
+	if((script == NULL) || (filename == NULL)) return RET_ERR_NULLPO;
+
+	if((fp = fopen(filename, "wb")) == NULL) return RET_ERR_OPEN;
+	written = fwrite(script->blob, 1, script->blob_size, fp);
+	if(fclose(fp) || (written != script->blob_size)) {
+		remove(filename);
+		return RET_ERR_WRITE;
+	}
+
+	return RET_OK;
+}
+
+static char *cache_name(const char *cache_dir, const uint64_t hash) {
+	size_t size;
+	char *out;
+
+	size = strlen(cache_dir) + 1 + 16 + strlen(EDSC_EXTENSION) + 1;
+	if((out = malloc(size)) == NULL) return NULL;
+	snprintf(out, size, "%s/%016llx%s", cache_dir, (unsigned long long)hash, EDSC_EXTENSION);
+	return out;
+}
+
+/* Writes the cache file under a name nobody else uses and then renames
+   it, so that runs in parallel never see half a cache file, nor write
+   into each other's. */
+static int save_cache(const edsc_script_t *script, const char *cache_file) {
+	char *tmp_file;
+	size_t written;
+	FILE *fp = NULL;
+	int status = RET_OK;
+#ifndef _WIN32
+	mode_t mask;
+	int fd;
+#endif
+
+	if((tmp_file = malloc(strlen(cache_file) + 8)) == NULL) return RET_ERR_MALLOC;
+	sprintf(tmp_file, "%s.XXXXXX", cache_file);
+
+#ifdef _WIN32
+	if(_mktemp_s(tmp_file, strlen(tmp_file) + 1) == 0)
+		fp = fopen(tmp_file, "wb");
+#else
+	if((fd = mkstemp(tmp_file)) >= 0) {
+		/* As readable as fopen() would have made it. Scripts are loaded
+		   before any threads are started. */
+		mask = umask(0);
+		umask(mask);
+		fchmod(fd, 0666 & ~mask);
+
+		if((fp = fdopen(fd, "wb")) == NULL) {
+			close(fd);
+			remove(tmp_file);
+		}
+	}
+#endif
+	if(fp == NULL) {
+		free(tmp_file);
+		return RET_ERR_OPEN;
+	}
+
+	written = fwrite(script->blob, 1, script->blob_size, fp);
+	if(fclose(fp) || (written != script->blob_size)) status = RET_ERR_WRITE;
+	else if(rename(tmp_file, cache_file)) status = RET_ERR_WRITE;
+
+	if(status != RET_OK) remove(tmp_file);
+	free(tmp_file);
+	return status;
+}
+
+/* Compiles a script file, or picks it up from the cache directory if it
+   was compiled before. A cache that can't be read or written is not an
+   error; the script just gets compiled. */
+edsc_script_t *edsc_load(const char *filename, const char *cache_dir, const char *prompt, int *status) {
+	edsc_script_t *out = NULL;
+	char *source, *cache_file = NULL, *blob;
+	size_t size, blob_size;
+	uint64_t hash;
+
+	if(status == NULL) return NULL;
+
+	*status = RET_ERR_OPEN;
+	if((source = read_file(filename, &size)) == NULL) {
+		fprintf(stderr, "%s: Couldn't read the script '%s'.\n", APP_NAME, filename);
+		return NULL;
+	}
+
+	if(cache_dir != NULL) {
+		hash = hash_bytes(source, size);
+		if((cache_file = cache_name(cache_dir, hash)) == NULL) {
+			*status = RET_ERR_MALLOC;
+			goto done;
+		}
+
+		if((blob = read_file(cache_file, &blob_size)) != NULL) {
+			if(check_blob(blob, blob_size, hash, size) == RET_YES) {
+				out = script_from_blob(blob, blob_size, status);
+				if(out == NULL) free(blob);
+				goto done;
+			}
+			free(blob);
+		}
+	}
+
+	if((out = edsc_compile(source, size, prompt, status)) == NULL)
+		goto done;
+
+	if((cache_file != NULL) && (save_cache(out, cache_file) != RET_OK))
+		fprintf(stderr, "%s: Couldn't write the script cache '%s'.\n", APP_NAME, cache_file);
+
+done:
+	free(cache_file);
+	free(source);
+	return out;
+}
+
+void edsc_free(edsc_script_t *script) {
+	if(script == NULL) return;
+
+	free(script->steps);
+	free(script->text);
+	free(script->lines);
+	free(script->blob);
+	free(script);
+}
+
+/**/
+
+static void load_instr(const edsc_script_t *script, const edsc_record_t *record, edps_instr_t *instr) {
+	instr->start_line = record->start_line;
+	instr->end_line = record->end_line;
+	instr->only_line = record->only_line;
+	instr->target_line = record->target_line;
+	instr->command = record->command;
+	instr->global_cmd = record->global_cmd;
+	instr->repeat = record->repeat;
+	instr->ask = record->ask;
+	instr->nocase = record->nocase;
+
+	instr->search_str = record->search_str == EDSC_NONE ? NULL : script->pool + record->search_str;
+	instr->replace_str = record->replace_str == EDSC_NONE ? NULL : script->pool + record->replace_str;
+	instr->global_str = record->global_str == EDSC_NONE ? NULL : script->pool + record->global_str;
+	instr->filename = record->filename == EDSC_NONE ? NULL : script->pool + record->filename;
+}
+
+/* An R can only join others if it doesn't depend on anything an R
+   before it changes: the cursor or the last search string. */
+static int fusable_replace(const edsc_script_t *script, const edsc_record_t *record) {
+	return (record->command == EDPS_CMD_REPLACE) && (record->ask != RET_YES) &&
+		(record->start_line >= 0) && (record->end_line >= record->start_line) &&
+		(record->search_str != EDSC_NONE) && (script->pool[record->search_str] != '\0') &&
+		(record->replace_str != EDSC_NONE) && (script->pool[record->replace_str] != '\0');
+}
+
+static int same_range(const edsc_record_t *a, const edsc_record_t *b) {
+	return (a->start_line == b->start_line) && (a->end_line == b->end_line) &&
+		(a->only_line == b->only_line);
+}
+
+/* Ws with a range don't write anything. */
+static int writes_file(const edsc_record_t *record) {
+	return (record->command == EDPS_CMD_WRITE) &&
+		((record->only_line != EDPS_NO_LINE) ||
+		 ((record->start_line == EDPS_NO_LINE) && (record->end_line == EDPS_NO_LINE)));
+}
+
+static const char *written_file(const edsc_script_t *script, const edsc_record_t *record, const char *doc_filename) {
+	if((record->command == EDPS_CMD_WRITE) && (record->filename != EDSC_NONE))
+		return script->pool + record->filename;
+	return doc_filename;
+}
+
+/* Length of the group of records starting at first that can run as one
+   step, or 0 if there is none. Empty lines in between go along. */
+static uint32_t group_size(const edsc_script_t *script, const uint32_t first, uint32_t *n_commands) {
+	const edsc_record_t *records = script->records, *head = &records[first];
+	uint32_t i, last = first;
+
+	*n_commands = 1;
+	if(head->flags != 0) return 0;
+	if((head->command != EDPS_CMD_DELETE) && !fusable_replace(script, head))
+		return 0;
+
+	/* Lines that might be text end it. */
+	for(i = first + 1; i < script->header->n_records; i++) {
+		if(records[i].flags != 0) break;
+		if(records[i].command == EDPS_CMD_NONE)
+			continue;
+
+		if(head->command == EDPS_CMD_DELETE) {
+			if(records[i].command != EDPS_CMD_DELETE) break;
+		} else {
+			if(!fusable_replace(script, &records[i]) || !same_range(head, &records[i])) break;
+		}
+
+		(*n_commands)++;
+		last = i;
+	}
+
+	return *n_commands > 1 ? last - first + 1 : 0;
+}
+
+/* Line of the W or E that writes the same file again before anybody
+   could have read it, or 0. */
+static uint32_t overwritten_in(const edsc_script_t *script, const uint32_t index, const char *doc_filename) {
+	const edsc_record_t *records = script->records;
+	const char *filename, *other;
+	uint32_t i;
+
+	if((records[index].flags != 0) || !writes_file(&records[index])) return 0;
+	if((filename = written_file(script, &records[index], doc_filename)) == NULL) return 0;
+
+	/* Text doesn't do anything. A line that might be text might not be
+	   run, so it can't be counted on. */
+	for(i = index + 1; i < script->header->n_records; i++) {
+		if(records[i].flags & EDSC_MAYBE) {
+			switch(records[i].command) {
+				case EDPS_CMD_TRANSFER:
+				case EDPS_CMD_QUIT:
+				case EDPS_CMD_END:
+				case EDPS_CMD_WRITE:
+					return 0;
+
+				default:
+					continue;
+			}
+		}
+		if(records[i].flags & EDSC_TEXT) continue;
+
+		switch(records[i].command) {
+			case EDPS_CMD_TRANSFER:
+			case EDPS_CMD_QUIT:
+				return 0;
+
+			case EDPS_CMD_END:
+				if((doc_filename != NULL) && !strcmp(filename, doc_filename))
+					return records[i].line;
+				return 0;
+
+			case EDPS_CMD_WRITE:
+				other = written_file(script, &records[i], doc_filename);
+				if(writes_file(&records[i]) && (other != NULL) && !strcmp(filename, other))
+					return records[i].line;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return 0;
+}
+
+static void report_lines(FILE *report, const uint32_t first, const uint32_t last) {
+	if(first == last)
+		fprintf(report, "%s: Line %u: ", APP_NAME, first);
+	else
+		fprintf(report, "%s: Lines %u-%u: ", APP_NAME, first, last);
+}
+
+/* Looks for instructions that can run together or not at all without
+   changing what the script does to the file: rows of D become one
+   splice, rows of R on the same lines become one pass over them, and
+   a W is dropped if the same file gets written again anyway. Without
+   doc_filename, nothing is known about where a bare W or E writes,
+   so those are never dropped or taken for a later write. */
+int edsc_optimize(edsc_script_t *script, const char *doc_filename, FILE *report) {
+	const edsc_record_t *records;
+	edsc_step_t *steps;
+	uint32_t i, n_records, n_steps = 0, size, n_commands, line;
+
+	if(script == NULL) return RET_ERR_NULLPO;
+	records = script->records;
+	n_records = script->header->n_records;
+
+	if((steps = malloc((n_records + 1) * sizeof(edsc_step_t))) == NULL)
+		return RET_ERR_MALLOC;
+
+	for(i = 0; i < n_records; i += steps[n_steps++].n_records) {
+		steps[n_steps].first = i;
+		steps[n_steps].n_records = 1;
+		steps[n_steps].kind = EDSC_STEP_ONE;
+
+		if((size = group_size(script, i, &n_commands)) > 0) {
+			steps[n_steps].n_records = size;
+			if(records[i].command == EDPS_CMD_DELETE) {
+				steps[n_steps].kind = EDSC_STEP_DELETE;
+				if(report != NULL) {
+					report_lines(report, records[i].line, records[i + size - 1].line);
+					fprintf(report, "%u deletes in one splice.\n", n_commands);
+				}
+			} else {
+				steps[n_steps].kind = EDSC_STEP_REPLACE;
+				if(report != NULL) {
+					report_lines(report, records[i].line, records[i + size - 1].line);
+					fprintf(report, "%u replaces on lines %lld-%lld in one pass.\n", n_commands,
+						(long long)records[i].start_line + 1, (long long)records[i].end_line + 1);
+				}
+			}
+		} else if((line = overwritten_in(script, i, doc_filename)) > 0) {
+			steps[n_steps].kind = EDSC_STEP_SKIP;
+			if(report != NULL) {
+				report_lines(report, records[i].line, records[i].line);
+				fprintf(report, "W dropped, line %u writes '%s' again.\n", line,
+					written_file(script, &records[i], doc_filename));
+			}
+		}
+	}
+
+	if(report != NULL)
+		fprintf(report, "%s: %u instructions in %u steps.\n", APP_NAME, n_records, n_steps);
+
+	free(script->steps);
+	script->steps = steps;
+	script->n_steps = n_steps;
+	return RET_OK;
+}
+
+static int run_group(const edsc_script_t *script, const edsc_step_t *step, repl_state_t *state, ed_doc_t *document) {
+	edps_instr_t *instrs;
+	uint32_t i, n = 0;
+	int status;
+
+	if((instrs = malloc(step->n_records * sizeof(edps_instr_t))) == NULL)
+		return RET_ERR_MALLOC;
+
+	for(i = step->first; i < step->first + step->n_records; i++) {
+		if(script->records[i].command != EDPS_CMD_NONE)
+			load_instr(script, &script->records[i], &instrs[n++]);
+	}
+
+	if(step->kind == EDSC_STEP_DELETE)
+		status = repl_delete_group(state, document, instrs, n);
+	else
+		status = repl_replace_group(state, document, instrs, n);
+
+	free(instrs);
+	return status;
+}
+
+/* Where a running script is: the line that's running, and the last
+   line that was taken, as a command or as text. */
+typedef struct edsc_input_t {
+	const edsc_script_t *script;
+	uint32_t line, taken;
+	const char *prompt;
+	edps_ctx_t *parser;
+} edsc_input_t;
+
+/* Text for I, A and line edits is the next line of the script, just
+   like it's the next line of stdin. The script ends the text. */
+static char *script_line(void *ctx) {
+	edsc_input_t *input = ctx;
+
+	if(input->taken >= input->script->n_lines) return NULL;
+	return str_alloc_copy(input->script->lines[input->taken++]);
+}
+
+/* Whether the record is on a line that was taken as text. */
+static int taken_as_text(const edsc_input_t *input, const edsc_record_t *record) {
+	return (record->line != input->line) && (record->line <= input->taken);
+}
+
+/* A line that isn't a command only turns out to be run as one now. It's
+   parsed again, to say where it's wrong. */
+static void bad_line(edsc_input_t *input, repl_state_t *state, const edsc_record_t *record, const int quiet) {
+	int status;
+
+	if((input->parser != NULL) || ((input->parser = edps_new("", input->prompt, &status)) != NULL)) {
+		if(edps_restart(input->parser, input->script->lines[record->line - 1]) == RET_OK)
+			while(edps_parse(input->parser) == RET_MORE);
+	}
+
+	print_error(RET_ERR_SYNTAX);
+	repl_count_error(state);
+	if(quiet) print_message("Error in line %u of the script.", record->line);
+}
+
+/* Echoes the command lines of a step and runs it. Sets ended if an
+   earlier command ended the editor before this step began. Lines that
+   were taken as text are left out. */
+static int run_step(edsc_input_t *input, const edsc_step_t *step, repl_state_t *state,
+	ed_doc_t *document, const int quiet, int *ended) {
+	const edsc_script_t *script = input->script;
+	const edsc_record_t *record;
+	edps_instr_t instr;
+	uint32_t j;
+	int status = RET_OK;
+
+	for(j = step->first; j < step->first + step->n_records; j++) {
+		record = &script->records[j];
+		if(taken_as_text(input, record)) return RET_OK;
+		if(record->source != EDSC_NONE) {
+			if(repl_done(state)) {
+				*ended = 1;
+				return RET_OK;
+			}
+			input->line = input->taken = record->line;
+			if(!quiet) printf("%s%s\n", input->prompt, script->pool + record->source);
+		}
+	}
+
+	switch(step->kind) {
+		case EDSC_STEP_ONE:
+			record = &script->records[step->first];
+			if(record->flags & EDSC_BAD) {
+				bad_line(input, state, record, quiet);
+				break;
+			}
+			load_instr(script, record, &instr);
+			status = repl_exec(state, document, &instr);
+			if(quiet && (status < 0) && (status != RET_ERR_NOTFOUND))
+				print_message("Error in line %u of the script.", record->line);
+			break;
+
+		case EDSC_STEP_SKIP:
+			for(j = step->first; j < step->first + step->n_records; j++) {
+				if(script->records[j].command != EDPS_CMD_NONE)
+					repl_count_skipped(state, 1);
+			}
+			break;
+
+		default:
+			status = run_group(script, step, state, document);
+			break;
+	}
+
+	return status;
+}
+
+/* Runs the instructions as if the script had been typed in: every
+   command line is echoed after the prompt, and the editor stops at the
+   first line after a command that ended it. A quiet run echoes nothing
+   and only tells which lines failed, and how it went in the end, or
+   leaves the last part to the caller if it asked for the counts. */
+static int run_script(const edsc_script_t *script, ed_doc_t *document, const char *prompt,
+	const char *cursor_marker, const int quiet, edsc_outcome_t *outcome) {
+	repl_state_t *state;
+	edsc_input_t input;
+	edsc_step_t step, one;
+	uint32_t i, j, n_steps;
+	int status = RET_OK, step_status, ended = 0;
+
+	if((script == NULL) || (document == NULL)) return RET_ERR_NULLPO;
+
+	if((state = repl_init(prompt, cursor_marker)) == NULL)
+		return RET_ERR_INTERNAL;
+	if(prompt == NULL) prompt = DEFAULT_PROMPT;
+	repl_set_quiet(state, quiet);
+
+	input.script = script;
+	input.line = input.taken = 0;
+	input.prompt = prompt;
+	input.parser = NULL;
+	repl_set_input(state, script_line, &input);
+
+	n_steps = script->steps != NULL ? script->n_steps : script->header->n_records;
+	for(i = 0; i < n_steps; i++) {
+		if(script->steps != NULL) {
+			step = script->steps[i];
+		} else {
+			step.first = i;
+			step.n_records = 1;
+			step.kind = EDSC_STEP_ONE;
+		}
+
+		/* A merged R lists the lines it changes as it goes, for all of
+		   its commands at once. Only a quiet run, which lists nothing,
+		   gets to merge them. */
+		if(!quiet && (step.kind == EDSC_STEP_REPLACE)) {
+			for(j = step.first; (j < step.first + step.n_records) && !ended; j++) {
+				one.first = j;
+				one.n_records = 1;
+				one.kind = EDSC_STEP_ONE;
+				step_status = run_step(&input, &one, state, document, quiet, &ended);
+				if(!ended) status = step_status;
+			}
+		} else {
+			step_status = run_step(&input, &step, state, document, quiet, &ended);
+			if(!ended) status = step_status;
+		}
+		if(ended) goto done;
+	}
+
+done:
+	if(outcome != NULL) {
+		repl_counts(state, &outcome->n_commands, &outcome->n_errors);
+		outcome->n_lines = document->n_lines;
+	} else if(quiet) {
+		repl_summary(state, document);
+	}
+	edps_free(input.parser);
+	repl_free(state);
+	return status;
+}
+
+int edsc_run(const edsc_script_t *script, ed_doc_t *document, const char *prompt,
+	const char *cursor_marker, const int quiet) {
+	return run_script(script, document, prompt, cursor_marker, quiet, NULL);
+}
+
+/**/
+
+static double now(void) {
+#ifdef _WIN32
+	return (double)clock() / CLOCKS_PER_SEC;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+#endif
+}
+
+typedef struct edsc_batch_t {
+	const edsc_script_t *script;
+	const char * const *files;
+	const char *prompt, *cursor_marker;
+	int no_write;
+	edsc_outcome_t *outcomes;
+} edsc_batch_t;
+
+/* One file from start to end, all on the worker it was given to: loaded,
+   run quietly and let go of again. */
+static int batch_body(void *ctx, const size_t start, const size_t end, const unsigned worker) {
+	edsc_batch_t *batch = ctx;
+	edsc_outcome_t *outcome;
+	ed_doc_t *document;
+	double started;
+	FILE *fp;
+	size_t i;
+
+	for(i = start; i < end; i++) {
+		outcome = &batch->outcomes[i];
+		started = now();
+		set_error_source(batch->files[i]);
+
+		if((fp = fopen(batch->files[i], "rb")) == NULL) {
+			outcome->status = RET_ERR_OPEN;
+		} else {
+			document = load_doc(fp, batch->files[i], batch->no_write);
+			fclose(fp);
+
+			if(document == NULL) {
+				outcome->status = RET_ERR_READ;
+			} else {
+				run_script(batch->script, document, batch->prompt, batch->cursor_marker, REPL_QUIET, outcome);
+				outcome->status = RET_OK;
+				free_doc(document);
+			}
+		}
+
+		outcome->seconds = now() - started;
+		set_error_source(NULL);
+	}
+
+	return RET_OK;
+}
+
+/* Whether the script puts anything on stdout when it's run quietly.
+   The lines of different files would end up mixed if it did. */
+static int prints(const edsc_script_t *script) {
+	uint32_t i;
+
+	for(i = 0; i < script->header->n_records; i++) {
+		if((script->records[i].flags & (EDSC_TEXT | EDSC_MAYBE)) == EDSC_TEXT) continue;
+
+		switch(script->records[i].command) {
+			case EDPS_CMD_ASK:
+			case EDPS_CMD_COUNT:
+			case EDPS_CMD_FIND:
+			case EDPS_CMD_LIST:
+			case EDPS_CMD_PAGE:
+			case EDPS_CMD_SEARCH:
+				return RET_YES;
+			default:
+				break;
+		}
+	}
+
+	return RET_NO;
+}
+
+/* Runs the script on every one of the files, as many at a time as
+   there are workers, or one after the other if it prints, and tells how
+   it went for each of them, in the order they were given, and for all
+   of them together. RET_OK if all of them could be loaded. */
+int edsc_batch(const edsc_script_t *script, const char * const *files, const size_t n_files,
+	const char *prompt, const char *cursor_marker, const int no_write) {
+	edsc_batch_t batch;
+	edsc_outcome_t *outcome;
+	size_t i, n_failed = 0;
+	uint64_t n_errors = 0;
+	double started, work = 0;
+	char *errstr;
+	int status;
+
+	if((script == NULL) || (files == NULL)) return RET_ERR_NULLPO;
+
+	batch.script = script;
+	batch.files = files;
+	batch.prompt = prompt;
+	batch.cursor_marker = cursor_marker;
+	batch.no_write = no_write;
+	if((batch.outcomes = calloc(n_files > 0 ? n_files : 1, sizeof(edsc_outcome_t))) == NULL)
+		return print_error(RET_ERR_MALLOC);
+
+	started = now();
+	if(prints(script) == RET_YES)
+		status = batch_body(&batch, 0, n_files, 0);
+	else
+		status = edtk_for(0, n_files, 1, batch_body, &batch, NULL);
+	if(status != RET_OK) {
+		free(batch.outcomes);
+		return print_error(status);
+	}
+
+	for(i = 0; i < n_files; i++) {
+		outcome = &batch.outcomes[i];
+		work += outcome->seconds;
+
+		if(outcome->status != RET_OK) {
+			n_failed++;
+			errstr = str_error(outcome->status);
+			fprintf(stderr, "%s: '%s': %s.\n", APP_NAME, files[i], errstr != NULL ? errstr : "Failed");
+			free(errstr);
+			continue;
+		}
+
+		n_errors += outcome->n_errors;
+		fprintf(stderr, "%s: '%s': %u command%s, %u error%s, %" PRIu64 " line%s, %.1f ms.\n", APP_NAME, files[i],
+			outcome->n_commands, outcome->n_commands == 1 ? "" : "s",
+			outcome->n_errors, outcome->n_errors == 1 ? "" : "s",
+			outcome->n_lines, outcome->n_lines == 1 ? "" : "s",
+			outcome->seconds * 1000);
+	}
+
+	fprintf(stderr, "%s: %zu file%s, %zu failed, %llu error%s, %.2f s (%.2f s of work on %u thread%s).\n", APP_NAME,
+		n_files, n_files == 1 ? "" : "s", n_failed,
+		(unsigned long long)n_errors, n_errors == 1 ? "" : "s",
+		now() - started, work, edtk_workers(), edtk_workers() == 1 ? "" : "s");
+
+	free(batch.outcomes);
+	return n_failed > 0 ? RET_ERR_OPEN : RET_OK;
+}
+
+/**/
+
+/* The text an I or A puts in, which is all of its lines up to the '.'. */
+static void stage_text(const edsc_script_t *script, const edsc_record_t *record, edsc_stage_t *stage) {
+	stage->text = script->text + record->first_text;
+	stage->n_text = record->n_text;
+	if((stage->n_text > 0) && is_end_of_text(stage->text[stage->n_text - 1]))
+		stage->n_text--;
+}
+
+/* A script streams if all of its commands are R, D, I and A on lines
+   that don't depend on the cursor, each starting no earlier than the
+   one before it. Then no line is needed again once it's been past all
+   of the stages that are working, and a stage only starts once all of
+   those before it have. RET_NO for any other script. */
+static int plan_stream(const edsc_script_t *script, edsc_stream_t *stream) {
+	const edsc_record_t *record;
+	edsc_stage_t *stage;
+	uint64_t floor = 0;
+	uint32_t i;
+
+	for(i = 0; i < script->header->n_records; i++) {
+		record = &script->records[i];
+		if(record->flags & EDSC_MAYBE) return RET_NO;
+		if((record->flags & EDSC_TEXT) || (record->command == EDPS_CMD_NONE)) continue;
+
+		stage = &stream->stages[stream->n_stages++];
+		memset(stage, 0, sizeof(edsc_stage_t));
+		stage->record = record;
+		stage->end = EDSC_STREAM_END;
+
+		switch(record->command) {
+			case EDPS_CMD_REPLACE:
+				if(!fusable_replace(script, record)) return RET_NO;
+				stage->kind = EDSC_STAGE_REPLACE;
+				stage->start = record->start_line;
+				stage->end = record->end_line;
+				break;
+
+			case EDPS_CMD_DELETE:
+				if(record->end_line < record->start_line) return RET_NO;
+				stage->kind = EDSC_STAGE_DELETE;
+				if(record->only_line != EDPS_NO_LINE) {
+					if(record->only_line < 0) return RET_NO;
+					stage->start = stage->end = record->only_line;
+				} else if((record->start_line == EDPS_NO_LINE) && (record->end_line >= 0)) {
+					stage->end = record->end_line;
+				} else if((record->start_line >= 0) && (record->end_line >= 0)) {
+					stage->start = record->start_line;
+					stage->end = record->end_line;
+				} else {
+					return RET_NO;
+				}
+				break;
+
+			case EDPS_CMD_INSERT:
+				if((record->end_line < record->start_line) || (record->only_line < 0)) return RET_NO;
+				stage->kind = EDSC_STAGE_INSERT;
+				stage->start = record->only_line;
+				stage_text(script, record, stage);
+				break;
+
+			case EDPS_CMD_APPEND:
+				if((record->only_line == EDPS_NO_LINE) &&
+					((record->start_line != EDPS_NO_LINE) || (record->end_line != EDPS_NO_LINE))) return RET_NO;
+				if((record->only_line != EDPS_NO_LINE) && (record->only_line < 0)) return RET_NO;
+
+				/* It only does anything at the end, so it can start
+				   along with the one before it. */
+				stage->kind = EDSC_STAGE_APPEND;
+				stage->start = floor;
+				stage_text(script, record, stage);
+				break;
+
+			default:
+				return RET_NO;
+		}
+
+		if(stage->start < floor) return RET_NO;
+		floor = stage->start;
+	}
+
+	return RET_OK;
+}
+
+static uint32_t live_stage(edsc_stream_t *stream, uint32_t k) {
+	uint32_t next;
+
+	while((k < stream->n_stages) && (stream->skip[k] != k)) {
+		next = stream->skip[k];
+		stream->skip[k] = stream->skip[next];
+		k = next;
+	}
+
+	return k;
+}
+
+static void start_stage(edsc_stream_t *stream, const uint32_t k) {
+	stream->stages[k].started = 1;
+	stream->dormant = k + 1;
+	if(k + 1 < stream->n_stages)
+		stream->stages[k + 1].seen = stream->stages[k].seen;
+}
+
+static void finish_stage(edsc_stream_t *stream, const uint32_t k) {
+	stream->stages[k].done = 1;
+	stream->skip[k] = k + 1;
+}
+
+static int emit(edsc_stream_t *stream, char *line) {
+	int status = RET_OK;
+
+	if(stream->n_out++ > 0) status = edio_write(stream->writer, "\n", 1);
+	if(status == RET_OK) status = edio_write(stream->writer, line, strlen(line));
+	edln_free(line);
+	return status;
+}
+
+static int push(edsc_stream_t *stream, uint32_t k, char *line);
+
+static int insert_text(edsc_stream_t *stream, const uint32_t k) {
+	const edsc_stage_t *stage = &stream->stages[k];
+	char *copy;
+	uint32_t i;
+	int status;
+
+	for(i = 0; i < stage->n_text; i++) {
+		if((copy = str_alloc_copy(stage->text[i])) == NULL) return RET_ERR_MALLOC;
+		if((status = push(stream, k + 1, copy)) != RET_OK) return status;
+	}
+
+	return RET_OK;
+}
+
+/* Takes a line through the stages from k on, and out if it's left. */
+static int push(edsc_stream_t *stream, uint32_t k, char *line) {
+	const edsc_script_t *script = stream->script;
+	const edsc_record_t *record;
+	edsc_stage_t *stage;
+	char *edited;
+	uint64_t index;
+	int status;
+
+	for(k = live_stage(stream, k); k < stream->n_stages; k = live_stage(stream, k + 1)) {
+		stage = &stream->stages[k];
+		if(k == stream->dormant) {
+			if(stage->seen < stage->start) {
+				stage->seen++;
+				break;
+			}
+			start_stage(stream, k);
+		}
+		index = stage->seen++;
+
+		switch(stage->kind) {
+			case EDSC_STAGE_REPLACE:
+				record = stage->record;
+				edited = repl_replace_all(line, script->pool + record->search_str,
+					script->pool + record->replace_str, record->nocase ? EDSR_NOCASE : 0);
+				if(edited != NULL) {
+					edln_free(line);
+					line = edited;
+					stage->found = 1;
+				}
+				if(index == stage->end) finish_stage(stream, k);
+				break;
+
+			case EDSC_STAGE_DELETE:
+				if(index == stage->end) finish_stage(stream, k);
+				edln_free(line);
+				return RET_OK;
+
+			case EDSC_STAGE_INSERT:
+				finish_stage(stream, k);
+				if((status = insert_text(stream, k)) != RET_OK) {
+					edln_free(line);
+					return status;
+				}
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return emit(stream, line);
+}
+
+static int take_block(void *ctx, dynarr_t *lines, const int maybe_binary) {
+	edsc_stream_t *stream = ctx;
+	size_t i, n_lines = dynarr_get_size(lines);
+	char **line;
+	int status = RET_OK;
+
+	for(i = 0; i < n_lines; i++) {
+		if((line = dynarr_get_element(lines, i)) == NULL) continue;
+		if(status == RET_OK)
+			status = push(stream, 0, *line);
+		else
+			edln_free(*line);
+	}
+	if(n_lines > 0) dynarr_delete(lines, 0, n_lines - 1);
+
+	return status;
+}
+
+/* At the end of the file, whatever hasn't come to its lines does what
+   the command would do with a document that's too short for it. */
+static int finish_stream(edsc_stream_t *stream) {
+	edsc_stage_t *stage;
+	uint32_t k;
+	int reached, status;
+
+	for(k = 0; k < stream->n_stages; k++) {
+		stage = &stream->stages[k];
+		if(stage->done) continue;
+
+		reached = stage->started;
+		if(!reached) start_stage(stream, k);
+		finish_stage(stream, k);
+
+		switch(stage->kind) {
+			case EDSC_STAGE_INSERT:
+			case EDSC_STAGE_APPEND:
+				if((status = insert_text(stream, k)) != RET_OK) return status;
+				break;
+
+			case EDSC_STAGE_DELETE:
+				if(!reached && (stage->seen > 0)) stage->failed = 1;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return RET_OK;
+}
+
+/* Tells what went wrong in the order the commands would have, since
+   that can only be known at the end. */
+static void report_stream(const edsc_stream_t *stream) {
+	const edsc_stage_t *stage;
+	uint32_t k, n_errors = 0;
+
+	for(k = 0; k < stream->n_stages; k++) {
+		stage = &stream->stages[k];
+		if((stage->kind == EDSC_STAGE_REPLACE) && !stage->found)
+			print_error(RET_ERR_NOTFOUND);
+		if(stage->failed) {
+			print_error(RET_ERR_INVALID);
+			fprintf(stderr, "%s: Error in line %u of the script.\n", APP_NAME, stage->record->line);
+			n_errors++;
+		}
+	}
+
+	repl_print_summary(stream->n_stages, n_errors, stream->n_out, NULL);
+}
+
+/* Runs the script on the lines of in, and writes what's left of them to
+   out, as -q would. If the script streams (see plan_stream()), that's
+   one pass that holds no more than a block of lines at a time; if not,
+   the whole file is loaded first. */
+int edsc_filter(const edsc_script_t *script, FILE *in, FILE *out, const char *prompt,
+	const char *cursor_marker) {
+	edsc_stream_t stream;
+	ed_doc_t *document;
+	uint32_t k;
+	int status;
+
+	if((script == NULL) || (in == NULL) || (out == NULL)) return RET_ERR_NULLPO;
+
+	memset(&stream, 0, sizeof(edsc_stream_t));
+	stream.script = script;
+	stream.stages = malloc((script->header->n_records + 1) * sizeof(edsc_stage_t));
+	stream.skip = malloc((script->header->n_records + 1) * sizeof(uint32_t));
+	if((stream.stages == NULL) || (stream.skip == NULL)) {
+		status = print_error(RET_ERR_MALLOC);
+		goto done;
+	}
+
+	if(plan_stream(script, &stream) == RET_OK) {
+		for(k = 0; k <= stream.n_stages; k++)
+			stream.skip[k] = k;
+		if((stream.writer = edio_writer_new(out)) == NULL) {
+			status = print_error(RET_ERR_MALLOC);
+			goto done;
+		}
+
+		if((status = repl_stream(in, take_block, &stream)) == RET_OK)
+			status = finish_stream(&stream);
+		if((edio_writer_close(stream.writer) != RET_OK) && (status == RET_OK))
+			status = RET_ERR_WRITE;
+
+		if(status != RET_OK)
+			print_error(status);
+		else
+			report_stream(&stream);
+		goto done;
+	}
+
+	if((document = load_doc(in, NULL, 0)) == NULL) {
+		status = print_error(RET_ERR_READ);
+		goto done;
+	}
+	edsc_run(script, document, prompt, cursor_marker, 1);
+	if((status = write_doc(document, out)) != RET_OK)
+		print_error(RET_ERR_WRITE);
+	free_doc(document);
+
+done:
+	free(stream.stages);
+	free(stream.skip);
+	return status;
+}
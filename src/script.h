@@ -0,0 +1,39 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef SCRIPT_H_
+#define SCRIPT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "repl.h"
+
+typedef struct edsc_script_t edsc_script_t;
+
+/* How a quiet run of a script went. */
+typedef struct edsc_outcome_t {
+	int status;
+	uint32_t n_commands, n_errors;
+	uint64_t n_lines;
+	double seconds;
+} edsc_outcome_t;
+
+edsc_script_t *edsc_compile(const char *source, const size_t size, const char *prompt, int *status);
+edsc_script_t *edsc_load(const char *filename, const char *cache_dir, const char *prompt, int *status);
+int edsc_save(const edsc_script_t *script, const char *filename);
+void edsc_free(edsc_script_t *script);
+
+int edsc_optimize(edsc_script_t *script, const char *doc_filename, FILE *report);
+
+int edsc_run(const edsc_script_t *script, ed_doc_t *document, const char *prompt,
+	const char *cursor_marker, const int quiet);
+int edsc_batch(const edsc_script_t *script, const char * const *files, const size_t n_files,
+	const char *prompt, const char *cursor_marker, const int no_write);
+int edsc_filter(const edsc_script_t *script, FILE *in, FILE *out, const char *prompt,
+	const char *cursor_marker);
+
+#endif
@@ -0,0 +1,587 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+
+#include "dynarr.h"
+#include "ermac.h"
+#include "search.h"
+#include "tasks.h"
+#include "thread.h"
+#include "util.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define EDSR_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#define PREALLOC_MATCHES	64
+#define BLOCK_SIZE			16
+
+/* A scan for the next match looks at this many lines on its own before
+   it hands the rest to the workers. Most of the time, it's in there. */
+#define PARALLEL_FIND		65536
+
+/* The memo remembers every matching line in the half-open
+ * interval [scan_start, scan_end) of the document. Lines
+ * beyond scan_end haven't been looked at yet, so a "find
+ * next" either hits the match list or continues the scan
+ * where the last one left off. */
+struct edsr_memo_t {
+	char *pattern;
+	int flags;
+
+	size_t scan_start, scan_end;
+
+	size_t *matches;
+	size_t n_matches, n_alloced;
+	size_t hint;
+};
+
+/**/
+
+#define fold(c) ((((c) >= 'A') && ((c) <= 'Z')) ? (c) + ('a' - 'A') : (c))
+
+#ifdef EDSR_SSE2
+static unsigned int lowest_bit(const unsigned int mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+/* ASCII lower case for 16 bytes at once. Everything outside of A-Z,
+   including bytes above 127, which are negative here, stays as is. */
+static __m128i fold_block(const __m128i block) {
+	const __m128i above = _mm_set1_epi8('A' - 1);
+	const __m128i below = _mm_set1_epi8('Z' + 1);
+	const __m128i offset = _mm_set1_epi8('a' - 'A');
+	__m128i upper;
+
+	upper = _mm_and_si128(_mm_cmpgt_epi8(block, above), _mm_cmpgt_epi8(below, block));
+	return _mm_add_epi8(block, _mm_and_si128(upper, offset));
+}
+#endif
+
+static int fold_equal(const char *a, const char *b, const size_t len) {
+	size_t pos = 0;
+#ifdef EDSR_SSE2
+	__m128i block_a, block_b;
+
+	for(; pos + BLOCK_SIZE <= len; pos += BLOCK_SIZE) {
+		block_a = fold_block(_mm_loadu_si128((const __m128i *)(a + pos)));
+		block_b = fold_block(_mm_loadu_si128((const __m128i *)(b + pos)));
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(block_a, block_b)) != 0xffff)
+			return 0;
+	}
+#endif
+
+	for(; pos < len; pos++)
+		if(fold(a[pos]) != fold(b[pos])) return 0;
+
+	return 1;
+}
+
+static int chars_equal(const char *a, const char *b, const size_t len, const int flags) {
+	if(flags & EDSR_NOCASE)
+		return fold_equal(a, b, len);
+	return !memcmp(a, b, len);
+}
+
+/* Looks for the pattern in the text, 16 candidate positions at a time:
+ * A position can only match if both the first and the last character
+ * of the pattern line up, and only those get compared in full. Without
+ * a counter, it returns the first match. With one, it counts all
+ * non-overlapping matches, the same ones R would replace. With
+ * EDSR_NOCASE, both sides are folded in registers as they are compared. */
+static const char *scan(const char *text, const size_t text_len,
+	const char *pattern, const size_t pattern_len, const int flags, size_t *count) {
+	const char *first_match = NULL;
+	size_t pos = 0, next_free = 0, n_candidates;
+	int nocase = flags & EDSR_NOCASE;
+	char first_char;
+#ifdef EDSR_SSE2
+	__m128i first, last, block_first, block_last;
+	unsigned int mask;
+	size_t candidate;
+#endif
+
+	if((pattern_len == 0) || (pattern_len > text_len)) return NULL;
+	n_candidates = text_len - pattern_len + 1;
+	first_char = nocase ? fold(pattern[0]) : pattern[0];
+
+#ifdef EDSR_SSE2
+	first = _mm_set1_epi8(first_char);
+	last = _mm_set1_epi8(nocase ? fold(pattern[pattern_len - 1]) : pattern[pattern_len - 1]);
+
+	for(; pos + BLOCK_SIZE <= n_candidates; pos += BLOCK_SIZE) {
+		block_first = _mm_loadu_si128((const __m128i *)(text + pos));
+		block_last = _mm_loadu_si128((const __m128i *)(text + pos + pattern_len - 1));
+		if(nocase) {
+			block_first = fold_block(block_first);
+			block_last = fold_block(block_last);
+		}
+		mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+
+		while(mask) {
+			candidate = pos + lowest_bit(mask);
+			mask &= mask - 1;
+
+			if(candidate < next_free) continue;
+			if((pattern_len > 2) && !chars_equal(text + candidate + 1, pattern + 1, pattern_len - 2, flags))
+				continue;
+
+			if(count == NULL) return text + candidate;
+			if(first_match == NULL) first_match = text + candidate;
+			next_free = candidate + pattern_len;
+			(*count)++;
+		}
+	}
+#endif
+
+	for(; pos < n_candidates; pos++) {
+		if(pos < next_free) continue;
+		if((nocase ? fold(text[pos]) : text[pos]) != first_char) continue;
+		if(!chars_equal(text + pos, pattern, pattern_len, flags)) continue;
+
+		if(count == NULL) return text + pos;
+		if(first_match == NULL) first_match = text + pos;
+		next_free = pos + pattern_len;
+		(*count)++;
+	}
+
+	return first_match;
+}
+
+const char *edsr_find(const char *line, const char *pattern, const int flags) {
+	if((line == NULL) || (pattern == NULL)) return NULL;
+	return scan(line, strlen(line), pattern, strlen(pattern), flags, NULL);
+}
+
+size_t edsr_count(const char *line, const char *pattern, const int flags) {
+	size_t count = 0;
+
+	if((line == NULL) || (pattern == NULL)) return 0;
+	scan(line, strlen(line), pattern, strlen(pattern), flags, &count);
+	return count;
+}
+
+typedef struct edsr_count_t {
+	const dynarr_t *lines;
+	const char *pattern;
+	size_t pattern_len;
+	int flags;
+
+	/* Matching lines and matches, per worker. */
+	size_t *sums;
+} edsr_count_t;
+
+static int count_body(void *ctx, const size_t start, const size_t end, const unsigned worker) {
+	edsr_count_t *job = ctx;
+	size_t n_lines = 0, n_matches = 0, n_found, i;
+	char **line;
+
+	for(i = start; i < end; i++) {
+		if((line = dynarr_get_element(job->lines, i)) == NULL) return RET_ERR_RANGE;
+
+		n_found = 0;
+		scan(*line, strlen(*line), job->pattern, job->pattern_len, job->flags, &n_found);
+		if(n_found) {
+			n_lines++;
+			n_matches += n_found;
+		}
+	}
+
+	job->sums[2 * worker] += n_lines;
+	job->sums[2 * worker + 1] += n_matches;
+	return RET_OK;
+}
+
+/* Counts matching lines and matches in [start, end). */
+int edsr_count_lines(const dynarr_t *lines, const size_t start, const size_t end,
+	const char *pattern, const int flags, size_t *n_lines, size_t *n_matches) {
+	edsr_count_t job;
+	unsigned i;
+	int status;
+
+	if((lines == NULL) || (pattern == NULL)) return RET_ERR_NULLPO;
+	if((n_lines == NULL) || (n_matches == NULL)) return RET_ERR_NULLPO;
+
+	*n_lines = 0;
+	*n_matches = 0;
+
+	job.lines = lines;
+	job.pattern = pattern;
+	job.pattern_len = strlen(pattern);
+	job.flags = flags;
+	if((job.sums = calloc(2 * edtk_workers(), sizeof(size_t))) == NULL)
+		return RET_ERR_MALLOC;
+
+	if((status = edtk_for(start, end, 0, count_body, &job, NULL)) == RET_OK) {
+		for(i = 0; i < edtk_workers(); i++) {
+			*n_lines += job.sums[2 * i];
+			*n_matches += job.sums[2 * i + 1];
+		}
+	}
+
+	free(job.sums);
+	return status;
+}
+
+static int line_matches(const dynarr_t *lines, const size_t index, const char *pattern, const int flags) {
+	char **line;
+
+	if((line = dynarr_get_element(lines, index)) == NULL) return 0;
+	if(*line == NULL) return 0;
+
+	return edsr_find(*line, pattern, flags) != NULL;
+}
+
+/* A scan for the next match on all the workers. Pieces behind the first
+   match found so far don't have to look, and once everything in front of
+   it has been looked at, the rest of the loop is called off. */
+typedef struct edsr_find_t {
+	const dynarr_t *lines;
+	const char *pattern;
+	int flags;
+
+	ed_lock_t lock;
+	size_t first, scanned_to;
+
+	/* Pieces that are done, but not next to scanned_to yet. */
+	size_t *pieces;
+	size_t n_pieces, pieces_alloced;
+
+	volatile int cancel;
+} edsr_find_t;
+
+/* Whatever is in front of scanned_to has been looked at. */
+static int piece_done(edsr_find_t *job, const size_t start, const size_t end) {
+	size_t *new_pieces, new_alloced, i;
+
+	if(start != job->scanned_to) {
+		if(job->n_pieces == job->pieces_alloced) {
+			new_alloced = job->pieces_alloced > 0 ? job->pieces_alloced * 2 : PREALLOC_MATCHES;
+			if((new_pieces = realloc(job->pieces, 2 * new_alloced * sizeof(size_t))) == NULL)
+				return RET_ERR_MALLOC;
+			job->pieces = new_pieces;
+			job->pieces_alloced = new_alloced;
+		}
+
+		job->pieces[2 * job->n_pieces] = start;
+		job->pieces[2 * job->n_pieces + 1] = end;
+		job->n_pieces++;
+		return RET_OK;
+	}
+
+	job->scanned_to = end;
+	for(i = 0; i < job->n_pieces; ) {
+		if(job->pieces[2 * i] != job->scanned_to) {
+			i++;
+			continue;
+		}
+
+		job->scanned_to = job->pieces[2 * i + 1];
+		job->n_pieces--;
+		job->pieces[2 * i] = job->pieces[2 * job->n_pieces];
+		job->pieces[2 * i + 1] = job->pieces[2 * job->n_pieces + 1];
+		i = 0;
+	}
+
+	return RET_OK;
+}
+
+static int find_body(void *ctx, const size_t start, const size_t end, const unsigned worker) {
+	edsr_find_t *job = ctx;
+	size_t limit, i;
+	int status;
+
+	ed_lock(&job->lock);
+	limit = job->first < end ? job->first : end;
+	ed_unlock(&job->lock);
+
+	for(i = start; i < limit; i++) {
+		if(line_matches(job->lines, i, job->pattern, job->flags))
+			break;
+	}
+
+	ed_lock(&job->lock);
+	if((i < limit) && (i < job->first)) job->first = i;
+	status = piece_done(job, start, end);
+	if(job->scanned_to >= job->first) job->cancel = 1;
+	ed_unlock(&job->lock);
+
+	return status;
+}
+
+/* The first matching line in [from, to). */
+static int find_parallel(const dynarr_t *lines, const char *pattern, const int flags,
+	const size_t from, const size_t to, size_t *match) {
+	edsr_find_t job;
+	int status;
+
+	job.lines = lines;
+	job.pattern = pattern;
+	job.flags = flags;
+	job.first = to;
+	job.scanned_to = from;
+	job.pieces = NULL;
+	job.n_pieces = job.pieces_alloced = 0;
+	job.cancel = 0;
+	ed_lock_init(&job.lock);
+
+	status = edtk_for(from, to, 0, find_body, &job, &job.cancel);
+
+	ed_lock_free(&job.lock);
+	free(job.pieces);
+
+	if(status != RET_OK) return status;
+	if(job.first == to) return RET_ERR_NOTFOUND;
+
+	*match = job.first;
+	return RET_OK;
+}
+
+/**/
+
+static int grow_matches(edsr_memo_t *memo, const size_t n_needed) {
+	size_t new_alloced;
+	size_t *new_matches;
+
+	if(n_needed <= memo->n_alloced) return RET_OK;
+
+	new_alloced = memo->n_alloced ? memo->n_alloced : PREALLOC_MATCHES;
+	while(new_alloced < n_needed)
+		new_alloced *= 2;
+
+	if((new_matches = malloc(new_alloced * sizeof(size_t))) == NULL)
+		return RET_ERR_MALLOC;
+
+	if(memo->matches != NULL) {
+		memcpy(new_matches, memo->matches, memo->n_matches * sizeof(size_t));
+		free(memo->matches);
+	}
+
+	memo->matches = new_matches;
+	memo->n_alloced = new_alloced;
+	return RET_OK;
+}
+
+/* Index of the first cached match at or after the given line. */
+static size_t lower_bound(const edsr_memo_t *memo, const size_t line) {
+	size_t lo = 0, hi = memo->n_matches, mid;
+
+	/* Stepping through the matches one by one always lands here. */
+	if((memo->hint < memo->n_matches) && (memo->matches[memo->hint] >= line) &&
+	   ((memo->hint == 0) || (memo->matches[memo->hint - 1] < line)))
+		return memo->hint;
+
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(memo->matches[mid] < line)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int start_over(edsr_memo_t *memo, const char *pattern, const int flags, const size_t from) {
+	if((memo->pattern == NULL) || strcmp(memo->pattern, pattern)) {
+		free(memo->pattern);
+		if((memo->pattern = str_alloc_copy(pattern)) == NULL)
+			return RET_ERR_MALLOC;
+	}
+
+	memo->flags = flags;
+	memo->scan_start = from;
+	memo->scan_end = from;
+	memo->n_matches = 0;
+	memo->hint = 0;
+
+	return RET_OK;
+}
+
+/**/
+
+/* The scan found the next match at line. */
+static int found_at(edsr_memo_t *memo, const size_t line, size_t *match) {
+	int status;
+
+	if((status = grow_matches(memo, memo->n_matches + 1)) != RET_OK)
+		return status;
+
+	memo->matches[memo->n_matches++] = line;
+	memo->scan_end = line + 1;
+	memo->hint = memo->n_matches;
+	*match = line;
+	return RET_OK;
+}
+
+int edsr_memo_next(edsr_memo_t *memo, const dynarr_t *lines, const char *pattern,
+	const int flags, const size_t from, const size_t to, size_t *match) {
+	size_t index, serial_end, i;
+	int status;
+
+	if((memo == NULL) || (lines == NULL) || (pattern == NULL) || (match == NULL))
+		return RET_ERR_NULLPO;
+
+	if(from >= to) return RET_ERR_NOTFOUND;
+
+	if((memo->pattern == NULL) || strcmp(memo->pattern, pattern) || (memo->flags != flags) ||
+	   (from < memo->scan_start) || (from > memo->scan_end)) {
+		if((status = start_over(memo, pattern, flags, from)) != RET_OK)
+			return status;
+	}
+
+	index = lower_bound(memo, from);
+	if(index < memo->n_matches) {
+		if(memo->matches[index] >= to)
+			return RET_ERR_NOTFOUND;
+
+		memo->hint = index + 1;
+		*match = memo->matches[index];
+		return RET_OK;
+	}
+
+	/* Nothing cached between from and scan_end. Keep scanning, and
+	   let the workers in on it if the next match is far away. */
+	serial_end = to;
+	if((memo->scan_end < to) && (to - memo->scan_end > PARALLEL_FIND))
+		serial_end = memo->scan_end + PARALLEL_FIND;
+	for(i = memo->scan_end; i < serial_end; i++) {
+		if(line_matches(lines, i, pattern, flags))
+			return found_at(memo, i, match);
+	}
+
+	if(serial_end < to) {
+		if((status = find_parallel(lines, pattern, flags, serial_end, to, &i)) == RET_OK)
+			return found_at(memo, i, match);
+		if(status != RET_ERR_NOTFOUND) return status;
+	}
+
+	if(to > memo->scan_end)
+		memo->scan_end = to;
+	return RET_ERR_NOTFOUND;
+}
+
+/* Lines [first, first + n_removed) were replaced by n_inserted new
+ * lines. Everything cached in front of the edit stays, everything
+ * behind it is shifted, and only the new lines are scanned again. */
+int edsr_memo_update(edsr_memo_t *memo, const dynarr_t *lines,
+	const size_t first, const size_t n_removed, const size_t n_inserted) {
+	size_t new_start, new_end, edit_end = first + n_removed;
+	size_t head, tail, n_tail, rescan_from, rescan_to, i;
+	size_t *tail_copy = NULL;
+	int status;
+
+	if(memo == NULL) return RET_ERR_NULLPO;
+	if(memo->pattern == NULL) return RET_OK;
+
+	/* Edits behind the scanned area don't touch the memo. */
+	if(first >= memo->scan_end) return RET_OK;
+
+	if(memo->scan_start <= first)
+		new_start = memo->scan_start;
+	else if(memo->scan_start >= edit_end)
+		new_start = memo->scan_start - n_removed + n_inserted;
+	else
+		new_start = first;
+
+	if(memo->scan_end >= edit_end)
+		new_end = memo->scan_end - n_removed + n_inserted;
+	else
+		new_end = first + n_inserted;
+
+	head = lower_bound(memo, first);
+	memo->hint = 0;
+	tail = lower_bound(memo, edit_end);
+	n_tail = memo->n_matches - tail;
+
+	if(n_tail > 0) {
+		if((tail_copy = malloc(n_tail * sizeof(size_t))) == NULL) {
+			edsr_memo_reset(memo);
+			return RET_ERR_MALLOC;
+		}
+		memcpy(tail_copy, memo->matches + tail, n_tail * sizeof(size_t));
+	}
+	memo->n_matches = head;
+
+	rescan_from = first > new_start ? first : new_start;
+	rescan_to = first + n_inserted < new_end ? first + n_inserted : new_end;
+	for(i = rescan_from; i < rescan_to; i++) {
+		if(line_matches(lines, i, memo->pattern, memo->flags)) {
+			if((status = grow_matches(memo, memo->n_matches + 1)) != RET_OK)
+				goto fail;
+			memo->matches[memo->n_matches++] = i;
+		}
+	}
+
+	if((status = grow_matches(memo, memo->n_matches + n_tail)) != RET_OK)
+		goto fail;
+	for(i = 0; i < n_tail; i++)
+		memo->matches[memo->n_matches++] = tail_copy[i] - n_removed + n_inserted;
+
+	memo->scan_start = new_start;
+	memo->scan_end = new_end;
+
+	free(tail_copy);
+	return RET_OK;
+
+fail:
+	free(tail_copy);
+	edsr_memo_reset(memo);
+	return status;
+}
+
+/**/
+
+void edsr_memo_reset(edsr_memo_t *memo) {
+	if(memo == NULL) return;
+
+	free(memo->pattern);
+	memo->pattern = NULL;
+	memo->scan_start = 0;
+	memo->scan_end = 0;
+	memo->n_matches = 0;
+	memo->hint = 0;
+}
+
+edsr_memo_t *edsr_memo_new(void) {
+	edsr_memo_t *out;
+
+	if((out = malloc(sizeof(edsr_memo_t))) == NULL) return NULL;
+
+	out->pattern = NULL;
+	out->flags = 0;
+	out->scan_start = 0;
+	out->scan_end = 0;
+	out->matches = NULL;
+	out->n_matches = 0;
+	out->n_alloced = 0;
+	out->hint = 0;
+
+	return out;
+}
+
+void edsr_memo_free(edsr_memo_t *memo) {
+	if(memo == NULL) return;
+
+	free(memo->pattern);
+	free(memo->matches);
+	free(memo);
+}
@@ -0,0 +1,30 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef SEARCH_H_
+#define SEARCH_H_
+
+#include <stddef.h>
+
+#include "dynarr.h"
+
+#define EDSR_NOCASE		1
+
+typedef struct edsr_memo_t edsr_memo_t;
+
+const char *edsr_find(const char *line, const char *pattern, const int flags);
+size_t edsr_count(const char *line, const char *pattern, const int flags);
+int edsr_count_lines(const dynarr_t *lines, const size_t start, const size_t end,
+	const char *pattern, const int flags, size_t *n_lines, size_t *n_matches);
+
+edsr_memo_t *edsr_memo_new(void);
+void edsr_memo_free(edsr_memo_t *memo);
+void edsr_memo_reset(edsr_memo_t *memo);
+int edsr_memo_next(edsr_memo_t *memo, const dynarr_t *lines, const char *pattern,
+	const int flags, const size_t from, const size_t to, size_t *match);
+int edsr_memo_update(edsr_memo_t *memo, const dynarr_t *lines,
+	const size_t first, const size_t n_removed, const size_t n_inserted);
+
+#endif
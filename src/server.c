@@ -0,0 +1,808 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "mem.h"
+
+#include "appinfo.h"
+#include "ermac.h"
+#include "parser.h"
+#include "repl.h"
+#include "server.h"
+#include "thread.h"
+
+#ifndef _WIN32
+
+#define READ_CHUNK			4096
+#define BACKLOG				16
+
+/* In the poll set, the listening socket and the writer come first. */
+#define FIRST_CLIENT		2
+
+/* A session doesn't run more lines while its connection has this much
+   of its output still to take. */
+#define OUT_LIMIT			(1024 * 1024)
+
+/* Every connection is a session of its own, with its own cursor and
+   search string, on the one document the server holds. */
+typedef struct edsv_client_t {
+	int fd;
+	repl_state_t *state;
+
+	char *buf;
+	size_t used, alloced;
+
+	/* A read ran into the end of the input, like feof() on stdin. */
+	int eof, hit_eof;
+
+	/* What the session printed that the connection hasn't taken yet. */
+	char *out;
+	size_t out_used, out_alloced;
+
+	/* Ended, and closed as soon as all of its output is out. */
+	int closing;
+
+	/* Every session parses its own lines, so that one can stop at a
+	   command whose text isn't all there yet, and go on from that
+	   command once it is. The others run meanwhile. */
+	edps_ctx_t *parser;
+	char *cmdline;
+	edps_instr_t *parked;
+	int more;
+} edsv_client_t;
+
+typedef struct edsv_server_t {
+	ed_doc_t *document;
+	const char *prompt, *cursor_marker;
+	int quiet;
+
+	edsv_client_t **clients;
+	size_t n_clients, alloced;
+
+	int saved_out, saved_err;
+	FILE *scratch;
+
+	/* Lines that change the document run on the writer thread, one at a
+	   time. Lines that only show it run right away on a snapshot of what
+	   the writer last left, and print to a scratch file of their own. */
+	ed_thread_t writer;
+	ed_lock_t lock;
+	ed_cond_t cond;
+	edsv_client_t *job;
+	int job_status, shut_down;
+
+	/* The writer's session, which nothing else touches until the writer
+	   says on wake that it's done with it. */
+	edsv_client_t *busy;
+	int wake[2];
+
+	FILE *reads;
+	edps_ctx_t *probe;
+} edsv_server_t;
+
+static volatile sig_atomic_t stop_server = 0;
+
+static void on_signal(int sig) {
+	stop_server = 1;
+}
+
+/**/
+
+static int fill(edsv_client_t *client) {
+	char *new_buf;
+	ssize_t n;
+
+	if(client->alloced - client->used < READ_CHUNK) {
+		if((new_buf = realloc(client->buf, client->alloced + READ_CHUNK)) == NULL)
+			return RET_ERR_MALLOC;
+		client->buf = new_buf;
+		client->alloced += READ_CHUNK;
+	}
+
+	do {
+		n = read(client->fd, client->buf + client->used, client->alloced - client->used);
+	} while((n < 0) && (errno == EINTR));
+
+	if(n <= 0) client->eof = 1;
+	else client->used += n;
+
+	return RET_OK;
+}
+
+static int has_line(const edsv_client_t *client) {
+	return client->eof || ((client->used > 0) && (memchr(client->buf, '\n', client->used) != NULL));
+}
+
+/* The length of a line without its end, by the same rules as get_line(). */
+static size_t cut_line(const char *line, const size_t length) {
+	size_t cut;
+
+	for(cut = length; (cut > 0) && (line[cut - 1] != '\r'); cut--);
+	return cut > 0 ? cut - 1 : length;
+}
+
+/* Whether all the text a command asks for is there: max_lines lines, or
+   fewer up to a ".". */
+static int has_text(const edsv_client_t *client, const uint64_t max_lines) {
+	const char *line = client->buf, *newline;
+	size_t left = client->used;
+	uint64_t n;
+
+	if(client->eof) return 1;
+
+	for(n = 0; n < max_lines; n++) {
+		if((left == 0) || ((newline = memchr(line, '\n', left)) == NULL))
+			return 0;
+		if((cut_line(line, newline - line) == 1) && (line[0] == '.'))
+			return 1;
+
+		left -= newline - line + 1;
+		line = newline + 1;
+	}
+
+	return 1;
+}
+
+/* A copy of the next line in the buffer, by the same rules as
+   get_line(), and how much of the buffer it takes up. At the end of the
+   input that's whatever is left. */
+static char *copy_line(const edsv_client_t *client, size_t *consumed) {
+	char *newline, *out;
+	size_t length;
+
+	if((newline = memchr(client->buf, '\n', client->used)) != NULL) {
+		length = newline - client->buf;
+		*consumed = length + 1;
+	} else {
+		length = client->used;
+		*consumed = length;
+	}
+
+	length = cut_line(client->buf, length);
+
+	if((out = malloc(length + 1)) == NULL) return NULL;
+	memcpy(out, client->buf, length);
+	out[length] = '\0';
+	return out;
+}
+
+/* Takes the next line out of the buffer. */
+static char *take_line(edsv_client_t *client) {
+	char *out;
+	size_t consumed;
+
+	if((out = copy_line(client, &consumed)) == NULL) return NULL;
+	if((consumed == 0) || (client->buf[consumed - 1] != '\n'))
+		client->hit_eof = 1;
+
+	memmove(client->buf, client->buf + consumed, client->used - consumed);
+	client->used -= consumed;
+	return out;
+}
+
+/* Text for I, A and line edits comes from the same connection. A
+   command only runs once all of its text is there (see run_line()), so
+   what isn't there is past the end of the input, and ends the text. */
+static char *client_line(void *ctx) {
+	edsv_client_t *client = ctx;
+
+	if(client->hit_eof || !has_line(client)) return NULL;
+	if(client->eof && (client->used == 0)) {
+		client->hit_eof = 1;
+		return NULL;
+	}
+
+	return take_line(client);
+}
+
+/**/
+
+/* The editor prints to stdout and stderr. Since only one session runs
+   on the writer at a time, both are pointed at a scratch file meanwhile,
+   and what ends up there goes to the session's connection as fast as
+   that takes it. Writing to the connection directly would hold up
+   everybody if it didn't read. */
+static void output_to(const int fd) {
+	fflush(stdout);
+	fflush(stderr);
+	dup2(fd, STDOUT_FILENO);
+	dup2(fd, STDERR_FILENO);
+}
+
+static void output_back(edsv_server_t *server) {
+	output_to(server->saved_out);
+	dup2(server->saved_err, STDERR_FILENO);
+}
+
+static int reserve_out(edsv_client_t *client, const size_t size) {
+	char *new_out;
+	size_t new_size;
+
+	if(client->out_alloced - client->out_used >= size) return RET_OK;
+
+	new_size = client->out_alloced > 0 ? client->out_alloced : READ_CHUNK;
+	while(new_size - client->out_used < size) new_size *= 2;
+	if((new_out = realloc(client->out, new_size)) == NULL)
+		return RET_ERR_MALLOC;
+
+	client->out = new_out;
+	client->out_alloced = new_size;
+	return RET_OK;
+}
+
+/* Moves what the last line printed from a scratch file to the
+   session's output. */
+static int collect(FILE *scratch, edsv_client_t *client) {
+	int fd = fileno(scratch);
+	off_t size, done = 0;
+	ssize_t n;
+	int status = RET_OK;
+
+	if((size = lseek(fd, 0, SEEK_END)) <= 0) return RET_OK;
+
+	if((status = reserve_out(client, size)) == RET_OK) {
+		while(done < size) {
+			if((n = pread(fd, client->out + client->out_used, size - done, done)) <= 0) {
+				if((n < 0) && (errno == EINTR)) continue;
+				status = RET_ERR_READ;
+				break;
+			}
+			client->out_used += n;
+			done += n;
+		}
+	}
+
+	if(ftruncate(fd, 0) < 0) status = RET_ERR_WRITE;
+	return status;
+}
+
+/* Sends as much of the output as the connection takes without waiting. */
+static int flush_out(edsv_client_t *client) {
+	ssize_t n;
+
+	while(client->out_used > 0) {
+		if((n = send(client->fd, client->out, client->out_used, MSG_DONTWAIT)) < 0) {
+			if(errno == EINTR) continue;
+			if((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+			return RET_ERR_WRITE;
+		}
+
+		memmove(client->out, client->out + n, client->out_used - n);
+		client->out_used -= n;
+	}
+
+	return RET_OK;
+}
+
+static void close_client(edsv_server_t *server, const size_t index) {
+	edsv_client_t *client = server->clients[index];
+
+	close(client->fd);
+	repl_free(client->state);
+	edps_free(client->parser);
+	free(client->cmdline);
+	free(client->buf);
+	free(client->out);
+	free(client);
+
+	server->clients[index] = server->clients[--server->n_clients];
+}
+
+static int add_client(edsv_server_t *server, const int fd) {
+	edsv_client_t *client, **new_clients;
+	size_t new_size;
+	int status;
+
+	if(server->n_clients == server->alloced) {
+		new_size = server->alloced > 0 ? server->alloced * 2 : 8;
+		if((new_clients = realloc(server->clients, new_size * sizeof(edsv_client_t*))) == NULL)
+			return RET_ERR_MALLOC;
+		server->clients = new_clients;
+		server->alloced = new_size;
+	}
+
+	if((client = malloc(sizeof(edsv_client_t))) == NULL)
+		return RET_ERR_MALLOC;
+	if((client->state = repl_init(server->prompt, server->cursor_marker)) == NULL) {
+		free(client);
+		return RET_ERR_MALLOC;
+	}
+	if((client->parser = edps_new("", server->prompt, &status)) == NULL) {
+		repl_free(client->state);
+		free(client);
+		return status;
+	}
+	repl_set_input(client->state, client_line, client);
+	repl_set_quiet(client->state, server->quiet);
+
+	client->fd = fd;
+	client->buf = NULL;
+	client->used = client->alloced = 0;
+	client->eof = client->hit_eof = 0;
+	client->out = NULL;
+	client->out_used = client->out_alloced = 0;
+	client->closing = 0;
+	client->cmdline = NULL;
+	client->parked = NULL;
+	client->more = 0;
+
+	if(!server->quiet) {
+		if(reserve_out(client, strlen(server->prompt)) != RET_OK) {
+			repl_free(client->state);
+			edps_free(client->parser);
+			free(client);
+			return RET_ERR_MALLOC;
+		}
+		memcpy(client->out, server->prompt, strlen(server->prompt));
+		client->out_used = strlen(server->prompt);
+	}
+
+	server->clients[server->n_clients++] = client;
+	return RET_OK;
+}
+
+/* Whether a session can run: one with a line waiting, or one that's
+   parked once the text for its command is there. */
+static int ready(edsv_server_t *server, edsv_client_t *client) {
+	uint64_t max_lines;
+
+	if(client->parked == NULL) return has_line(client);
+	if(repl_wants_text(client->state, server->document, client->parked, &max_lines) != RET_YES)
+		return 1;
+	return has_text(client, max_lines);
+}
+
+/* Whether the next line only shows the document, so that it can run on
+   a snapshot while the writer is busy. A line that doesn't parse is left
+   to the writer, which tells the session what's wrong with it. */
+static int reads_only(edsv_server_t *server, const edsv_client_t *client) {
+	edps_instr_t *instr;
+	char *line;
+	size_t consumed;
+	int status, more = 1, reads = 1;
+
+	if((server->document->versions == NULL) || (client->parked != NULL) || !has_line(client))
+		return 0;
+	if((line = copy_line(client, &consumed)) == NULL) return 0;
+
+	status = edps_restart(server->probe, line);
+	while(reads && more && (status == RET_OK)) {
+		if((status = edps_parse(server->probe)) == RET_MORE) status = RET_OK;
+		else more = 0;
+
+		if((status != RET_OK) || ((instr = edps_get_instr(server->probe)) == NULL))
+			reads = 0;
+		else
+			reads = repl_reads_only(instr) == RET_YES;
+	}
+
+	free(line);
+	return reads && (status == RET_OK);
+}
+
+/* Whether a session can't go on before it sends more. While the writer
+   is busy, one with a line for it waits for the writer instead. */
+static int wants_input(edsv_server_t *server, edsv_client_t *client) {
+	if(server->busy == NULL) return !ready(server, client);
+	return (client->parked == NULL) && !has_line(client);
+}
+
+/* One turn of repl_main() for one session: echo the line, run it and
+   show the prompt for the next one. All of that is left in the
+   session's output. A command that asks for text that isn't there yet
+   parks the session before it runs, and the next turn goes on with it.
+   With a version, the line only reads, and reads that. */
+static int run_line(edsv_server_t *server, edsv_client_t *client, const edsn_version_t *version) {
+	edps_instr_t *instr = client->parked;
+	FILE *out = version != NULL ? server->reads : stdout;
+	uint64_t max_lines;
+	int parser_status, status = RET_OK;
+
+	if((instr == NULL) && ((client->cmdline = take_line(client)) == NULL))
+		return RET_ERR_MALLOC;
+
+	if(version != NULL) set_error_stream(out);
+	else output_to(fileno(server->scratch));
+
+	if(instr == NULL) {
+		if(!server->quiet) fprintf(out, "%s\n", client->cmdline);
+		status = edps_restart(client->parser, client->cmdline);
+		client->more = 1;
+	}
+	client->parked = NULL;
+
+	while(status == RET_OK) {
+		if(instr == NULL) {
+			if(!client->more) break;
+
+			if((parser_status = edps_parse(client->parser)) != RET_OK) {
+				if(parser_status == RET_ERR_SYNTAX) {
+					print_error(parser_status);
+					break;
+				}
+				if(parser_status != RET_MORE) {
+					status = print_error(parser_status);
+					break;
+				}
+			}
+			client->more = parser_status == RET_MORE;
+
+			if((instr = edps_get_instr(client->parser)) == NULL)
+				break;
+		}
+
+		if(version != NULL) {
+			repl_read(client->state, version, instr, out);
+			instr = NULL;
+			continue;
+		}
+
+		if((repl_wants_text(client->state, server->document, instr, &max_lines) == RET_YES) &&
+			!has_text(client, max_lines)) {
+			client->parked = instr;
+			break;
+		}
+
+		repl_exec(client->state, server->document, instr);
+		instr = NULL;
+		if(repl_done(client->state)) break;
+	}
+
+	if(client->parked == NULL) {
+		if(!repl_done(client->state) && !client->hit_eof && !server->quiet)
+			fprintf(out, "%s", server->prompt);
+
+		free(client->cmdline);
+		client->cmdline = NULL;
+	}
+
+	if(version != NULL) {
+		set_error_stream(NULL);
+		fflush(out);
+	} else {
+		output_back(server);
+	}
+
+	if((parser_status = collect(version != NULL ? server->reads : server->scratch, client)) != RET_OK)
+		return parser_status;
+	return status;
+}
+
+/* Runs a line that only reads on what the writer last published. */
+static int read_line(edsv_server_t *server, edsv_client_t *client) {
+	const edsn_version_t *version;
+	int status;
+
+	if((version = edsn_pin(server->document->versions)) == NULL)
+		return RET_ERR_MALLOC;
+	status = run_line(server, client, version);
+	edsn_unpin(server->document->versions, version);
+
+	return status;
+}
+
+ED_THREAD_FUNC(writer_main, arg) {
+	edsv_server_t *server = arg;
+	edsv_client_t *client;
+	int status;
+
+	ed_lock(&server->lock);
+	for(;;) {
+		while((server->job == NULL) && !server->shut_down)
+			ed_cond_wait(&server->cond, &server->lock);
+		if((client = server->job) == NULL) break;
+		ed_unlock(&server->lock);
+
+		status = run_line(server, client, NULL);
+
+		ed_lock(&server->lock);
+		server->job = NULL;
+		server->job_status = status;
+		while((write(server->wake[1], "", 1) < 0) && (errno == EINTR));
+	}
+	ed_unlock(&server->lock);
+
+	ED_THREAD_RETURN;
+}
+
+static void hand_over(edsv_server_t *server, edsv_client_t *client) {
+	server->busy = client;
+
+	ed_lock(&server->lock);
+	server->job = client;
+	ed_cond_broadcast(&server->cond);
+	ed_unlock(&server->lock);
+}
+
+/* Whether the writer is done with its session. */
+static int writer_done(edsv_server_t *server) {
+	char drain[64];
+	int done;
+
+	while(read(server->wake[0], drain, sizeof(drain)) > 0);
+
+	ed_lock(&server->lock);
+	done = server->job == NULL;
+	ed_unlock(&server->lock);
+
+	return done;
+}
+
+/* What's left after a line ran: the session ends if it's done, and gets
+   what it printed. Whether it's still there. */
+static int after_line(edsv_server_t *server, const size_t index, const int status) {
+	edsv_client_t *client = server->clients[index];
+
+	if(status == RET_ERR_MALLOC) {
+		close_client(server, index);
+		return 0;
+	}
+	if(repl_done(client->state) || client->hit_eof)
+		client->closing = 1;
+
+	/* Most of the time, the connection takes it right away. */
+	if(flush_out(client) != RET_OK) {
+		close_client(server, index);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**/
+
+static int open_socket(const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: Socket path too long.\n", APP_NAME);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		perror(APP_NAME);
+		return -1;
+	}
+
+	if((bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) || (listen(fd, BACKLOG) < 0)) {
+		perror(APP_NAME);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Serves the document to everybody who connects, until the server is
+   interrupted. Lines that change the document run one at a time on the
+   writer, each up to a command that waits for its text, so every
+   command sees the document as the one before it left it. Lines of
+   nothing but L, P and S don't wait for the writer: once the whole file
+   is there, they read the last version it left, even while it's busy
+   with a long R. Nobody waits for a session to send something. The
+   document is never saved on its own; that's what W and E are for. */
+int edsv_serve(const char *path, ed_doc_t *document, const char *prompt, const char *cursor_marker, const int quiet) {
+	edsv_server_t server;
+	edsv_client_t *client;
+	struct pollfd *fds = NULL, *new_fds;
+	struct sigaction action;
+	sigset_t signals, old_signals;
+	size_t i, fds_alloced = 0;
+	int listen_fd, fd, pending, reading, started = 0, status = RET_OK;
+
+	if((path == NULL) || (document == NULL)) return RET_ERR_NULLPO;
+
+	if((listen_fd = open_socket(path)) < 0)
+		return RET_ERR_OPEN;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = on_signal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	server.document = document;
+	server.prompt = prompt != NULL ? prompt : DEFAULT_PROMPT;
+	server.cursor_marker = cursor_marker;
+	server.quiet = quiet;
+	server.clients = NULL;
+	server.n_clients = server.alloced = 0;
+	server.saved_out = dup(STDOUT_FILENO);
+	server.saved_err = dup(STDERR_FILENO);
+	server.job = server.busy = NULL;
+	server.job_status = RET_OK;
+	server.shut_down = 0;
+	server.wake[0] = server.wake[1] = -1;
+	server.scratch = server.reads = NULL;
+	server.probe = NULL;
+	ed_lock_init(&server.lock);
+	ed_cond_init(&server.cond);
+
+	/* stdout and stderr end up on the same connection, so the messages
+	   have to come out in the order a terminal would show them. */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if((server.probe = edps_new("", server.prompt, &status)) == NULL) {
+		print_error(status);
+		goto done;
+	}
+	edps_set_silent(server.probe, 1);
+
+	/* Both write to the end of it, wherever the other one left that. */
+	if(((server.scratch = tmpfile()) == NULL) ||
+		(fcntl(fileno(server.scratch), F_SETFL, O_APPEND) < 0) ||
+		((server.reads = tmpfile()) == NULL) ||
+		(fcntl(fileno(server.reads), F_SETFL, O_APPEND) < 0)) {
+		status = print_error(RET_ERR_OPEN);
+		goto done;
+	}
+
+	if((pipe(server.wake) < 0) || (fcntl(server.wake[0], F_SETFL, O_NONBLOCK) < 0)) {
+		status = print_error(RET_ERR_OPEN);
+		goto done;
+	}
+
+	/* Signals are for the thread that polls, so that they wake it. */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+	started = ed_thread_start(&server.writer, writer_main, &server);
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+	if(!started) {
+		status = print_error(RET_ERR_INTERNAL);
+		goto done;
+	}
+
+	fprintf(stderr, "%s: Serving '%s' on %s.\n", APP_NAME, document->filename, path);
+
+	while(!stop_server) {
+		/* Only the writer's thread may touch the document while it's
+		   busy, and the file has to be all there for snapshots. */
+		if((server.busy == NULL) && (document->versions == NULL))
+			repl_snapshots(document);
+
+		if(fds_alloced < server.n_clients + FIRST_CLIENT) {
+			if((new_fds = realloc(fds, (server.n_clients + FIRST_CLIENT) * 2 * sizeof(struct pollfd))) == NULL) {
+				status = RET_ERR_MALLOC;
+				break;
+			}
+			fds = new_fds;
+			fds_alloced = (server.n_clients + FIRST_CLIENT) * 2;
+		}
+
+		fds[0].fd = listen_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = server.wake[0];
+		fds[1].events = POLLIN;
+		pending = 0;
+		for(i = 0; i < server.n_clients; i++) {
+			client = server.clients[i];
+			fds[i + FIRST_CLIENT].fd = client == server.busy ? -1 : client->fd;
+			fds[i + FIRST_CLIENT].events = client->out_used > 0 ? POLLOUT : 0;
+
+			/* Nothing more is read from a connection that doesn't take
+			   what it's sent. */
+			if((client == server.busy) || client->closing || (client->out_used >= OUT_LIMIT)) continue;
+
+			/* One that waits for the writer waits for wake instead. */
+			if(reads_only(&server, client) || ((server.busy == NULL) && ready(&server, client)))
+				pending = 1;
+			else if(wants_input(&server, client))
+				fds[i + FIRST_CLIENT].events |= POLLIN;
+			else if(client->out_used == 0)
+				fds[i + FIRST_CLIENT].fd = -1;
+		}
+
+		/* Sessions with a line waiting don't have to wait for more. */
+		if(poll(fds, server.n_clients + FIRST_CLIENT, pending ? 0 : -1) < 0) {
+			if(errno == EINTR) continue;
+			perror(APP_NAME);
+			status = RET_ERR_READ;
+			break;
+		}
+
+		/* Back to front, since closing moves the last one up. */
+		for(i = server.n_clients; i > 0; i--) {
+			client = server.clients[i - 1];
+			if(client == server.busy) continue;
+
+			if((fds[i - 1 + FIRST_CLIENT].revents & (POLLOUT | POLLHUP | POLLERR)) && (flush_out(client) != RET_OK)) {
+				close_client(&server, i - 1);
+				continue;
+			}
+
+			if(!client->closing && (client->out_used < OUT_LIMIT)) {
+				reading = reads_only(&server, client);
+				if(!reading && (fds[i - 1 + FIRST_CLIENT].revents & (POLLIN | POLLHUP | POLLERR)) &&
+					wants_input(&server, client)) {
+					fill(client);
+					reading = reads_only(&server, client);
+				}
+
+				if(reading) {
+					if(!after_line(&server, i - 1, read_line(&server, client)))
+						continue;
+				} else if((server.busy == NULL) && ready(&server, client)) {
+					hand_over(&server, client);
+					continue;
+				}
+			}
+
+			if(client->closing && (client->out_used == 0))
+				close_client(&server, i - 1);
+		}
+
+		if((fds[1].revents & POLLIN) && (server.busy != NULL) && writer_done(&server)) {
+			client = server.busy;
+			server.busy = NULL;
+			for(i = 0; (i < server.n_clients) && (server.clients[i] != client); i++);
+			if(after_line(&server, i, server.job_status) && client->closing && (client->out_used == 0))
+				close_client(&server, i);
+		}
+
+		if(fds[0].revents & POLLIN) {
+			if((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+				if(add_client(&server, fd) != RET_OK)
+					close(fd);
+			}
+		}
+	}
+
+	if(started) {
+		ed_lock(&server.lock);
+		server.shut_down = 1;
+		ed_cond_broadcast(&server.cond);
+		ed_unlock(&server.lock);
+		ed_thread_join(server.writer);
+	}
+
+	while(server.n_clients > 0)
+		close_client(&server, server.n_clients - 1);
+
+done:
+	if(server.scratch != NULL) fclose(server.scratch);
+	if(server.reads != NULL) fclose(server.reads);
+	if(server.wake[0] >= 0) close(server.wake[0]);
+	if(server.wake[1] >= 0) close(server.wake[1]);
+	edps_free(server.probe);
+	ed_cond_free(&server.cond);
+	ed_lock_free(&server.lock);
+	free(server.clients);
+	free(fds);
+	close(server.saved_out);
+	close(server.saved_err);
+	close(listen_fd);
+	unlink(path);
+
+	return status;
+}
+
+#else
+
+int edsv_serve(const char *path, ed_doc_t *document, const char *prompt, const char *cursor_marker, const int quiet) {
+	fprintf(stderr, "%s: The server needs Unix domain sockets.\n", APP_NAME);
+	return RET_ERR_INTERNAL;
+}
+
+#endif
@@ -0,0 +1,13 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "repl.h"
+
+int edsv_serve(const char *path, ed_doc_t *document, const char *prompt, const char *cursor_marker, const int quiet);
+
+#endif
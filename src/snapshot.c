@@ -0,0 +1,351 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+
+#include "dynarr.h"
+#include "ermac.h"
+#include "lines.h"
+#include "search.h"
+#include "snapshot.h"
+#include "thread.h"
+
+/* Lines per chunk. An edit only copies the chunks it touches (and the
+   ones after it, if lines were inserted or deleted); all the others are
+   shared with the version before. */
+#define EDSN_CHUNK			1024
+#define PREALLOC_RETIRED	1024
+
+struct edsn_version_t {
+	uint64_t epoch;
+	uint64_t n_lines;
+	size_t n_chunks;
+	char ***chunks;
+
+	uint32_t pins;
+	edsn_version_t *next;
+};
+
+/* Something that was taken out of the table, and the epoch of the first
+   version without it. It can go once no older version is pinned. */
+typedef struct edsn_retired_t {
+	uint64_t epoch;
+	void *ptr;
+	int is_line;
+} edsn_retired_t;
+
+struct edsn_t {
+	ed_lock_t lock;
+	dynarr_t *lines;
+
+	uint64_t epoch;
+	edsn_version_t *oldest, *current;
+
+	/* One R can retire a line per match, so this grows by doubling. */
+	edsn_retired_t *retired;
+	size_t n_retired, retired_alloced;
+
+	/* What changed since the current version. Line numbers after
+	   dirty_hi have only moved if shifted is set. */
+	int dirty, shifted;
+	uint64_t dirty_lo, dirty_hi;
+};
+
+/**/
+
+static void release_line(void *ctx, void *element) {
+	char **line = element;
+
+	edsn_retire(ctx, *line);
+}
+
+/* Lines may still be in the table elsewhere. */
+static void free_retired(edsn_retired_t *retired) {
+	if(retired->is_line)
+		edln_free(retired->ptr);
+	else
+		free(retired->ptr);
+}
+
+static void free_version(edsn_version_t *version) {
+	free(version->chunks);
+	free(version);
+}
+
+static size_t chunk_length(const uint64_t n_lines, const size_t chunk) {
+	size_t first = chunk * EDSN_CHUNK;
+
+	if(first >= n_lines) return 0;
+	return n_lines - first < EDSN_CHUNK ? n_lines - first : EDSN_CHUNK;
+}
+
+/* Whether a chunk of the new version holds the same lines as the one in
+   the old version. */
+static int unchanged(const edsn_t *sn, const edsn_version_t *prev, const uint64_t n_lines, const size_t chunk) {
+	size_t first = chunk * EDSN_CHUNK, length = chunk_length(n_lines, chunk);
+
+	if((prev == NULL) || (chunk >= prev->n_chunks)) return 0;
+	if(chunk_length(prev->n_lines, chunk) != length) return 0;
+
+	if(first + length <= sn->dirty_lo) return 1;
+	if(!sn->shifted && (first > sn->dirty_hi)) return 1;
+
+	return 0;
+}
+
+static void retire(edsn_t *sn, void *ptr, const int is_line, const uint64_t epoch) {
+	edsn_retired_t *new_retired;
+	size_t new_size;
+
+	if(sn->n_retired == sn->retired_alloced) {
+		new_size = sn->retired_alloced * 2;
+
+		/* Without room to keep it, it can't be freed safely. Leak it. */
+		if((new_retired = realloc(sn->retired, new_size * sizeof(edsn_retired_t))) == NULL)
+			return;
+		sn->retired = new_retired;
+		sn->retired_alloced = new_size;
+	}
+
+	sn->retired[sn->n_retired].epoch = epoch;
+	sn->retired[sn->n_retired].ptr = ptr;
+	sn->retired[sn->n_retired].is_line = is_line;
+	sn->n_retired++;
+}
+
+/**/
+
+edsn_t *edsn_new(dynarr_t *lines, const uint64_t n_lines) {
+	edsn_t *out;
+
+	if(lines == NULL) return NULL;
+
+	if((out = malloc(sizeof(edsn_t))) == NULL) return NULL;
+	if((out->retired = malloc(PREALLOC_RETIRED * sizeof(edsn_retired_t))) == NULL) {
+		free(out);
+		return NULL;
+	}
+	out->n_retired = 0;
+	out->retired_alloced = PREALLOC_RETIRED;
+
+	ed_lock_init(&out->lock);
+	out->lines = lines;
+	out->epoch = 0;
+	out->oldest = out->current = NULL;
+	out->dirty = out->shifted = 1;
+	out->dirty_lo = 0;
+	out->dirty_hi = 0;
+
+	if(edsn_publish(out, n_lines) != RET_OK) {
+		edsn_free(out);
+		return NULL;
+	}
+
+	dynarr_set_release(lines, release_line, out);
+	return out;
+}
+
+/* Nobody may have a version pinned anymore. */
+void edsn_free(edsn_t *sn) {
+	edsn_version_t *version, *next;
+	size_t i;
+
+	if(sn == NULL) return;
+
+	dynarr_set_release(sn->lines, NULL, NULL);
+
+	for(i = 0; i < sn->n_retired; i++)
+		free_retired(&sn->retired[i]);
+	free(sn->retired);
+
+	/* The chunks of older versions are either shared with the current
+	   one or were retired. */
+	if(sn->current != NULL) {
+		for(i = 0; i < sn->current->n_chunks; i++)
+			free(sn->current->chunks[i]);
+	}
+	for(version = sn->oldest; version != NULL; version = next) {
+		next = version->next;
+		free_version(version);
+	}
+
+	ed_lock_free(&sn->lock);
+	free(sn);
+}
+
+/**/
+
+/* Takes the same arguments as the search memo's update. */
+void edsn_changed(edsn_t *sn, const size_t first, const size_t n_removed, const size_t n_inserted) {
+	size_t span = n_removed > n_inserted ? n_removed : n_inserted;
+
+	if((sn == NULL) || (span == 0)) return;
+
+	if(!sn->dirty || (first < sn->dirty_lo)) sn->dirty_lo = first;
+	if(!sn->dirty || (first + span - 1 > sn->dirty_hi)) sn->dirty_hi = first + span - 1;
+	if(n_removed != n_inserted) sn->shifted = 1;
+	sn->dirty = 1;
+}
+
+/* A line that's no longer in the table. Readers may still be looking at
+   it, so it's freed later. */
+void edsn_retire(edsn_t *sn, void *line) {
+	if(sn == NULL) return;
+	retire(sn, line, 1, sn->epoch + 1);
+}
+
+/* Makes the table as it is now the version new readers get. */
+int edsn_publish(edsn_t *sn, const uint64_t n_lines) {
+	edsn_version_t *prev, *version;
+	size_t i, length;
+	char **first;
+
+	if(sn == NULL) return RET_ERR_NULLPO;
+	if(!sn->dirty) return RET_OK;
+
+	prev = sn->current;
+
+	if((version = malloc(sizeof(edsn_version_t))) == NULL)
+		return RET_ERR_MALLOC;
+	version->n_lines = n_lines;
+	version->n_chunks = (n_lines + EDSN_CHUNK - 1) / EDSN_CHUNK;
+	version->pins = 0;
+	version->next = NULL;
+	if((version->chunks = calloc(version->n_chunks + 1, sizeof(char**))) == NULL) {
+		free(version);
+		return RET_ERR_MALLOC;
+	}
+
+	for(i = 0; i < version->n_chunks; i++) {
+		if(unchanged(sn, prev, n_lines, i)) {
+			version->chunks[i] = prev->chunks[i];
+			continue;
+		}
+
+		length = chunk_length(n_lines, i);
+		if(((version->chunks[i] = malloc(length * sizeof(char*))) == NULL) ||
+			((first = dynarr_get_element(sn->lines, i * EDSN_CHUNK)) == NULL)) {
+			while(i > 0) {
+				i--;
+				if((prev == NULL) || (i >= prev->n_chunks) || (version->chunks[i] != prev->chunks[i]))
+					free(version->chunks[i]);
+			}
+			free_version(version);
+			return RET_ERR_MALLOC;
+		}
+		memcpy(version->chunks[i], first, length * sizeof(char*));
+	}
+
+	if(prev != NULL) {
+		for(i = 0; i < prev->n_chunks; i++) {
+			if((i >= version->n_chunks) || (version->chunks[i] != prev->chunks[i]))
+				retire(sn, prev->chunks[i], 0, sn->epoch + 1);
+		}
+	}
+
+	ed_lock(&sn->lock);
+	version->epoch = ++sn->epoch;
+	if(prev != NULL) prev->next = version;
+	else sn->oldest = version;
+	sn->current = version;
+	ed_unlock(&sn->lock);
+
+	sn->dirty = sn->shifted = 0;
+	edsn_reclaim(sn);
+
+	return RET_OK;
+}
+
+/* Frees what no pinned version can see anymore, and the versions that
+   aren't pinned. */
+void edsn_reclaim(edsn_t *sn) {
+	edsn_version_t *version, **link;
+	uint64_t oldest_pinned;
+	size_t n_free;
+
+	if(sn == NULL) return;
+
+	ed_lock(&sn->lock);
+	oldest_pinned = sn->epoch;
+	for(link = &sn->oldest; (version = *link) != NULL;) {
+		if(version->pins > 0) {
+			if(version->epoch < oldest_pinned) oldest_pinned = version->epoch;
+			link = &version->next;
+		} else if(version != sn->current) {
+			*link = version->next;
+			free_version(version);
+		} else {
+			link = &version->next;
+		}
+	}
+	ed_unlock(&sn->lock);
+
+	/* Retired in epoch order, so it's always the front of the list. */
+	for(n_free = 0; n_free < sn->n_retired; n_free++) {
+		if(sn->retired[n_free].epoch > oldest_pinned) break;
+		free_retired(&sn->retired[n_free]);
+	}
+	if(n_free > 0) {
+		memmove(sn->retired, sn->retired + n_free, (sn->n_retired - n_free) * sizeof(edsn_retired_t));
+		sn->n_retired -= n_free;
+	}
+}
+
+/**/
+
+/* The version stays as it is until it's unpinned. */
+const edsn_version_t *edsn_pin(edsn_t *sn) {
+	edsn_version_t *out;
+
+	if(sn == NULL) return NULL;
+
+	ed_lock(&sn->lock);
+	out = sn->current;
+	out->pins++;
+	ed_unlock(&sn->lock);
+
+	return out;
+}
+
+void edsn_unpin(edsn_t *sn, const edsn_version_t *version) {
+	if((sn == NULL) || (version == NULL)) return;
+
+	ed_lock(&sn->lock);
+	((edsn_version_t*)version)->pins--;
+	ed_unlock(&sn->lock);
+}
+
+uint64_t edsn_epoch(const edsn_version_t *version) {
+	if(version == NULL) return 0;
+	return version->epoch;
+}
+
+uint64_t edsn_n_lines(const edsn_version_t *version) {
+	if(version == NULL) return 0;
+	return version->n_lines;
+}
+
+const char *edsn_line(const edsn_version_t *version, const uint64_t line) {
+	if((version == NULL) || (line >= version->n_lines)) return NULL;
+	return version->chunks[line / EDSN_CHUNK][line % EDSN_CHUNK];
+}
+
+/* The first line from the given one on that has the pattern in it. */
+uint64_t edsn_find(const edsn_version_t *version, const uint64_t from, const char *pattern, const int flags) {
+	uint64_t i;
+
+	if((version == NULL) || (pattern == NULL)) return EDSN_NOT_FOUND;
+
+	for(i = from; i < version->n_lines; i++) {
+		if(edsr_find(version->chunks[i / EDSN_CHUNK][i % EDSN_CHUNK], pattern, flags) != NULL)
+			return i;
+	}
+
+	return EDSN_NOT_FOUND;
+}
@@ -0,0 +1,38 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include "dynarr.h"
+
+/* Read-only versions of a line table, for readers on other threads.
+   All edsn_ functions but edsn_pin(), edsn_unpin() and the ones taking a
+   version belong to the thread that edits the table. */
+
+#define EDSN_NOT_FOUND		UINT64_MAX
+
+typedef struct edsn_t edsn_t;
+typedef struct edsn_version_t edsn_version_t;
+
+edsn_t *edsn_new(dynarr_t *lines, const uint64_t n_lines);
+void edsn_free(edsn_t *sn);
+
+void edsn_changed(edsn_t *sn, const size_t first, const size_t n_removed, const size_t n_inserted);
+void edsn_retire(edsn_t *sn, void *line);
+int edsn_publish(edsn_t *sn, const uint64_t n_lines);
+void edsn_reclaim(edsn_t *sn);
+
+const edsn_version_t *edsn_pin(edsn_t *sn);
+void edsn_unpin(edsn_t *sn, const edsn_version_t *version);
+
+uint64_t edsn_epoch(const edsn_version_t *version);
+uint64_t edsn_n_lines(const edsn_version_t *version);
+const char *edsn_line(const edsn_version_t *version, const uint64_t line);
+uint64_t edsn_find(const edsn_version_t *version, const uint64_t from, const char *pattern, const int flags);
+
+#endif
@@ -0,0 +1,155 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+/* How line-range work scales with the number of workers: counts the
+   matches of a few patterns over the given files (repeated until there
+   are enough lines) with 1 to N threads. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+#include "mem.h"
+
+#include "dynarr.h"
+#include "ermac.h"
+#include "repl.h"
+#include "search.h"
+#include "tasks.h"
+#include "thread.h"
+
+#define BENCH_NAME			"edison-taskbench"
+#define MIN_LINES			2000000
+#define REPEATS				5
+
+static const char *patterns[] = { "the", "Bloom", "yes I said yes", "qqq" };
+static const char *default_files[] = { "samples/lowerulysses.txt", "samples/raven.txt" };
+
+static double now(void) {
+#ifdef _WIN32
+	return (double)clock() / CLOCKS_PER_SEC;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+#endif
+}
+
+/* The corpus only points at the lines of the documents, over and over. */
+static dynarr_t *build_corpus(ed_doc_t **docs, const size_t n_docs) {
+	dynarr_t *out;
+	char **line;
+	size_t i, n_lines = 0;
+	uint32_t j;
+
+	if((out = dynarr_new(sizeof(char*), MIN_LINES, NULL)) == NULL) return NULL;
+
+	while(n_lines < MIN_LINES) {
+		for(i = 0; i < n_docs; i++) {
+			for(j = 0; j < docs[i]->n_lines; j++) {
+				line = dynarr_get_element(docs[i]->lines_arr, j);
+				if(dynarr_append(out, line) != RET_OK) {
+					dynarr_free(out);
+					return NULL;
+				}
+				n_lines++;
+			}
+		}
+		if(n_lines == 0) break;
+	}
+
+	return out;
+}
+
+static double run(const dynarr_t *corpus, size_t *total) {
+	size_t n_lines, n_matches, i, r;
+	double start;
+
+	*total = 0;
+	start = now();
+	for(r = 0; r < REPEATS; r++) {
+		for(i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+			edsr_count_lines(corpus, 0, dynarr_get_size(corpus), patterns[i], EDSR_NOCASE, &n_lines, &n_matches);
+			*total += n_matches;
+		}
+	}
+
+	return now() - start;
+}
+
+int main(int argc, char **argv) {
+	const char **files = default_files;
+	size_t n_files = sizeof(default_files) / sizeof(default_files[0]);
+	ed_doc_t **docs;
+	dynarr_t *corpus;
+	unsigned max_threads, n;
+	size_t i, total, first_total = 0;
+	double seconds, first = 0;
+	FILE *fp;
+
+	max_threads = ed_n_cpus();
+	if((argc > 2) && !strcmp(argv[1], "-j")) {
+		max_threads = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+	if(max_threads < 1) max_threads = 1;
+	if(argc > 1) {
+		files = (const char **)argv + 1;
+		n_files = argc - 1;
+	}
+
+	if((docs = calloc(n_files, sizeof(ed_doc_t*))) == NULL) return EXIT_FAILURE;
+	for(i = 0; i < n_files; i++) {
+		if((fp = fopen(files[i], "rb")) == NULL) {
+			fprintf(stderr, "%s: Can't open '%s'.\n", BENCH_NAME, files[i]);
+			return EXIT_FAILURE;
+		}
+		docs[i] = load_doc(fp, files[i], 1);
+		fclose(fp);
+		if(docs[i] == NULL) return EXIT_FAILURE;
+	}
+
+	if((corpus = build_corpus(docs, n_files)) == NULL) return EXIT_FAILURE;
+
+	printf("%zu lines, %zu patterns, %d runs each, %u CPUs.\n",
+		dynarr_get_size(corpus), sizeof(patterns) / sizeof(patterns[0]), REPEATS, ed_n_cpus());
+	printf("threads    seconds    lines/s    speedup\n");
+
+	for(n = 1; n <= max_threads; n++) {
+		edtk_init(n);
+		seconds = run(corpus, &total);
+		edtk_shutdown();
+
+		if(n == 1) {
+			first = seconds;
+			first_total = total;
+		} else if(total != first_total) {
+			fprintf(stderr, "%s: %u threads counted %zu matches instead of %zu.\n", BENCH_NAME, n, total, first_total);
+		}
+
+		printf("%7u %10.3f %10.0f %9.2fx\n", n, seconds,
+			dynarr_get_size(corpus) * (double)REPEATS * (sizeof(patterns) / sizeof(patterns[0])) / seconds,
+			first / seconds);
+	}
+
+	dynarr_free(corpus);
+	for(i = 0; i < n_files; i++)
+		free_doc(docs[i]);
+	free(docs);
+
+#if defined _DEBUG
+	mem_summary(stderr, RET_YES);
+#endif
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,423 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "mem.h"
+
+#include "ermac.h"
+#include "tasks.h"
+#include "thread.h"
+
+/* Ranges are only ever halved, so a worker's queue never gets deeper
+   than the number of bits in a line number. */
+#define EDTK_DEPTH			64
+#define EDTK_MAX_THREADS	256
+
+/* Without a grain size, a range is cut into about this many pieces
+   per worker, but never into pieces smaller than EDTK_MIN_GRAIN. */
+#define EDTK_PIECES			16
+#define EDTK_MIN_GRAIN		256
+
+typedef struct edtk_range_t {
+	size_t start, end;
+} edtk_range_t;
+
+/* The owner works at the tail, thieves take from the head, where the
+   biggest ranges are. */
+typedef struct edtk_deque_t {
+	ed_lock_t lock;
+	edtk_range_t ranges[EDTK_DEPTH];
+	size_t head, tail;
+} edtk_deque_t;
+
+typedef struct edtk_worker_t {
+	unsigned index;
+	ed_thread_t thread;
+	edtk_deque_t deque;
+} edtk_worker_t;
+
+typedef struct edtk_pool_t {
+	unsigned n_workers;
+	edtk_worker_t *workers;
+
+	/* Everything below is guarded by the lock. */
+	ed_lock_t lock;
+	ed_cond_t job_cond, work_cond, done_cond;
+	int stop, busy;
+	unsigned generation, n_active, n_idle;
+
+	/* The loop that's running. */
+	edtk_body_t body;
+	void *ctx;
+	size_t grain, remaining;
+	volatile int *cancel;
+	int cancelled, status;
+} edtk_pool_t;
+
+static edtk_pool_t *pool = NULL;
+
+/**/
+
+unsigned ed_n_cpus(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+	long n;
+
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? n : 1;
+#endif
+}
+
+static int push(edtk_deque_t *deque, const size_t start, const size_t end) {
+	int pushed = 0;
+
+	ed_lock(&deque->lock);
+	if(deque->head == deque->tail)
+		deque->head = deque->tail = 0;
+	if(deque->tail < EDTK_DEPTH) {
+		deque->ranges[deque->tail].start = start;
+		deque->ranges[deque->tail].end = end;
+		deque->tail++;
+		pushed = 1;
+	}
+	ed_unlock(&deque->lock);
+
+	return pushed;
+}
+
+static int pop(edtk_deque_t *deque, edtk_range_t *range) {
+	int popped = 0;
+
+	ed_lock(&deque->lock);
+	if(deque->tail > deque->head) {
+		*range = deque->ranges[--deque->tail];
+		popped = 1;
+	}
+	ed_unlock(&deque->lock);
+
+	return popped;
+}
+
+static int steal(edtk_deque_t *deque, edtk_range_t *range) {
+	int stolen = 0;
+
+	ed_lock(&deque->lock);
+	if(deque->tail > deque->head) {
+		*range = deque->ranges[deque->head++];
+		stolen = 1;
+	}
+	ed_unlock(&deque->lock);
+
+	return stolen;
+}
+
+static int is_empty(edtk_deque_t *deque) {
+	int empty;
+
+	ed_lock(&deque->lock);
+	empty = deque->tail == deque->head;
+	ed_unlock(&deque->lock);
+
+	return empty;
+}
+
+static int find_work(const unsigned index, edtk_range_t *range) {
+	unsigned i;
+
+	if(pop(&pool->workers[index].deque, range)) return 1;
+
+	for(i = 1; i < pool->n_workers; i++) {
+		if(steal(&pool->workers[(index + i) % pool->n_workers].deque, range))
+			return 1;
+	}
+
+	return 0;
+}
+
+static int any_work(void) {
+	unsigned i;
+
+	for(i = 0; i < pool->n_workers; i++) {
+		if(!is_empty(&pool->workers[i].deque)) return 1;
+	}
+
+	return 0;
+}
+
+/**/
+
+/* Books a finished (or skipped) part of the range. Returns whether the
+   loop has been called off. */
+static int account(const size_t n_done, const int status) {
+	int cancelled;
+
+	ed_lock(&pool->lock);
+	if((status != RET_OK) && !pool->cancelled) {
+		pool->status = status;
+		pool->cancelled = 1;
+	}
+	if((pool->cancel != NULL) && *pool->cancel)
+		pool->cancelled = 1;
+
+	pool->remaining -= n_done;
+	if(pool->remaining == 0)
+		ed_cond_broadcast(&pool->work_cond);
+
+	cancelled = pool->cancelled;
+	ed_unlock(&pool->lock);
+
+	return cancelled;
+}
+
+static void offer(const unsigned index, const size_t start, const size_t end) {
+	push(&pool->workers[index].deque, start, end);
+
+	ed_lock(&pool->lock);
+	if(pool->n_idle > 0)
+		ed_cond_broadcast(&pool->work_cond);
+	ed_unlock(&pool->lock);
+}
+
+/* Works through a range a grain at a time. Whenever the worker's own
+   queue has run dry, which is when somebody stole from it or at the
+   start, the back half of what's left is put up for grabs. That way a
+   range is only split as far as there are idle workers to take it. */
+static void run_range(const unsigned index, edtk_range_t range) {
+	edtk_deque_t *deque = &pool->workers[index].deque;
+	size_t chunk_end, middle;
+	int cancelled, status;
+
+	cancelled = account(0, RET_OK);
+	while(range.start < range.end) {
+		if(cancelled) {
+			account(range.end - range.start, RET_OK);
+			return;
+		}
+
+		if((range.end - range.start > 2 * pool->grain) && is_empty(deque)) {
+			middle = range.start + (range.end - range.start) / 2;
+			offer(index, middle, range.end);
+			range.end = middle;
+		}
+
+		chunk_end = range.start + pool->grain < range.end ? range.start + pool->grain : range.end;
+		status = pool->body(pool->ctx, range.start, chunk_end, index);
+		cancelled = account(chunk_end - range.start, status);
+		range.start = chunk_end;
+	}
+}
+
+static void work(const unsigned index) {
+	edtk_range_t range;
+
+	for(;;) {
+		if(find_work(index, &range)) {
+			run_range(index, range);
+			continue;
+		}
+
+		ed_lock(&pool->lock);
+		if(pool->remaining == 0) {
+			ed_unlock(&pool->lock);
+			return;
+		}
+
+		/* Somebody is still at it and might split off more. */
+		pool->n_idle++;
+		if(!any_work())
+			ed_cond_wait(&pool->work_cond, &pool->lock);
+		pool->n_idle--;
+		ed_unlock(&pool->lock);
+	}
+}
+
+ED_THREAD_FUNC(worker_main, arg) {
+	edtk_worker_t *worker = arg;
+	unsigned seen = 0;
+
+	ed_lock(&pool->lock);
+	for(;;) {
+		while((pool->generation == seen) && !pool->stop)
+			ed_cond_wait(&pool->job_cond, &pool->lock);
+		if(pool->stop) break;
+
+		seen = pool->generation;
+		pool->n_active++;
+		ed_unlock(&pool->lock);
+
+		work(worker->index);
+
+		ed_lock(&pool->lock);
+		if(--pool->n_active == 0)
+			ed_cond_broadcast(&pool->done_cond);
+	}
+	ed_unlock(&pool->lock);
+
+	ED_THREAD_RETURN;
+}
+
+/**/
+
+/* Starts the workers. The calling thread is one of them, so it takes
+   n_threads - 1 new threads; 0 means one per CPU. */
+int edtk_init(const unsigned n_threads) {
+	unsigned i, n_started;
+
+	if(pool != NULL) return RET_OK;
+
+	if((pool = malloc(sizeof(edtk_pool_t))) == NULL)
+		return RET_ERR_MALLOC;
+
+	pool->n_workers = n_threads > 0 ? n_threads : ed_n_cpus();
+	if(pool->n_workers > EDTK_MAX_THREADS) pool->n_workers = EDTK_MAX_THREADS;
+
+	if((pool->workers = calloc(pool->n_workers, sizeof(edtk_worker_t))) == NULL) {
+		free(pool);
+		pool = NULL;
+		return RET_ERR_MALLOC;
+	}
+
+	ed_lock_init(&pool->lock);
+	ed_cond_init(&pool->job_cond);
+	ed_cond_init(&pool->work_cond);
+	ed_cond_init(&pool->done_cond);
+	pool->stop = pool->busy = 0;
+	pool->generation = pool->n_active = pool->n_idle = 0;
+	pool->remaining = 0;
+
+	for(i = 0; i < pool->n_workers; i++) {
+		pool->workers[i].index = i;
+		ed_lock_init(&pool->workers[i].deque.lock);
+		pool->workers[i].deque.head = pool->workers[i].deque.tail = 0;
+	}
+
+	for(n_started = 1; n_started < pool->n_workers; n_started++) {
+		if(!ed_thread_start(&pool->workers[n_started].thread, worker_main, &pool->workers[n_started]))
+			break;
+	}
+
+	/* Make do with the ones that could be started. */
+	pool->n_workers = n_started;
+
+	return RET_OK;
+}
+
+void edtk_shutdown(void) {
+	unsigned i;
+
+	if(pool == NULL) return;
+
+	ed_lock(&pool->lock);
+	pool->stop = 1;
+	ed_cond_broadcast(&pool->job_cond);
+	ed_unlock(&pool->lock);
+
+	for(i = 1; i < pool->n_workers; i++)
+		ed_thread_join(pool->workers[i].thread);
+
+	for(i = 0; i < pool->n_workers; i++)
+		ed_lock_free(&pool->workers[i].deque.lock);
+	ed_cond_free(&pool->job_cond);
+	ed_cond_free(&pool->work_cond);
+	ed_cond_free(&pool->done_cond);
+	ed_lock_free(&pool->lock);
+
+	free(pool->workers);
+	free(pool);
+	pool = NULL;
+}
+
+unsigned edtk_workers(void) {
+	return pool != NULL ? pool->n_workers : 1;
+}
+
+/**/
+
+static int run_alone(const size_t start, const size_t end, const size_t grain,
+	edtk_body_t body, void *ctx, volatile int *cancel) {
+	size_t i, chunk_end;
+	int status;
+
+	for(i = start; i < end; i = chunk_end) {
+		if((cancel != NULL) && *cancel) return RET_OK;
+
+		chunk_end = i + grain < end ? i + grain : end;
+		if((status = body(ctx, i, chunk_end, 0)) != RET_OK)
+			return status;
+	}
+
+	return RET_OK;
+}
+
+/* Calls body on pieces of [start, end) on all the workers and returns
+   when they're through. The pieces are at most grain lines long; with a
+   grain of 0, that's worked out from the size of the range. Setting
+   *cancel, or the body returning anything but RET_OK, stops the loop
+   once the pieces being worked on are done. Loops started from inside a
+   body, or while another thread has one running, run on their own. */
+int edtk_for(const size_t start, const size_t end, const size_t grain,
+	edtk_body_t body, void *ctx, volatile int *cancel) {
+	size_t actual_grain = grain;
+	int status;
+
+	if(body == NULL) return RET_ERR_NULLPO;
+	if(end <= start) return RET_OK;
+
+	if(actual_grain == 0) {
+		actual_grain = (end - start) / (edtk_workers() * EDTK_PIECES);
+		if(actual_grain < EDTK_MIN_GRAIN) actual_grain = EDTK_MIN_GRAIN;
+	}
+
+	if((pool == NULL) || (pool->n_workers < 2) || (end - start <= actual_grain))
+		return run_alone(start, end, actual_grain, body, ctx, cancel);
+
+	ed_lock(&pool->lock);
+	if(pool->busy) {
+		ed_unlock(&pool->lock);
+		return run_alone(start, end, actual_grain, body, ctx, cancel);
+	}
+
+	/* Stragglers from the last loop have to be out first. */
+	while(pool->n_active > 0)
+		ed_cond_wait(&pool->done_cond, &pool->lock);
+
+	pool->busy = 1;
+	pool->body = body;
+	pool->ctx = ctx;
+	pool->grain = actual_grain;
+	pool->remaining = end - start;
+	pool->cancel = cancel;
+	pool->cancelled = 0;
+	pool->status = RET_OK;
+	ed_unlock(&pool->lock);
+
+	push(&pool->workers[0].deque, start, end);
+
+	ed_lock(&pool->lock);
+	pool->generation++;
+	ed_cond_broadcast(&pool->job_cond);
+	ed_unlock(&pool->lock);
+
+	work(0);
+
+	ed_lock(&pool->lock);
+	while(pool->n_active > 0)
+		ed_cond_wait(&pool->done_cond, &pool->lock);
+	status = pool->status;
+	pool->busy = 0;
+	ed_unlock(&pool->lock);
+
+	return status;
+}
@@ -0,0 +1,26 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef TASKS_H_
+#define TASKS_H_
+
+#include <stddef.h>
+
+/* The one set of worker threads everything that runs in parallel
+   shares. Until edtk_init() is called, or when it was asked for a single
+   thread, edtk_for() simply runs on the calling thread. */
+
+/* Runs [start, end) of the range on the given worker (0 to
+   edtk_workers() - 1). Anything but RET_OK stops the whole loop. */
+typedef int (*edtk_body_t)(void *ctx, const size_t start, const size_t end, const unsigned worker);
+
+int edtk_init(const unsigned n_threads);
+void edtk_shutdown(void);
+unsigned edtk_workers(void);
+
+int edtk_for(const size_t start, const size_t end, const size_t grain,
+	edtk_body_t body, void *ctx, volatile int *cancel);
+
+#endif
@@ -0,0 +1,66 @@
+/*******************************************
+ *  SPDX-License-Identifier: GPL-2.0-only  *
+ * Copyright (C) 2022-2023  Martin Wolters *
+ *******************************************/
+
+#ifndef THREAD_H_
+#define THREAD_H_
+
+/* Just enough of threads, locks and condition variables to get by on
+   both Windows and everything with pthreads. */
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef SRWLOCK ed_lock_t;
+typedef CONDITION_VARIABLE ed_cond_t;
+typedef HANDLE ed_thread_t;
+
+#define ED_LOCK_INITIALIZER		SRWLOCK_INIT
+#define ed_lock_init(l)			InitializeSRWLock(l)
+#define ed_lock_free(l)
+#define ed_lock(l)				AcquireSRWLockExclusive(l)
+#define ed_unlock(l)			ReleaseSRWLockExclusive(l)
+
+#define ed_cond_init(c)			InitializeConditionVariable(c)
+#define ed_cond_free(c)
+#define ed_cond_wait(c, l)		SleepConditionVariableSRW(c, l, INFINITE, 0)
+#define ed_cond_broadcast(c)	WakeAllConditionVariable(c)
+
+#define ED_THREAD_FUNC(name, arg)	static DWORD WINAPI name(LPVOID arg)
+#define ED_THREAD_RETURN		return 0
+#define ed_thread_start(t, f, arg)	((*(t) = CreateThread(NULL, 0, f, arg, 0, NULL)) != NULL)
+#define ed_thread_join(t)		do { WaitForSingleObject(t, INFINITE); CloseHandle(t); } while(0)
+
+#define ED_THREAD_LOCAL			__declspec(thread)
+
+#else
+#include <pthread.h>
+
+typedef pthread_mutex_t ed_lock_t;
+typedef pthread_cond_t ed_cond_t;
+typedef pthread_t ed_thread_t;
+
+#define ED_LOCK_INITIALIZER		PTHREAD_MUTEX_INITIALIZER
+#define ed_lock_init(l)			pthread_mutex_init(l, NULL)
+#define ed_lock_free(l)			pthread_mutex_destroy(l)
+#define ed_lock(l)				pthread_mutex_lock(l)
+#define ed_unlock(l)			pthread_mutex_unlock(l)
+
+#define ed_cond_init(c)			pthread_cond_init(c, NULL)
+#define ed_cond_free(c)			pthread_cond_destroy(c)
+#define ed_cond_wait(c, l)		pthread_cond_wait(c, l)
+#define ed_cond_broadcast(c)	pthread_cond_broadcast(c)
+
+#define ED_THREAD_FUNC(name, arg)	static void *name(void *arg)
+#define ED_THREAD_RETURN		return NULL
+#define ed_thread_start(t, f, arg)	(pthread_create(t, NULL, f, arg) == 0)
+#define ed_thread_join(t)		pthread_join(t, NULL)
+
+#define ED_THREAD_LOCAL			__thread
+
+#endif
+
+unsigned ed_n_cpus(void);
+
+#endif
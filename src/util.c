@@ -19,8 +19,7 @@
 
 #include "appinfo.h"
 #include "ermac.h"
-
-#define MAXBUF		1024
+#include "util.h"
 
 #ifndef _WIN32
 #include <termios.h>
@@ -144,9 +143,9 @@ int is_positive_integer(const char *str) {
 
 int is_good_integer(const char *str) {
 	int notzero = 0;
-	size_t len, pos = 0, cmp = 0, i;
-	const char min_int[] = "2147483648";
-	const char max_int[] = "2147483647";
+	size_t len, pos = 0, i;
+	const char min_int[] = "9223372036854775808";
+	const char max_int[] = "9223372036854775807";
 	const char *limit;
 
 	if(str == NULL) return RET_NO;
@@ -164,7 +163,7 @@ int is_good_integer(const char *str) {
 
 	/* All digits? */
 	for(i = pos; i < len; i++) {
-		if(!isxdigit(str[i])) return RET_NO;
+		if(!isdigit(str[i])) return RET_NO;
 		/* Skip leading zeroes, although I think it'd just be abuse. */
 		if(str[i] == '0') {
 			if(notzero == 0) {
@@ -174,18 +173,15 @@ int is_good_integer(const char *str) {
 			notzero = 1;
 		}
 	}
-	/* Numbers with less than 10 digits are good. */
-	if(len - pos < 10) return RET_YES;
-
-	for(i = pos; i < len; i++) {
-		if(str[i] > limit[cmp++])
-			return RET_NO;
-	}
+	/* Numbers with less digits than the limit are good, those with more
+	   aren't, and those with as many are compared to it. */
+	if(len - pos < sizeof(max_int) - 1) return RET_YES;
+	if(len - pos > sizeof(max_int) - 1) return RET_NO;
 
-	return RET_YES;
+	return strncmp(str + pos, limit, len - pos) <= 0 ? RET_YES : RET_NO;
 }
 
-uint32_t num_len(int i) {
+uint32_t num_len(uint64_t i) {
 	uint32_t out = 0;
 	while(i) {
 		i /= 10;
@@ -9,6 +9,9 @@
 #include <stdint.h>
 #include <stdio.h>
 
+/* get_line() reads in pieces of this size. */
+#define MAXBUF		1024
+
 char get_key(int *status);
 char *get_line(FILE *fp);
 void strtoupper(char *str);
@@ -17,7 +20,7 @@ char *str_alloc_copy(const char *str);
 int is_integer(const char *str);
 int is_positive_integer(const char *str);
 int is_good_integer(const char *str);
-uint32_t num_len(int i);
+uint32_t num_len(uint64_t i);
 
 int is_piped(FILE *fp);
 